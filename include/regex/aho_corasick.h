@@ -0,0 +1,62 @@
+//
+// Copyright [2020] <inhzus>
+//
+#ifndef REGEX_AHO_CORASICK_H_
+#define REGEX_AHO_CORASICK_H_
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "regex/exp.h"
+#include "regex/prefix.h"
+
+namespace regex {
+
+// Aho-Corasick automaton of patterns that are an alternation of many
+// literals, such as keyword lists. The trie is completed with its failure
+// transitions into a dense table indexed by byte class, so the search costs
+// one lookup per byte whatever the number of literals.
+//
+// Matches are leftmost-first: the earliest start wins, then the literal
+// that comes first in the pattern, as the backtracker would pick it.
+class AhoCorasick {
+ public:
+  // smaller alternations are left to the prefix literals and the DFAs
+  static constexpr size_t kMinLiterals = Prefix::kMaxLiterals + 1;
+  static constexpr size_t kMaxLiterals = size_t{1} << 16;
+
+  // Build the automaton of `exp`, returns false unless it is an alternation
+  // of `kMinLiterals` to `kMaxLiterals` non-empty literals, optionally
+  // wrapped in groups.
+  bool Build(const Exp &exp);
+  // Whether `s` contains any of the literals.
+  [[nodiscard]] bool Test(std::string_view s) const;
+  // Find the leftmost-first match, its span is [`*begin`, `*end`).
+  bool Search(std::string_view s, size_t *begin, size_t *end) const;
+
+  [[nodiscard]] size_t literal_num() const { return literal_num_; }
+  [[nodiscard]] size_t state_num() const { return depth_.size(); }
+
+ private:
+  static constexpr uint32_t kNone = UINT32_MAX;
+
+  [[nodiscard]] uint32_t Next(uint32_t state, char ch) const {
+    return trans_[state * stride_ + classes_[static_cast<uint8_t>(ch)]];
+  }
+
+  size_t literal_num_;
+  uint16_t classes_[256];  // bytes absent from every literal share class 0
+  size_t stride_;
+  std::vector<uint32_t> trans_;
+  std::vector<uint32_t> depth_;
+  // the longest literal ending at each state and its first index in the
+  // alternation, `match_len_` is 0 where none ends
+  std::vector<uint32_t> match_len_;
+  std::vector<uint32_t> match_idx_;
+};
+
+}  // namespace regex
+
+#endif  // REGEX_AHO_CORASICK_H_
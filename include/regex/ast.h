@@ -0,0 +1,69 @@
+//
+// Copyright [2020] <inhzus>
+//
+#ifndef REGEX_AST_H_
+#define REGEX_AST_H_
+
+#include <memory>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "regex/exp.h"
+
+namespace regex {
+
+// Rewrites `Ast::Simplify` applies, each of which may be turned off to
+// measure what it buys. None changes what a pattern matches or captures.
+struct AstPasses {
+  // "(?:a)" -> "a", and atomic groups around a body matching in one way
+  bool drop_groups = true;
+  // "abc|abd" -> "ab(?:c|d)", among adjacent alternatives
+  bool factor_prefixes = true;
+  // "a|b|[c-e]" -> "[a-e]", among adjacent alternatives
+  bool merge_classes = true;
+  // "(?:a*)*" -> "a*", "a*a+" -> "a+", on operands matching in one way
+  bool collapse_quantifiers = true;
+  // "a{2,3}" -> "aaa?", for bounds up to `Ast::kMaxUnrolled`
+  bool unroll_repeats = true;
+};
+
+// Tree form of an `Exp`, the stage between parsing and compilation where the
+// structure of the pattern can be rewritten. Concatenations and
+// alternations keep all their operands in one node, in order.
+class Ast {
+ public:
+  // copies a counted repetition is unrolled into at most, larger bounds keep
+  // their counter
+  static constexpr size_t kMaxUnrolled = 8;
+
+  struct Node {
+    explicit Node(Id &&id) : id(std::move(id)) {}
+
+    Id id;
+    std::vector<std::unique_ptr<Node>> children;
+  };
+
+  static Ast FromExp(Exp &&exp);
+
+  void Simplify(const AstPasses &passes = {});
+  // Lower back to postfix, leaving the tree empty.
+  Exp ToExp();
+
+  // null for the empty pattern
+  [[nodiscard]] const Node *root() const { return root_.get(); }
+  [[nodiscard]] size_t size() const;
+  // Whether both trees have the same shape and operands.
+  bool operator==(const Ast &ast) const;
+
+ private:
+  Ast() = default;
+
+  size_t group_num_ = 0;
+  std::unordered_map<std::string_view, size_t> named_group_;
+  std::unique_ptr<Node> root_;
+};
+
+}  // namespace regex
+
+#endif  // REGEX_AST_H_
@@ -0,0 +1,83 @@
+//
+// Copyright [2020] <inhzus>
+//
+#ifndef REGEX_BACKTRACK_H_
+#define REGEX_BACKTRACK_H_
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "regex/program.h"
+
+namespace regex {
+
+// Depth-first virtual machine running a `Program` with leftmost-first
+// semantics. Choice points are only pushed by `Split`, captures and loop
+// registers are restored while backtracking. A possessive `Split` pushes
+// none, the next byte picks its branch.
+//
+// When the program has no back-reference and a bit per (`Split`, position)
+// pair fits in `visit_budget` bits, every pair that was explored once is
+// known to fail and is not explored again, which bounds the search by
+// O(n * m). Instructions inside atomic groups and look-ahead bodies are not
+// memoized, their outcome depends on how they were entered.
+class Backtracker {
+ public:
+  explicit Backtracker(const Program &program, size_t visit_budget = 0);
+
+  // Search the leftmost match in `s`, `slots` receives the capture offsets
+  // (`Program::kUnset` for groups that did not participate).
+  bool Search(std::string_view s, std::vector<size_t> *slots,
+              Anchor anchor = Unanchored) {
+    return Search(s, 0, slots, anchor);
+  }
+  // Try the starts from `begin` on only, while "^" still tests the start of
+  // the whole text. An anchored search ignores `begin`.
+  bool Search(std::string_view s, size_t begin, std::vector<size_t> *slots,
+              Anchor anchor = Unanchored);
+
+ private:
+  struct Frame {
+    enum Kind : uint8_t { Barrier, Choice, Restore };
+
+    Kind kind;
+    uint32_t pc;  // slot index for `Restore`
+    size_t pos;   // previous slot value for `Restore`
+  };
+
+  bool Run(uint32_t pc, size_t pos);
+  void SetSlot(uint32_t slot, size_t val) {
+    stack_.push_back({Frame::Restore, slot, slots_[slot]});
+    slots_[slot] = val;
+  }
+  // Drop the choice points above `base` while keeping the restore frames.
+  void Cut(size_t base);
+  // Pop every frame above `base`, restoring the slots on the way.
+  void Unwind(size_t base);
+  // Whether (`pc`, `pos`) is seen for the first time, marking it visited.
+  bool Visit(uint32_t pc, size_t pos) {
+    size_t bit = pc * (s_.size() + 1) + pos;
+    uint64_t mask = uint64_t{1} << (bit & 63);
+    if (visited_[bit >> 6] & mask) return false;
+    visited_[bit >> 6] |= mask;
+    return true;
+  }
+
+  const Program &program_;
+  size_t visit_budget_;
+  std::string_view s_;
+  Anchor anchor_;
+  std::vector<Frame> stack_;
+  std::vector<size_t> slots_;
+  std::vector<uint8_t> memo_;  // whether a pc may be memoized
+  // whether a pc is the split of a greedy loop over one character class,
+  // whose iterations are scanned for at once
+  std::vector<uint8_t> run_;
+  bool memoize_;
+  std::vector<uint64_t> visited_;
+};
+
+}  // namespace regex
+
+#endif  // REGEX_BACKTRACK_H_
@@ -0,0 +1,89 @@
+//
+// Copyright [2020] <inhzus>
+//
+#ifndef REGEX_BYTE_SET_H_
+#define REGEX_BYTE_SET_H_
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "regex/exp.h"
+
+namespace regex {
+
+// Membership bitmap of the 256 byte values, the form `CharSet`s are compiled
+// into so that a lookup is a single bit test. The same bits are also laid
+// out as two nibble tables, which let `Find` classify 16 bytes at a time
+// with SSSE3 shuffles.
+class ByteSet {
+ public:
+  static constexpr size_t npos = std::string_view::npos;
+
+  ByteSet() : bits_{}, low_{}, high_{} {}
+  // every byte `set` contains, its negated groups folded in
+  explicit ByteSet(const CharSet &set);
+  static ByteSet All();
+
+  void Insert(uint8_t byte) {
+    bits_[byte >> 6] |= uint64_t{1} << (byte & 63);
+    (byte < 128 ? low_ : high_)[byte & 15] |= 1 << (byte >> 4 & 7);
+  }
+  ByteSet &operator|=(const ByteSet &set);
+  [[nodiscard]] ByteSet operator~() const;
+
+  [[nodiscard]] bool Contains(char ch) const {
+    auto byte = static_cast<uint8_t>(ch);
+    return bits_[byte >> 6] >> (byte & 63) & 1;
+  }
+  [[nodiscard]] size_t Count() const;
+  [[nodiscard]] bool full() const { return Count() == 256; }
+  // 32 bytes, bit `b` of byte `b / 8` telling whether `b` is contained
+  [[nodiscard]] const uint64_t *bits() const { return bits_; }
+
+  // Offset of the first byte at or after `pos` that is in the set, or with
+  // `in` false that is not, or `npos`.
+  [[nodiscard]] size_t Find(std::string_view s, size_t pos,
+                            bool in = true) const;
+
+ private:
+  // Scan 16 bytes at a time from `*pos`, returns true with `*pos` at the
+  // first byte found, or false with `*pos` where the scan stopped.
+  bool Scan(std::string_view s, size_t *pos, bool in) const;
+
+  uint64_t bits_[4];
+  // bit `h` of `low_[l]` (`high_[l]`) tells whether byte `h << 4 | l` (`(h +
+  // 8) << 4 | l`) is contained
+  alignas(16) uint8_t low_[16];
+  alignas(16) uint8_t high_[16];
+};
+
+// Partition of the 256 byte values into classes of bytes that no
+// instruction tells apart, so that automata keep one column per class
+// rather than per byte. Classes are numbered in the order of their smallest
+// byte.
+class ByteClasses {
+ public:
+  // a single class
+  ByteClasses() : map_{}, num_(1) {}
+  // every byte in a class of its own
+  static ByteClasses Singletons();
+
+  // Refine the classes so that none holds bytes both in and out of `set`.
+  void Split(const ByteSet &set);
+
+  [[nodiscard]] uint8_t operator[](char ch) const {
+    return map_[static_cast<uint8_t>(ch)];
+  }
+  [[nodiscard]] size_t size() const { return num_; }
+  // the smallest byte of every class, in class order
+  [[nodiscard]] std::vector<uint8_t> Representatives() const;
+
+ private:
+  uint8_t map_[256];
+  size_t num_;
+};
+
+}  // namespace regex
+
+#endif  // REGEX_BYTE_SET_H_
@@ -0,0 +1,170 @@
+//
+// Copyright [2020] <inhzus>
+//
+#ifndef REGEX_DFA_H_
+#define REGEX_DFA_H_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "regex/program.h"
+
+namespace regex {
+
+// Deterministic automaton built on the fly by subset construction over a
+// `Program`. A state is the priority-ordered list of instructions waiting for
+// input, truncated after `Match`, so the leftmost-first match end is found in
+// one forward scan. States and transitions live in a cache bounded by
+// `cache_size` bytes, which is cleared once full; the search gives up when
+// the cache is cleared too often to be of any use.
+//
+// A `Reverse` automaton runs a program compiled with `reverse` backwards from
+// the end of the text. It is anchored there and keeps every thread past
+// `Match`, so it finds the longest match, i.e. the leftmost start.
+//
+// An `Overlapping` automaton scans forwards keeping every thread past `Match`
+// and restarting at every offset, so it reaches every `Match` instruction
+// some match ends on. It runs programs made by `Program::Union`.
+class LazyDfa {
+ public:
+  friend class Dfa;
+
+  enum Kind { Forward, Reverse, Overlapping };
+  enum Status { Matched, NoMatch, GaveUp };
+
+  LazyDfa(std::shared_ptr<const Program> program, size_t cache_size,
+          Kind kind = Forward);
+
+  // Unanchored search for the leftmost-first match, `end` receives the
+  // offset where it ends.
+  Status Search(std::string_view s, size_t *end);
+  // Scan `s` backwards from its end, `start` receives the smallest offset a
+  // match begins at. `at_end` tells whether `s` ends where the text does.
+  Status SearchReverse(std::string_view s, bool at_end, size_t *start);
+  // Scan the whole of `s`, `matched` receives the ascending pcs of the
+  // `Match` instructions reached. With `any` the scan stops at the first
+  // state reaching some of them.
+  Status SearchOverlapping(std::string_view s, std::vector<uint32_t> *matched,
+                           bool any = false);
+
+  // The cache belongs to one search at a time. Take it without blocking,
+  // false if another thread has it; `Release` hands it back.
+  bool TryAcquire() { return !busy_.exchange(true, std::memory_order_acquire); }
+  void Release() { busy_.store(false, std::memory_order_release); }
+
+  // Exclusive use of a lazy DFA for the scope of a call, or none when another
+  // thread is using its cache; the caller then takes a path without it.
+  class Borrowed {
+   public:
+    explicit Borrowed(LazyDfa *dfa)
+        : dfa_(dfa != nullptr && dfa->TryAcquire() ? dfa : nullptr) {}
+    Borrowed(const Borrowed &) = delete;
+    Borrowed &operator=(const Borrowed &) = delete;
+    ~Borrowed() {
+      if (dfa_ != nullptr) dfa_->Release();
+    }
+
+    explicit operator bool() const { return dfa_ != nullptr; }
+    LazyDfa *operator->() const { return dfa_; }
+
+   private:
+    LazyDfa *dfa_;
+  };
+
+ private:
+  static constexpr uint32_t kUnknown = UINT32_MAX, kDead = 0;
+  // sentinel instruction of the implicit ".*?" prefix of unanchored searches
+  [[nodiscard]] uint32_t Restart() const { return program_->insts().size(); }
+
+  struct Hash {
+    size_t operator()(const std::vector<uint32_t> &key) const {
+      size_t h = key.size();
+      for (uint32_t v : key) h = h * 1000003 ^ v;
+      return h;
+    }
+  };
+
+  // Follow the empty transitions from `pc` and append the instructions
+  // reached to `list_`, stopping at the first `Match` if `Forward`.
+  void AddClosure(uint32_t pc, bool at_begin, bool at_end);
+  // The key of a state is its flags followed by its instruction list.
+  uint32_t Insert(bool at_begin);
+  uint32_t InsertKey(std::vector<uint32_t> &&key);
+  uint32_t Start(bool at_begin);
+  // Compute the transition of `state` on the byte class `cls` (or
+  // `end_of_text_`), returns `kUnknown` if the cache had to be cleared too
+  // often.
+  uint32_t Next(uint32_t state, uint32_t cls);
+  void ClearCache();
+
+  std::shared_ptr<const Program> program_;
+  size_t cache_size_;
+  size_t cache_used_;
+  Kind kind_;
+  uint32_t match_num_;  // `Match` instructions of the program
+  // a column per byte class of the program and one for the end of the text
+  uint32_t stride_;
+  uint32_t end_of_text_;
+  std::vector<uint8_t> reps_;  // a byte of every class
+  // per search
+  size_t clears_;
+  size_t pos_;        // bytes scanned before the transition being computed
+  size_t clear_pos_;  // bytes scanned before the last clear
+
+  std::unordered_map<std::vector<uint32_t>, uint32_t, Hash> map_;
+  std::vector<std::vector<uint32_t>> states_;
+  std::vector<uint8_t> matches_;
+  std::vector<uint8_t> reported_;  // matching states already looked into
+  std::vector<uint8_t> hit_;  // `Match` instructions already reported
+  std::vector<uint32_t> trans_;
+  uint32_t start_[2];  // indexed by whether the search starts at the text
+
+  // workspace of the subset construction
+  std::vector<uint32_t> list_;
+  std::vector<uint32_t> stack_;
+  std::vector<uint32_t> sparse_;
+  std::vector<uint32_t> dense_;
+  uint32_t visited_;
+  bool matched_;
+  std::atomic<bool> busy_ = false;
+};
+
+// Complete deterministic automaton built ahead of time, minimized with
+// Hopcroft's algorithm and stored as a dense table with a column per byte
+// class, so the search costs two lookups per byte. It finds the same match
+// ends as `LazyDfa`.
+class Dfa {
+ public:
+  // Build the automaton of `program`, returns false if the subset
+  // construction needs more than `max_states` states.
+  bool Build(std::shared_ptr<const Program> program, size_t max_states);
+  bool Search(std::string_view s, size_t *end) const;
+
+  [[nodiscard]] size_t state_num() const { return flags_.size(); }
+
+ private:
+  enum Flag : uint8_t { MatchFlag = 1, EndMatchFlag = 2 };
+
+  // Merge equivalent states of the automaton described by `trans` (`stride_`
+  // columns per state) and `flags`, returns the state each one became.
+  std::vector<uint32_t> Minimize(const std::vector<uint32_t> &trans,
+                                 const std::vector<uint8_t> &flags,
+                                 uint32_t start, uint32_t dead);
+
+  ByteClasses classes_;
+  uint32_t stride_;  // a column per byte class
+  std::vector<uint32_t> trans_;
+  std::vector<uint8_t> flags_;
+  uint32_t start_;
+  uint32_t dead_;
+  uint32_t restart_;  // waits for a match to begin, `kUnknown` if unreached
+  Prefix prefix_;
+};
+
+}  // namespace regex
+
+#endif  // REGEX_DFA_H_
@@ -125,8 +125,8 @@ struct Id {
       order_ = Order(inner);
       return *this;
     }
-    bool operator==(Sym::_Inner inner) { return inner == inner_; }
-    bool operator!=(Sym::_Inner inner) { return inner != inner_; }
+    bool operator==(Sym::_Inner inner) const { return inner == inner_; }
+    bool operator!=(Sym::_Inner inner) const { return inner != inner_; }
     explicit operator int() const { return static_cast<int>(inner_); }
 
     [[nodiscard]] bool IsOperand() const {
@@ -170,6 +170,7 @@ struct Id {
             {id.repeat->lower, id.repeat->upper});
         break;
       case Sym::Set:
+      case Sym::SetEx:
         set = new std::remove_reference_t<decltype(*set)>({id.set->val});
         break;
       default:
@@ -177,7 +178,7 @@ struct Id {
         break;
     }
   }
-  Id(Id &&id) : sym(id.sym) {
+  Id(Id &&id) noexcept : sym(id.sym) {
     set = id.set;
     id.set = {};
     id.sym = Sym(Sym::Char);
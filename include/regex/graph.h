@@ -5,26 +5,38 @@
 #define REGEX_GRAPH_H_
 
 #include <cstring>
-#include <functional>
+#include <deque>
 #include <memory>
 #include <string>
 #include <unordered_map>
 #include <utility>
 #include <vector>
 
+#include "regex/aho_corasick.h"
+#include "regex/ast.h"
+#include "regex/backtrack.h"
+#include "regex/dfa.h"
 #include "regex/exp.h"
+#include "regex/jit.h"
+#include "regex/pike.h"
+#include "regex/prefilter.h"
+#include "regex/program.h"
+#include "regex/shift_and.h"
 
 namespace regex {
 
-struct Node;
-class Graph;
-
+// Edges and nodes of the epsilon-NFA are plain values stored in one arena
+// owned by the `Graph` and refer to each other by 32-bit index. Loop
+// counters and atomic brakes are numbered registers living in the frame of
+// each walk, character classes live in a side table of byte bitmaps and
+// the literal runs of `String` edges in a table of bytes.
 struct Edge {
-  enum Type {
+  enum Type : uint8_t {
     Empty,
     Ahead,
     NegAhead,
     Any,
+    Arm,
     Begin,
     Brake,
     Char,
@@ -41,150 +53,151 @@ struct Edge {
     Repeat,
     Set,
     SetEx,
+    String,
     Upper
   };
 
-  static Edge AheadEdge(Node *next, Graph *graph) {
-    return Edge(Ahead, next, graph);
+  static Edge AheadEdge(uint32_t next, uint32_t start) {
+    return Edge(Ahead, next, start);
+  }
+  static Edge NegAheadEdge(uint32_t next, uint32_t start) {
+    return Edge(NegAhead, next, start);
+  }
+  static Edge CharEdge(uint32_t next, char ch) {
+    Edge edge(Char, next);
+    edge.ch.val = ch;
+    return edge;
   }
-  static Edge NegAheadEdge(Node *next, Graph *graph) {
-    return Edge(NegAhead, next, graph);
+  static Edge AnyEdge(uint32_t next) { return Edge(Any, next); }
+  // let the next `Brake` edge of brake `reg` pass once
+  static Edge ArmEdge(uint32_t next, uint32_t reg) {
+    return Edge(Arm, next, reg);
   }
-  static Edge CharEdge(Node *next, char ch) { return Edge(Char, next, ch); }
-  static Edge AnyEdge(Node *next) { return Edge(Any, next); }
-  static Edge BeginEdge(Node *next) { return Edge(Begin, next); }
-  static Edge BrakeEdge(Node *next, bool *pass) {
-    return Edge(Brake, next, pass);
+  static Edge BeginEdge(uint32_t next) { return Edge(Begin, next); }
+  static Edge BrakeEdge(uint32_t next, uint32_t reg) {
+    return Edge(Brake, next, reg);
   }
-  static Edge EndEdge(Node *next) { return Edge(End, next); }
-  static Edge EpsilonEdge(Node *next) { return Edge(Epsilon, next); }
-  static Edge FuncEdge(Node *next, std::function<void()> *f) {
-    return Edge(Func, next, f);
+  static Edge EndEdge(uint32_t next) { return Edge(End, next); }
+  static Edge EpsilonEdge(uint32_t next) { return Edge(Epsilon, next); }
+  // set loop counter `reg` to `val`
+  static Edge FuncEdge(uint32_t next, uint32_t reg, uint32_t val) {
+    return Edge(Func, next, reg, val);
   }
-  static Edge LowerEdge(Node *next, size_t *repeat, size_t num) {
-    return Edge(Lower, next, repeat, num);
+  static Edge LowerEdge(uint32_t next, uint32_t reg, uint32_t num) {
+    return Edge(Lower, next, reg, num);
   }
-  static Edge RefEdge(Node *next, size_t idx) { return Edge(Ref, next, idx); }
-  static Edge StoreEdge(Node *next, size_t idx) {
+  static Edge RefEdge(uint32_t next, uint32_t idx) {
+    return Edge(Ref, next, idx);
+  }
+  static Edge StoreEdge(uint32_t next, uint32_t idx) {
     return Edge(Store, next, idx);
   }
-  static Edge StoreEndEdge(Node *next, size_t idx) {
+  static Edge StoreEndEdge(uint32_t next, uint32_t idx) {
     return Edge(StoreEnd, next, idx);
   }
-  static Edge MatchEdge(Node *next) { return Edge(Match, next); }
-  static Edge NamedEdge(Node *next, size_t idx) {
+  static Edge MatchEdge(uint32_t next) { return Edge(Match, next); }
+  static Edge NamedEdge(uint32_t next, uint32_t idx) {
     return Edge(Named, next, idx);
   }
-  static Edge NamedEndEdge(Node *next, size_t idx) {
+  static Edge NamedEndEdge(uint32_t next, uint32_t idx) {
     return Edge(NamedEnd, next, idx);
   }
-  static Edge RepeatEdge(Node *next, size_t *repeat) {
-    return Edge(Repeat, next, repeat);
+  static Edge RepeatEdge(uint32_t next, uint32_t reg) {
+    return Edge(Repeat, next, reg);
+  }
+  static Edge SetEdge(uint32_t next, uint32_t idx) {
+    return Edge(Set, next, idx);
   }
-  static Edge SetEdge(Node *next, CharSet &&v) {
-    return Edge(Set, next, std::move(v));
+  static Edge SetExEdge(uint32_t next, uint32_t idx) {
+    return Edge(SetEx, next, idx);
   }
-  static Edge SetExEdge(Node *next, CharSet &&v) {
-    return Edge(SetEx, next, std::move(v));
+  // `len` bytes of the string table from `idx`, compared at once
+  static Edge StringEdge(uint32_t next, uint32_t idx, uint32_t len) {
+    return Edge(String, next, idx, len);
   }
-  static Edge UpperEdge(Node *next, size_t *repeat, size_t num) {
-    return Edge(Upper, next, repeat, num);
+  static Edge UpperEdge(uint32_t next, uint32_t reg, uint32_t num) {
+    return Edge(Upper, next, reg, num);
   }
-  Edge(const Edge &) = delete;
-  Edge &operator=(const Edge &) = delete;
-  Edge(Edge &&) noexcept;
-  Edge &operator=(Edge &&) noexcept;
-  ~Edge();
 
   [[nodiscard]] bool IsEpsilon() const { return Epsilon == type; }
 
   Type type;
-  Node *next;
+  uint32_t next;
   union {
     struct {
-      size_t *repeat;
-      size_t num;
-    } * bound;
+      uint32_t reg;
+      uint32_t num;
+    } bound;
     struct {
       char val;
     } ch;
     struct {
-      Graph *graph;
+      uint32_t start;  // first node of the body, which ends in a match node
     } ahead, neg_ahead;
     struct {
-      bool *pass;
-    } brake;
+      uint32_t reg;
+    } arm, brake, repeat;
     struct {
-      std::function<void()> *f;
+      uint32_t reg;
+      uint32_t val;
     } func;
     struct {
-      size_t idx;
+      uint32_t idx;
     } ref, store, store_end, named, named_end;
     struct {
-      size_t *val;
-    } repeat;
+      uint32_t idx;  // in the class table
+    } set;
     struct {
-      CharSet val;
-    } * set;
+      uint32_t idx;  // in the string table
+      uint32_t len;
+    } str;
   };
 
  private:
-  Edge(Type type, Node *next) : type(type), next(next), ch({0}) {}
-  Edge(Type type, Node *next, char ch) : type(type), next(next), ch({ch}) {}
-  Edge(Type type, Node *next, Graph *graph)
-      : type(type), next(next), ahead({graph}) {}
-  Edge(Type type, Node *next, size_t idx)
-      : type(type), next(next), store({idx}) {}
-  Edge(Type type, Node *next, std::function<void()> *f)
-      : type(type), next(next), func({f}) {}
-  Edge(Type type, Node *next, bool *pass)
-      : type(type), next(next), brake({pass}) {}
-  Edge(Type type, Node *next, size_t *repeat, size_t num)
-      : type(type), next(next) {
-    bound = new std::remove_reference_t<decltype(*bound)>({repeat, num});
-  }
-  Edge(Type type, Node *next, size_t *repeat)
-      : type(type), next(next), repeat({repeat}) {}
-  Edge(Type type, Node *next, CharSet &&v) : type(type), next(next) {
-    set = new std::remove_reference_t<decltype(*set)>();
-    set->val = std::move(v);
-  }
+  Edge(Type type, uint32_t next) : type(type), next(next), func({0, 0}) {}
+  Edge(Type type, uint32_t next, uint32_t idx)
+      : type(type), next(next), func({idx, 0}) {}
+  Edge(Type type, uint32_t next, uint32_t reg, uint32_t val)
+      : type(type), next(next), func({reg, val}) {}
 };
 
 struct Node {
-  enum Status { Default, Match };
-
-  Node() : status(Default) {}
-  //  explicit Node(const std::vector<Edge> &edges) :
-  //      status(Default), edges(edges) {}
-  explicit Node(Edge &&edge) : status(Default) {
-    edges.push_back(std::move(edge));
-  }
-  explicit Node(Edge &&e1, Edge &&e2) : status(Default) {
-    edges.push_back(std::move(e1));
-    edges.push_back(std::move(e2));
-  }
-
-  [[nodiscard]] bool WillMatch() const;
+  enum Status : uint8_t { Default, Match };
 
+  uint32_t begin;  // edges [begin, end) of the arena, in priority order
+  uint32_t end;
   Status status;
-  std::vector<Edge> edges;
+};
+
+// Nodes and edges of a walker graph.
+struct GraphSize {
+  uint32_t nodes;
+  uint32_t edges;
 };
 
 struct Segment {
-  Segment(Node *start, Node *end) : start(start), end(end) {}
+  Segment(uint32_t start, uint32_t end) : start(start), end(end) {}
 
-  Node *start;
-  Node *end;
+  uint32_t start;
+  uint32_t end;
 };
 
+// Index of the group of every name, built once per pattern and shared by
+// the matchers of its matches.
+using NamedGroups = std::unordered_map<std::string_view, size_t>;
+
+// Result of a match. A matcher passed to the `Graph` calls taking one is
+// reset and refilled, so reusing it keeps its buffers and steady-state
+// matching allocates nothing.
 class Matcher {
  public:
   friend class Graph;
 
+  Matcher() : ok_(false), overflowed_(false) {}
   Matcher(std::string_view s, size_t group_num,
-          std::unordered_map<std::string_view, size_t> named_group)
+          std::shared_ptr<const NamedGroups> named_group)
       : ok_(false),
+        overflowed_(false),
         s_(s),
         groups_(group_num, std::string_view()),
         named_groups_(std::move(named_group)) {}
@@ -200,13 +213,17 @@ class Matcher {
     return groups_[idx];
   }
   [[nodiscard]] std::string_view Group(std::string_view key) const {
-    auto pair_it = named_groups_.find(key);
-    if (pair_it == named_groups_.end()) return kEnd;
+    if (named_groups_ == nullptr) return kEnd;
+    auto pair_it = named_groups_->find(key);
+    if (pair_it == named_groups_->end()) return kEnd;
     return groups_[pair_it->second];
   }
   std::string Sub(std::string_view s) const;
 
   [[nodiscard]] bool ok() const { return ok_; }
+  // Whether the graph walker gave up past `Options::max_stack_depth`, in
+  // which case no match was found but the text may still contain one.
+  [[nodiscard]] bool overflowed() const { return overflowed_; }
   [[nodiscard]] const std::vector<std::string_view> &groups() const {
     return groups_;
   }
@@ -214,51 +231,245 @@ class Matcher {
   inline static const char *kEnd = "";
 
  private:
+  // Start over on `s`, keeping the capacity of the buffers.
+  void Reset(std::string_view s, size_t group_num,
+             const std::shared_ptr<const NamedGroups> &named_group) {
+    ok_ = false;
+    overflowed_ = false;
+    s_ = s;
+    groups_.assign(group_num, std::string_view());
+    if (named_groups_ != named_group) named_groups_ = named_group;
+  }
+
   bool ok_;
+  bool overflowed_;
   std::string_view s_;
   std::vector<std::string_view> groups_;
-  std::unordered_map<std::string_view, size_t> named_groups_;
+  std::shared_ptr<const NamedGroups> named_groups_;  // null when none
+  std::vector<size_t> slots_;  // filled by the VMs
 };
 
+struct Options {
+  // bytes of memory the lazy DFA may spend on its state cache
+  size_t dfa_cache_size = size_t{2} << 20;
+  // bits the backtracker may spend remembering the (instruction, position)
+  // pairs it explored, longer texts are searched without memoization
+  size_t visit_budget = size_t{256} << 10;
+  // run the patterns that do not backtrack as native code, where `REGEX_JIT`
+  // is defined
+  bool jit = false;
+  // rewrites of the pattern tree applied before compiling it
+  AstPasses passes;
+  // instructions the program may have once counted repetitions are copied
+  // out, larger patterns are only run by the graph walker
+  size_t max_program_size = Program::kMaxSize;
+  // branch points the graph walker may stack, and counter updates it may
+  // trail, a walk needing more gives up and marks its matcher `overflowed`
+  size_t max_stack_depth = size_t{1} << 20;
+};
+
+class MatchScratch;
+
+// A compiled pattern. Matching only reads it, apart from the lazy DFA
+// caches which are taken without blocking, so a single `Graph` may be
+// matched from many threads at once.
+//
+// The calls taking a `MatchScratch` run the engines it keeps, without one
+// they build engines for the call alone.
 class Graph {
  public:
-  static Graph Compile(std::string_view s);
-  static Graph Compile(Exp &&exp);
+  static Graph Compile(std::string_view s, const Options &options = {});
+  static Graph Compile(Exp &&exp, const Options &options = {});
 
   Graph(const Graph &) = delete;
   Graph operator=(const Graph &) = delete;
   Graph(Graph &&) = default;
-  Graph &operator=(Graph &&graph) noexcept {
-    Deallocate();
-    group_num_ = graph.group_num_;
-    start_ = graph.start_;
-    nodes_ = std::move(graph.nodes_);
-    named_group_ = std::move(graph.named_group_);
-    return *this;
-  }
-  Graph(size_t group_num, Node *start, std::vector<Node *> &&nodes,
-        std::unordered_map<std::string_view, size_t> named_group)
-      : group_num_(group_num),
-        start_(start),
-        nodes_(std::move(nodes)),
-        named_group_(std::move(named_group)) {}
-  ~Graph() { Deallocate(); }
+  Graph &operator=(Graph &&) = default;
 
+  // Build the complete minimized DFA of the pattern for the fastest
+  // `Test` and `MatchEnd`. Returns false, keeping the lazy DFA, if the
+  // pattern needs backtracking or more than `max_states` states.
+  bool CompileDfa(size_t max_states = 10000);
+  // Whether `s` contains a match, answered by a DFA when it can.
+  [[nodiscard]] bool Test(std::string_view s) const;
+  // End offset of the leftmost-first match, or -1.
+  [[nodiscard]] int MatchEnd(std::string_view s) const;
   [[nodiscard]] int MatchLen(std::string_view s) const;
   [[nodiscard]] bool MatchGroups(std::string_view s,
                                  std::vector<std::string_view> *groups) const;
-  void Match(std::string_view s, Matcher *matcher) const;
+  // Run the compiled program on the Pike VM, or on the backtracking VM when
+  // the pattern needs it. For the Pike VM the automata first locate the
+  // match, so that only its span is searched for captures. Patterns over
+  // `Options::max_program_size` are walked instead, see `Walk`.
+  void Match(std::string_view s, Matcher *matcher,
+             MatchScratch *scratch = nullptr) const;
   Matcher Match(std::string_view s) const;
+  // Match only at the start of `s`, or only against the whole of it, in a
+  // single run of the VM.
+  void MatchAnchored(std::string_view s, Matcher *matcher,
+                     MatchScratch *scratch = nullptr) const;
+  Matcher MatchAnchored(std::string_view s) const;
+  void FullMatch(std::string_view s, Matcher *matcher,
+                 MatchScratch *scratch = nullptr) const;
+  Matcher FullMatch(std::string_view s) const;
+  // The bytecode the VMs and automata run, compiled from the simplified
+  // pattern tree, empty if the pattern was too large.
+  [[nodiscard]] const Program &program() const { return *program_; }
+  // Classes of bytes the pattern never tells apart: `byte_classes()[ch]`
+  // may stand for `ch` in any table indexed by input byte.
+  [[nodiscard]] const ByteClasses &byte_classes() const {
+    return program_->classes();
+  }
+  // Walk the epsilon-NFA graph directly, kept as the reference matcher.
+  // Texts of 4 GiB or more are reported as not matching. Walks stacking
+  // more than `Options::max_stack_depth` branch points or counter updates
+  // give up without a match and mark the matcher `overflowed`.
+  void Walk(std::string_view s, Matcher *matcher,
+            MatchScratch *scratch = nullptr) const;
+  // Size of the walker graph as built from the expression, and once lone
+  // epsilons are collapsed, literal runs merged into `String` edges and
+  // unreachable nodes dropped.
+  [[nodiscard]] GraphSize unoptimized_size() const {
+    return unoptimized_size_;
+  }
+  [[nodiscard]] GraphSize size() const { return {node_num_, edge_num_}; }
   std::string Sub(std::string_view sub, std::string_view s) const;
   void DrawMermaid() const;
 
  private:
-  void Deallocate();
+  Graph(size_t group_num, NamedGroups named_group)
+      : group_num_(group_num),
+        named_group_(named_group.empty()
+                         ? nullptr
+                         : std::make_shared<const NamedGroups>(
+                               std::move(named_group))) {}
+
+  friend class MatchScratch;
+
+  void Match(std::string_view s, Anchor anchor, Matcher *matcher,
+             MatchScratch *scratch) const;
+  void SetGroups(std::string_view s, const std::vector<size_t> &slots,
+                 Matcher *matcher) const;
+  // Whether `s` lacks every literal some match would contain.
+  [[nodiscard]] bool Rejected(std::string_view s) const {
+    return Candidate(s) == Prefilter::npos;
+  }
+  // Offset no match begins before judging by the prefilter, or `npos` if
+  // `s` is rejected.
+  [[nodiscard]] size_t Candidate(std::string_view s) const {
+    if (prefilter_.empty()) return 0;
+    size_t pos = prefilter_.Find(s, 0);
+    return pos == Prefilter::npos || prefilter_.leading() ? pos : 0;
+  }
+  // State of one walk, so that concurrent walks share nothing. Counter
+  // updates are trailed and undone on backtracking, brakes are not: a brake
+  // passed once stays closed until it is armed again.
+  struct Frame {
+    std::vector<size_t> counters;
+    std::vector<uint8_t> brakes;
+    std::vector<std::pair<uint32_t, size_t>> trail;  // (counter, old value)
+    // the stack or the trail outgrew `Options::max_stack_depth`
+    bool overflowed = false;
+
+    void Set(uint32_t counter, size_t val) {
+      trail.emplace_back(counter, counters[counter]);
+      counters[counter] = val;
+    }
+    void Undo(size_t size) {
+      for (; trail.size() > size; trail.pop_back()) {
+        counters[trail.back().first] = trail.back().second;
+      }
+    }
+  };
+
+  // The edge a walk tries next, `trail` being the counter updates made
+  // before it entered the node. Only nodes with edges left to try are
+  // stacked, in 16 bytes.
+  struct Pos {
+    uint32_t pos;  // offset in the text the walk entered the node at
+    uint32_t node;
+    uint32_t idx;  // edge in the arena
+    uint32_t trail;
+
+    Pos(uint32_t pos, uint32_t node, uint32_t idx, size_t trail)
+        : pos(pos),
+          node(node),
+          idx(idx),
+          trail(static_cast<uint32_t>(trail)) {}
+  };
+  // where every group of a walk begins and ends
+  using Boundary = std::vector<std::pair<std::string_view::const_iterator,
+                                         std::string_view::const_iterator>>;
+
+  void Walk(std::string_view s, Anchor anchor, Matcher *matcher,
+            MatchScratch *scratch) const;
+  // Walk from node `start`, at every offset of `s` unless `anchor`ed,
+  // leaving the groups of a match in the boundaries of `depth`. Look-ahead
+  // bodies are walked anchored one `depth` further.
+  bool Walk(std::string_view s, uint32_t start, Anchor anchor, size_t depth,
+            MatchScratch *scratch) const;
 
   size_t group_num_;
-  Node *start_;
-  std::vector<Node *> nodes_;
-  std::unordered_map<std::string_view, size_t> named_group_;
+  uint32_t start_ = 0;
+  // `nodes_` followed by `edges_`, in a single allocation
+  std::unique_ptr<uint8_t[]> arena_;
+  const Node *nodes_ = nullptr;
+  const Edge *edges_ = nullptr;
+  uint32_t node_num_ = 0;
+  uint32_t edge_num_ = 0;
+  GraphSize unoptimized_size_{};
+  std::vector<ByteSet> sets_;  // referred to by `Set` and `SetEx` edges
+  std::string strings_;        // referred to by `String` edges
+  uint32_t counter_num_ = 0;
+  uint32_t brake_num_ = 0;
+  std::shared_ptr<const NamedGroups> named_group_;  // null when none
+  Options options_;
+  std::shared_ptr<const Program> program_;
+  // only for programs that do not backtrack
+  mutable std::unique_ptr<LazyDfa> lazy_dfa_;
+  // finds where the match found by the forward automata starts
+  mutable std::unique_ptr<LazyDfa> reverse_dfa_;
+  std::unique_ptr<Dfa> dfa_;  // built on request by `CompileDfa`
+  // only for patterns with at most `ShiftAnd::kMaxPositions` positions
+  std::unique_ptr<ShiftAnd> shift_and_;
+  Prefilter prefilter_;
+  // only for alternations of at least `AhoCorasick::kMinLiterals` literals
+  std::unique_ptr<AhoCorasick> aho_corasick_;
+  // only with `Options::jit`, replaces the Pike VM
+  std::unique_ptr<Jit> jit_;
+};
+
+// Engines and buffers of the matches of one thread, built on first use and
+// kept by every call it is passed to, so that steady-state matching
+// allocates nothing. A scratch may serve several patterns in turn, its
+// engines are rebuilt when the pattern changes. The lazy DFA caches stay in
+// the `Graph`.
+class MatchScratch {
+ public:
+  MatchScratch() = default;
+  MatchScratch(const MatchScratch &) = delete;
+  MatchScratch &operator=(const MatchScratch &) = delete;
+  MatchScratch(MatchScratch &&) = default;
+  MatchScratch &operator=(MatchScratch &&) = default;
+
+ private:
+  friend class Graph;
+
+  // Keep the engines if they run `program`, drop them otherwise.
+  void Bind(const std::shared_ptr<const Program> &program);
+  PikeVm *pike();
+  Backtracker *backtracker(size_t visit_budget);
+
+  // held so that the program the engines refer to stays alive
+  std::shared_ptr<const Program> program_;
+  std::unique_ptr<PikeVm> pike_;
+  std::unique_ptr<Backtracker> backtracker_;
+  Jit::Scratch jit_;
+  // of the walker, references to the boundaries of a depth survive deeper
+  // walks
+  Graph::Frame frame_;
+  std::vector<Graph::Pos> stack_;
+  std::deque<Graph::Boundary> boundaries_;
 };
 
 }  // namespace regex
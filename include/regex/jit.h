@@ -0,0 +1,99 @@
+//
+// Copyright [2020] <inhzus>
+//
+#ifndef REGEX_JIT_H_
+#define REGEX_JIT_H_
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "regex/program.h"
+
+namespace regex {
+
+// Native x86-64 code for a `Program`, run with the same leftmost-first,
+// depth-first semantics as the `Backtracker`. Every instruction becomes a
+// short inline sequence: characters are compared against immediates, sets
+// test a 256-bit bitmap stored after the code and `Split` pushes the
+// address of its second branch as a choice point, unless it is possessive
+// and the next byte picks the branch. Slot restores and choice points share
+// one explicit stack, so a failure is a single shared pop loop.
+//
+// Only available on x86-64 Linux (`REGEX_JIT` defined), and only for
+// programs that do not backtrack; `Build` returns false otherwise. The code
+// and its data are read-only once built, every search brings its own stack,
+// so one `Jit` may be searched from several threads.
+class Jit {
+ public:
+  enum Status {
+    Matched,
+    NoMatch,
+    GaveUp,  // the choice stack overflowed, run the interpreter instead
+  };
+
+  // choice points and slot restores kept at most
+  static constexpr size_t kMaxFrames = size_t{1} << 16;
+  // frames of the stack first tried, on the stack of the caller
+  static constexpr size_t kInlineFrames = 256;
+
+  // Buffers of a search, kept by callers that search many times so that
+  // they are only allocated once.
+  struct Scratch {
+    std::vector<uint64_t> stack;
+    std::vector<uint64_t> visited;
+    std::vector<uint64_t> regs;
+  };
+
+  Jit() = default;
+  Jit(const Jit &) = delete;
+  Jit &operator=(const Jit &) = delete;
+  ~Jit();
+
+  // Generate the code of `program` into an executable page. As for the
+  // `Backtracker`, the (instruction, position) pairs explored are
+  // remembered, in at most `visit_budget` bits.
+  bool Build(const Program &program, size_t visit_budget = 0);
+  // Search the leftmost match starting at or after `begin`, `slots`
+  // receives the capture offsets. Gives up when the pairs of `s` do not fit
+  // in the budget, the search would not be bounded by O(n * m) then.
+  Status Search(std::string_view s, size_t begin, std::vector<size_t> *slots,
+                Anchor anchor = Unanchored) const;
+  // Same, with the buffers of `scratch`, grown as needed.
+  Status Search(std::string_view s, size_t begin, std::vector<size_t> *slots,
+                Anchor anchor, Scratch *scratch) const;
+
+ private:
+  // argument of the generated function, field offsets are baked into it
+  struct Context {
+    const char *text;
+    uint64_t size;
+    uint64_t pos;
+    uint64_t *slots;
+    uint64_t *stack;
+    uint64_t *stack_end;
+    uint64_t *visited;
+    uint64_t stride;    // text size + 1
+    uint64_t full;      // whether the match must end at the end of the text
+  };
+  // 1 on a match, 0 on failure and -1 on overflow
+  using Function = int64_t (*)(Context *);
+
+  Status Search(std::string_view s, size_t begin, std::vector<size_t> *slots,
+                Anchor anchor, uint64_t *stack, size_t frames,
+                Scratch *scratch) const;
+
+  void *code_ = nullptr;
+  size_t code_size_ = 0;
+  size_t inst_num_ = 0;
+  size_t slot_num_ = 0;
+  size_t group_num_ = 0;
+  size_t visit_budget_ = 0;
+  bool anchored_ = false;
+  Prefix prefix_;
+  ByteSet first_;
+};
+
+}  // namespace regex
+
+#endif  // REGEX_JIT_H_
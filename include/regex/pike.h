@@ -0,0 +1,78 @@
+//
+// Copyright [2020] <inhzus>
+//
+#ifndef REGEX_PIKE_H_
+#define REGEX_PIKE_H_
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "regex/program.h"
+
+namespace regex {
+
+// Breadth-first simulation of a `Program` (Pike VM). Every instruction holds
+// at most one thread per input position, so the search takes O(n * m) time
+// whatever the pattern is. Threads are kept in priority order to produce the
+// same leftmost-first captures as the backtracker. Programs that
+// `backtrack()` are not supported.
+class PikeVm {
+ public:
+  explicit PikeVm(const Program &program);
+
+  bool Search(std::string_view s, std::vector<size_t> *slots,
+              Anchor anchor = Unanchored) {
+    return Search(s, 0, s.size(), slots, anchor);
+  }
+  // Search only the window [begin, end) of `s`, while "^" and "$" still
+  // test the boundaries of the whole text. An anchored search only starts
+  // at `begin`.
+  bool Search(std::string_view s, size_t begin, size_t end,
+              std::vector<size_t> *slots, Anchor anchor = Unanchored);
+
+ private:
+  // Sparse set of program counters, each one owning a row of capture slots.
+  struct Threads {
+    explicit Threads(size_t inst_num, size_t slot_num)
+        : size(0),
+          sparse(inst_num),
+          dense(inst_num),
+          slots(inst_num * slot_num) {}
+    [[nodiscard]] bool Contains(uint32_t pc) const {
+      return sparse[pc] < size && dense[sparse[pc]] == pc;
+    }
+    void Insert(uint32_t pc) {
+      sparse[pc] = size;
+      dense[size++] = pc;
+    }
+
+    uint32_t size;
+    std::vector<uint32_t> sparse;
+    std::vector<uint32_t> dense;
+    std::vector<size_t> slots;
+  };
+  struct Frame {
+    enum Kind : uint8_t { Explore, Restore };
+
+    Kind kind;
+    uint32_t pc;  // slot index for `Restore`
+    size_t val;   // previous slot value for `Restore`
+  };
+
+  // Follow the empty transitions from `pc` at `pos`, adding every thread
+  // that waits for input (or matches) to `threads`.
+  void AddThread(Threads *threads, uint32_t pc, size_t pos, size_t *slots);
+
+  const Program &program_;
+  std::string_view s_;
+  size_t slot_num_;
+  std::vector<size_t> init_;  // slots of a thread starting a match
+  Threads cur_;
+  Threads next_;
+  std::vector<Frame> stack_;
+};
+
+}  // namespace regex
+
+#endif  // REGEX_PIKE_H_
@@ -0,0 +1,64 @@
+//
+// Copyright [2020] <inhzus>
+//
+#ifndef REGEX_PREFILTER_H_
+#define REGEX_PREFILTER_H_
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "regex/exp.h"
+
+namespace regex {
+
+// A small set of literals one of which occurs somewhere in every match of an
+// `Exp`, chosen as the rarest among the literals required at the beginning,
+// the end or inside the match. Texts without any of them are rejected before
+// running an engine. When the literals begin every match, no match begins
+// before the first occurrence, where the engines then start.
+//
+// The literals are searched for together with the Teddy algorithm: every
+// literal owns a bit, and the low and high nibbles of the first bytes of a
+// window select the literals that may start there through SSSE3 shuffles.
+class Prefilter {
+ public:
+  static constexpr size_t kMaxLiterals = 8;
+  static constexpr size_t npos = std::string_view::npos;
+
+  // Extract the literals of `exp`, returns false (and stays empty) if no
+  // literal is required.
+  bool Build(const Exp &exp);
+  // Offset of the first occurrence of a literal at or after `pos`, or `npos`.
+  [[nodiscard]] size_t Find(std::string_view s, size_t pos) const;
+
+  [[nodiscard]] bool empty() const { return literals_.empty(); }
+  // Whether every match begins with one of the literals.
+  [[nodiscard]] bool leading() const { return leading_; }
+  [[nodiscard]] const std::vector<std::string> &literals() const {
+    return literals_;
+  }
+
+ private:
+  // bytes of the fingerprint compared by the SIMD scan
+  static constexpr size_t kMaxFingerprint = 3;
+
+  [[nodiscard]] bool Verify(std::string_view s, size_t pos,
+                            uint8_t buckets) const;
+  // Scan 16 windows at a time from `*pos`, returns true with `*pos` at the
+  // first occurrence, or false with `*pos` where the scan stopped.
+  bool Teddy(std::string_view s, size_t *pos) const;
+
+  std::vector<std::string> literals_;
+  bool leading_ = false;
+  size_t fingerprint_;
+  // literals whose i-th byte has the given low/high nibble
+  alignas(16) uint8_t lo_[kMaxFingerprint][16];
+  alignas(16) uint8_t hi_[kMaxFingerprint][16];
+  uint8_t first_[256];  // literals beginning with each byte
+};
+
+}  // namespace regex
+
+#endif  // REGEX_PREFILTER_H_
@@ -0,0 +1,44 @@
+//
+// Copyright [2020] <inhzus>
+//
+#ifndef REGEX_PREFIX_H_
+#define REGEX_PREFIX_H_
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "regex/exp.h"
+
+namespace regex {
+
+// A small set of literals one of which begins every match of an `Exp`, used
+// to skip the positions where no match can start.
+class Prefix {
+ public:
+  static constexpr size_t kMaxLiterals = 8, kMaxLength = 32;
+  static constexpr size_t npos = std::string_view::npos;
+
+  // Extract the literals of `exp`, returns false (and stays empty) if some
+  // match may begin with any character.
+  bool Build(const Exp &exp);
+  // Offset of the first candidate at or after `pos`, or `npos`.
+  [[nodiscard]] size_t Find(std::string_view s, size_t pos) const;
+
+  [[nodiscard]] bool empty() const { return literals_.empty(); }
+  [[nodiscard]] const std::vector<std::string> &literals() const {
+    return literals_;
+  }
+
+ private:
+  // Offset of the first byte at or after `pos` that begins some literal.
+  [[nodiscard]] size_t FindFirstByte(std::string_view s, size_t pos) const;
+
+  std::vector<std::string> literals_;
+  std::string first_bytes_;
+  bool first_table_[256]{};
+};
+
+}  // namespace regex
+
+#endif  // REGEX_PREFIX_H_
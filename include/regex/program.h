@@ -0,0 +1,226 @@
+//
+// Copyright [2020] <inhzus>
+//
+#ifndef REGEX_PROGRAM_H_
+#define REGEX_PROGRAM_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "regex/byte_set.h"
+#include "regex/exp.h"
+#include "regex/prefix.h"
+
+namespace regex {
+
+// A single bytecode instruction. Instructions without an explicit target
+// fall through to the next one.
+struct Inst {
+  enum Op : uint8_t {
+    Any,
+    Atomic,     // push a barrier for "(?>...)"
+    AtomicEnd,  // drop every choice point pushed since the barrier
+    Begin,
+    Char,
+    End,
+    Jmp,
+    Look,
+    NegLook,  // "(?=...)", "(?!...)": body follows, continue at `look.next`
+    Mark,     // remember the position of a loop iteration
+    Match,
+    Progress,  // fail if the loop iteration consumed nothing
+    Ref,
+    Save,
+    Set,
+    SetEx,
+    Split,  // try `split.x` first, then `split.y`
+  };
+
+  static Inst AnyInst() { return Inst(Any); }
+  static Inst AtomicInst() { return Inst(Atomic); }
+  static Inst AtomicEndInst() { return Inst(AtomicEnd); }
+  static Inst BeginInst() { return Inst(Begin); }
+  static Inst CharInst(char ch) {
+    Inst inst(Char);
+    inst.ch.val = ch;
+    return inst;
+  }
+  static Inst EndInst() { return Inst(End); }
+  static Inst JmpInst(uint32_t x) {
+    Inst inst(Jmp);
+    inst.jmp.x = x;
+    return inst;
+  }
+  static Inst LookInst(uint32_t next, bool negative) {
+    Inst inst(negative ? NegLook : Look);
+    inst.look.next = next;
+    return inst;
+  }
+  static Inst MarkInst(uint32_t slot) {
+    Inst inst(Mark);
+    inst.mark.slot = slot;
+    return inst;
+  }
+  static Inst MatchInst() { return Inst(Match); }
+  static Inst ProgressInst(uint32_t slot) {
+    Inst inst(Progress);
+    inst.mark.slot = slot;
+    return inst;
+  }
+  static Inst RefInst(uint32_t idx) {
+    Inst inst(Ref);
+    inst.ref.idx = idx;
+    return inst;
+  }
+  static Inst SaveInst(uint32_t slot) {
+    Inst inst(Save);
+    inst.save.slot = slot;
+    return inst;
+  }
+  static Inst SetInst(uint32_t idx, bool exclude) {
+    Inst inst(exclude ? SetEx : Set);
+    inst.set.idx = idx;
+    return inst;
+  }
+  static Inst SplitInst(uint32_t x, uint32_t y) {
+    Inst inst(Split);
+    inst.split.x = x;
+    inst.split.y = y;
+    return inst;
+  }
+
+  // Shift every jump target by `offset`, used when fragments are appended.
+  void Relocate(uint32_t offset) {
+    switch (op) {
+      case Jmp:
+        jmp.x += offset;
+        break;
+      case Split:
+        split.x += offset;
+        split.y += offset;
+        break;
+      case Look:
+      case NegLook:
+        look.next += offset;
+        break;
+      default:
+        break;
+    }
+  }
+
+  Op op;
+  union {
+    struct {
+      char val;
+    } ch;
+    struct {
+      uint32_t x;
+    } jmp;
+    struct {
+      uint32_t next;
+    } look;
+    struct {
+      uint32_t slot;
+    } mark, save;
+    struct {
+      uint32_t idx;
+    } ref, set;
+    struct {
+      uint32_t x;
+      uint32_t y;
+    } split;
+  };
+
+ private:
+  explicit Inst(Op op) : op(op), split({0, 0}) {}
+};
+
+// How much of the text a match must span.
+enum Anchor {
+  Unanchored,
+  AnchorStart,  // the match begins at the start of the text
+  AnchorBoth,   // the match is the whole text
+};
+
+// Instruction sequence lowered from the postfix `Exp`. Slots [0, 2 *
+// group_num) hold the capture boundaries, the remaining `reg_num` slots are
+// scratch registers used by the empty-loop checks.
+class Program {
+ public:
+  // value of a slot whose group did not participate in the match
+  static constexpr size_t kUnset = static_cast<size_t>(-1);
+
+  // instructions a program may have by default
+  static constexpr size_t kMaxSize = size_t{1} << 20;
+
+  // With `reverse` the program matches the reversed strings, "^" and "$"
+  // swapping roles. Such programs are only run by the reverse DFA. Counted
+  // repetitions are copied out, so a pattern needing more than `max_size`
+  // instructions compiles to an empty program instead.
+  static Program Compile(const Exp &exp, bool reverse = false,
+                         size_t max_size = kMaxSize);
+
+  // Alternation of `programs`, none of which may backtrack, that keeps their
+  // `Match` instructions apart, in the same order. Such programs are only
+  // run by the overlapping DFA.
+  static Program Union(const std::vector<const Program *> &programs);
+
+  Program()
+      : group_num_(0),
+        reg_num_(0),
+        backtrack_(false),
+        anchored_(false),
+        first_(ByteSet::All()) {}
+
+  [[nodiscard]] const std::vector<Inst> &insts() const { return insts_; }
+  [[nodiscard]] const std::vector<ByteSet> &sets() const { return sets_; }
+  [[nodiscard]] size_t group_num() const { return group_num_; }
+  [[nodiscard]] size_t slot_num() const { return group_num_ * 2 + reg_num_; }
+  // Whether the pattern was too large to compile.
+  [[nodiscard]] bool empty() const { return insts_.empty(); }
+  // Whether the program uses back-references, look-ahead or atomic groups,
+  // which only the backtracking VM is able to run.
+  [[nodiscard]] bool backtrack() const { return backtrack_; }
+  // Whether every alternative begins with "^", so that a match may only
+  // start at offset 0.
+  [[nodiscard]] bool anchored() const { return anchored_; }
+  // Literals every match begins with, empty if unknown or `reverse`.
+  [[nodiscard]] const Prefix &prefix() const { return prefix_; }
+  // Bytes every match begins with one of, all of them if some match may be
+  // empty or the program is `reverse`.
+  [[nodiscard]] const ByteSet &first() const { return first_; }
+  // Classes of bytes no instruction tells apart, the columns of the DFAs.
+  [[nodiscard]] const ByteClasses &classes() const { return classes_; }
+  // Whether the `Split` at `pc` needs no choice point when the instruction at
+  // `split.x` accepts the next byte: no path through `split.y` could match
+  // then. The backtracking engines take `split.x` or `split.y` by that byte
+  // alone, as if the loop of "\d+:" were written "\d++:". Only known for
+  // programs the VMs run, false in `reverse` ones and unions.
+  [[nodiscard]] bool possessive(uint32_t pc) const {
+    return pc < possessive_.size() && possessive_[pc];
+  }
+  // Whether the instruction at `pc`, one consuming a byte, accepts `ch`.
+  [[nodiscard]] bool Accepts(uint32_t pc, char ch) const;
+  // Offset of the first position at or after `pos` a match may begin at
+  // judging by `prefix` and `first`, or `Prefix::npos`.
+  [[nodiscard]] size_t FindStart(std::string_view s, size_t pos) const;
+  // Human-readable listing, one instruction per line.
+  [[nodiscard]] std::string Dump() const;
+
+ private:
+  std::vector<Inst> insts_;
+  std::vector<ByteSet> sets_;
+  size_t group_num_;
+  size_t reg_num_;
+  bool backtrack_;
+  bool anchored_;
+  Prefix prefix_;
+  ByteSet first_;
+  ByteClasses classes_;
+  std::vector<uint8_t> possessive_;  // by pc
+};
+
+}  // namespace regex
+
+#endif  // REGEX_PROGRAM_H_
@@ -0,0 +1,58 @@
+//
+// Copyright [2020] <inhzus>
+//
+#ifndef REGEX_REGEX_SET_H_
+#define REGEX_REGEX_SET_H_
+
+#include <algorithm>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+#include "regex/dfa.h"
+#include "regex/graph.h"
+#include "regex/program.h"
+
+namespace regex {
+
+// Many patterns searched for together. The programs of the patterns that do
+// not backtrack are joined by `Program::Union` and run on one overlapping
+// DFA, so a single scan of the text tells which of them match; the others
+// are tested one by one, as are all of them while another thread has the
+// DFA.
+class RegexSet {
+ public:
+  static RegexSet Compile(const std::vector<std::string_view> &patterns,
+                          const Options &options = {});
+
+  // Indices of the patterns matching somewhere in `s`, in ascending order.
+  [[nodiscard]] std::vector<size_t> Matches(std::string_view s) const;
+  // The same into `matches`, with `pcs` as the buffer of the DFA, so that
+  // both keep their capacity from one call to the next.
+  void Matches(std::string_view s, std::vector<size_t> *matches,
+               std::vector<uint32_t> *pcs) const;
+  // Whether any of the patterns matches.
+  [[nodiscard]] bool Test(std::string_view s) const;
+
+  [[nodiscard]] size_t size() const { return graphs_.size(); }
+  [[nodiscard]] const Graph &operator[](size_t idx) const {
+    return graphs_[idx];
+  }
+
+ private:
+  // Whether pattern `idx` is run by `dfa_`.
+  [[nodiscard]] bool Covered(size_t idx) const {
+    return std::binary_search(dfa_patterns_.begin(), dfa_patterns_.end(),
+                              idx);
+  }
+
+  std::vector<Graph> graphs_;
+  // patterns run by `dfa_`, in the order of their `Match` instructions
+  std::vector<size_t> dfa_patterns_;
+  std::vector<uint32_t> match_pcs_;
+  mutable std::unique_ptr<LazyDfa> dfa_;
+};
+
+}  // namespace regex
+
+#endif  // REGEX_REGEX_SET_H_
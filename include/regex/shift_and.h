@@ -0,0 +1,62 @@
+//
+// Copyright [2020] <inhzus>
+//
+#ifndef REGEX_SHIFT_AND_H_
+#define REGEX_SHIFT_AND_H_
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "regex/exp.h"
+
+namespace regex {
+
+// Bit-parallel simulation of the Glushkov position automaton of small
+// patterns. Every character position of the expression owns a bit of a
+// 64-bit word; a step ORs the follow masks of the active positions, looked
+// up a byte of the word at a time, and keeps those accepting the next
+// character. It only tells whether a match exists.
+class ShiftAnd {
+ public:
+  static constexpr size_t kMaxPositions = 64;
+
+  // Build the automaton of `exp`, returns false if it has more than
+  // `kMaxPositions` positions or uses anchors, back-references,
+  // look-ahead, atomic groups or possessive quantifiers.
+  bool Build(const Exp &exp);
+  [[nodiscard]] bool Test(std::string_view s) const;
+
+  [[nodiscard]] size_t position_num() const { return follow_.size(); }
+
+ private:
+  static constexpr size_t kChunkBits = 8;
+
+  struct Fragment {
+    uint64_t first;
+    uint64_t last;
+    bool nullable;
+    uint32_t begin;  // the positions of the fragment are [begin, end)
+  };
+
+  uint64_t Follow(uint64_t active) const {
+    uint64_t next = 0;
+    for (size_t i = 0; i < chunk_num_; ++i) {
+      next |= table_[i << kChunkBits | (active >> (i * kChunkBits) & 0xff)];
+    }
+    return next;
+  }
+
+  std::vector<uint64_t> follow_;  // positions that may follow each one
+  uint64_t masks_[256];           // positions accepting each byte
+  uint64_t first_;
+  uint64_t last_;
+  bool nullable_;
+  size_t chunk_num_;
+  // union of the follow masks of every value of every byte of the state
+  std::vector<uint64_t> table_;
+};
+
+}  // namespace regex
+
+#endif  // REGEX_SHIFT_AND_H_
@@ -0,0 +1,886 @@
+//
+// Copyright [2020] <inhzus>
+//
+#ifndef REGEX_STATIC_H_
+#define REGEX_STATIC_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <string_view>
+#include <vector>
+
+namespace regex {
+
+// Patterns known at build time, parsed by a constexpr parser and matched by
+// a backtracker instantiated node by node, so that every character, set and
+// repeat of the pattern becomes inline code:
+//
+//   using Email = regex::Static<"(\\w+)@(\\w+)\\.com">;
+//   auto matcher = Email::Match(s);  // as with `Graph::Match`
+//   if (matcher) std::cout << matcher.Group(1);
+//
+// The syntax and the leftmost-first semantics are those of `Exp::FromStr`
+// and `Graph::Match`. A malformed pattern fails to compile.
+//
+// Depth limit: repeats of a single character or set run in a loop, but the
+// matcher recurses once per iteration of any other repeat. Once the bodies
+// of the nested iterations add up to `ct::Context::kMaxDepth` nodes, about
+// 4096 iterations of "(ab)*", it gives up and reports no match with
+// `overflowed()` set, where `Graph::Match` may find one; such texts need
+// the graph.
+//
+// As the backtracker does, the matcher tries each point of a pattern
+// without back-references once per position when a bit per point and
+// position fits `ct::Points::kVisitBudget`, which bounds the search by
+// O(n * m). A loop whose body may match the empty
+// string then ends, as in the VMs, where a path comes back to a point it
+// already tried at that position; without the bits, an empty iteration
+// ends it.
+template <size_t N>
+struct FixedString {
+  // NOLINTNEXTLINE(runtime/explicit): converts from the literal argument
+  constexpr FixedString(const char (&s)[N]) {
+    for (size_t i = 0; i < N; ++i) data[i] = s[i];
+  }
+  [[nodiscard]] constexpr size_t size() const { return N - 1; }
+  constexpr char operator[](size_t i) const { return data[i]; }
+
+  char data[N];
+};
+
+namespace ct {
+
+// called from constant evaluation, so that a malformed pattern is reported
+// by the compiler at this name
+inline void InvalidPattern() {}
+
+struct Node {
+  enum Kind : uint8_t {
+    Ahead,
+    NegAhead,  // "(?=...)", "(?!...)" around `left`
+    Any,
+    Atomic,  // "(?>...)" around `left`
+    Begin,
+    Char,
+    Concat,  // `left` then `right`
+    Either,  // `left` or else `right`
+    Empty,
+    End,
+    Group,  // capture `left` into group `idx`
+    Ref,    // the text of group `idx`
+    Repeat,
+    Set,
+  };
+  enum Greed : uint8_t { Greedy, Possessive, Reluctant };
+
+  [[nodiscard]] constexpr bool Contains(char ch) const {
+    auto byte = static_cast<uint8_t>(ch);
+    return bits[byte >> 6] >> (byte & 63) & 1;
+  }
+  // Whether the node matches exactly one byte: a character, a set or any.
+  [[nodiscard]] constexpr bool OneByte() const {
+    return kind == Any || kind == Char || kind == Set;
+  }
+  // Whether a one-byte node accepts `ch`.
+  [[nodiscard]] constexpr bool Accepts(char ch) const {
+    return kind == Any || (kind == Char ? this->ch == ch : Contains(ch));
+  }
+
+  Kind kind = Empty;
+  Greed greed = Greedy;
+  char ch = 0;
+  uint32_t left = 0, right = 0;
+  size_t idx = 0;
+  size_t lower = 0, upper = 0;
+  uint64_t bits[4] = {};
+};
+
+// The syntax tree in a fixed array, `nodes[root]` is the whole pattern.
+// Group names are spans of the pattern.
+template <size_t N>
+struct Ast {
+  static constexpr size_t kMaxNodes = 3 * N + 2;
+
+  Node nodes[kMaxNodes] = {};
+  size_t node_num = 0;
+  uint32_t root = 0;
+  size_t group_num = 1;
+  size_t name_begin[N] = {}, name_len[N] = {}, name_group[N] = {};
+  size_t name_num = 0;
+};
+
+static constexpr size_t kInfinite = std::numeric_limits<size_t>::max();
+
+// Recursive descent over the grammar of `Exp::FromStr`:
+//   either := concat ("|" concat)*
+//   concat := repeat*
+//   repeat := atom ("*" | "+" | "?" | "{m,n}")* each followed by "+" or "?"
+template <size_t N>
+class Parser {
+ public:
+  constexpr explicit Parser(const FixedString<N> &s) : s_(s), it_(0) {}
+
+  constexpr Ast<N> Parse() {
+    ast_.root = Either();
+    if (it_ != s_.size()) InvalidPattern();
+    return ast_;
+  }
+
+ private:
+  [[nodiscard]] constexpr bool More() const { return it_ < s_.size(); }
+  constexpr char Peek() const { return More() ? s_[it_] : '\0'; }
+  constexpr char Next() {
+    if (!More()) InvalidPattern();
+    return s_[it_++];
+  }
+  constexpr uint32_t Add(Node node) {
+    if (ast_.node_num == Ast<N>::kMaxNodes) InvalidPattern();
+    ast_.nodes[ast_.node_num] = node;
+    return static_cast<uint32_t>(ast_.node_num++);
+  }
+  constexpr uint32_t Binary(Node::Kind kind, uint32_t left, uint32_t right) {
+    Node node;
+    node.kind = kind;
+    node.left = left;
+    node.right = right;
+    return Add(node);
+  }
+
+  constexpr uint32_t Either() {
+    uint32_t left = Concat();
+    if (Peek() != '|') return left;
+    ++it_;
+    return Binary(Node::Either, left, Either());
+  }
+
+  // Right-leaning like the postfix form of `Exp::FromStr`.
+  constexpr uint32_t Concat() {
+    uint32_t items[N] = {};
+    size_t num = 0;
+    while (More() && Peek() != '|' && Peek() != ')') items[num++] = Repeat();
+    if (num == 0) return Add(Node{});
+    uint32_t back = items[--num];
+    while (num > 0) back = Binary(Node::Concat, items[--num], back);
+    return back;
+  }
+
+  constexpr size_t Number() {
+    size_t num = 0;
+    while (Peek() >= '0' && Peek() <= '9') num = num * 10 + (Next() - '0');
+    return num;
+  }
+
+  constexpr uint32_t Repeat() {
+    uint32_t elem = Atom();
+    while (true) {
+      Node node;
+      node.kind = Node::Repeat;
+      switch (Peek()) {
+        case '*':
+          node.upper = kInfinite;
+          break;
+        case '+':
+          node.lower = 1;
+          node.upper = kInfinite;
+          break;
+        case '?':
+          node.upper = 1;
+          break;
+        case '{': {
+          ++it_;
+          node.lower = node.upper = Number();
+          if (Peek() == ',') {
+            ++it_;
+            node.upper = Peek() == '}' ? kInfinite : Number();
+          }
+          if (Peek() != '}' || node.lower > node.upper) InvalidPattern();
+          break;
+        }
+        default:
+          return elem;
+      }
+      ++it_;
+      if (Peek() == '+') {
+        node.greed = Node::Possessive;
+        ++it_;
+      } else if (Peek() == '?') {
+        node.greed = Node::Reluctant;
+        ++it_;
+      }
+      node.left = elem;
+      elem = Add(node);
+    }
+  }
+
+  static constexpr void Insert(Node *node, char first, char last) {
+    for (int ch = static_cast<uint8_t>(first); ch <= static_cast<uint8_t>(last);
+         ++ch) {
+      node->bits[ch >> 6] |= uint64_t{1} << (ch & 63);
+    }
+  }
+  // Shorthand classes "\d", "\w", "\s" and their complements, returns false
+  // for any other escaped character.
+  static constexpr bool Shorthand(Node *node, char ch) {
+    Node group;
+    switch (ch) {
+      case 'd':
+      case 'D':
+        Insert(&group, '0', '9');
+        break;
+      case 'w':
+      case 'W':
+        Insert(&group, '0', '9');
+        Insert(&group, 'a', 'z');
+        Insert(&group, 'A', 'Z');
+        Insert(&group, '_', '_');
+        break;
+      case 's':
+      case 'S':
+        Insert(&group, '\t', '\n');
+        Insert(&group, '\f', '\r');
+        Insert(&group, ' ', ' ');
+        break;
+      default:
+        return false;
+    }
+    bool exclude = ch == 'D' || ch == 'W' || ch == 'S';
+    for (size_t i = 0; i < 4; ++i) {
+      node->bits[i] |= exclude ? ~group.bits[i] : group.bits[i];
+    }
+    return true;
+  }
+
+  constexpr uint32_t Bracket() {
+    Node node;
+    node.kind = Node::Set;
+    bool exclude = Peek() == '^';
+    if (exclude) ++it_;
+    char prev = 0;
+    if (Peek() == '-' || Peek() == ']') {
+      prev = Next();
+      Insert(&node, prev, prev);
+    }
+    while (Peek() != ']') {
+      char ch = Next();
+      if (ch == '\\') {
+        ch = Next();
+        if (Shorthand(&node, ch)) continue;
+      } else if (ch == '-' && Peek() != ']') {
+        ch = Next();
+        if (static_cast<uint8_t>(prev) > static_cast<uint8_t>(ch)) {
+          InvalidPattern();
+        }
+        Insert(&node, prev, ch);
+        continue;
+      }
+      Insert(&node, ch, ch);
+      prev = ch;
+    }
+    ++it_;
+    if (exclude) {
+      for (auto &bits : node.bits) bits = ~bits;
+    }
+    return Add(node);
+  }
+
+  [[nodiscard]] constexpr bool Named(size_t begin, size_t len,
+                                     size_t *group) const {
+    for (size_t i = 0; i < ast_.name_num; ++i) {
+      if (ast_.name_len[i] != len) continue;
+      bool same = true;
+      for (size_t j = 0; j < len; ++j) {
+        same = same && s_[ast_.name_begin[i] + j] == s_[begin + j];
+      }
+      if (same) {
+        *group = ast_.name_group[i];
+        return true;
+      }
+    }
+    return false;
+  }
+
+  constexpr uint32_t Paren() {
+    Node node;
+    node.kind = Node::Group;
+    if (Peek() != '?') {
+      node.idx = ast_.group_num++;
+    } else {
+      ++it_;
+      switch (Next()) {
+        case '=':
+          node.kind = Node::Ahead;
+          break;
+        case '!':
+          node.kind = Node::NegAhead;
+          break;
+        case '>':
+          node.kind = Node::Atomic;
+          break;
+        case ':':
+          return Close(Either());
+        case 'P': {
+          char flag = Next();
+          size_t begin = it_;
+          while (Peek() != (flag == '<' ? '>' : ')')) Next();
+          size_t len = it_ - begin;
+          if (flag == '=') {
+            node.kind = Node::Ref;
+            if (!Named(begin, len, &node.idx)) InvalidPattern();
+            ++it_;
+            return Add(node);
+          }
+          if (flag != '<') InvalidPattern();
+          ++it_;
+          ast_.name_begin[ast_.name_num] = begin;
+          ast_.name_len[ast_.name_num] = len;
+          ast_.name_group[ast_.name_num++] = ast_.group_num;
+          node.idx = ast_.group_num++;
+          break;
+        }
+        default:
+          InvalidPattern();
+      }
+    }
+    node.left = Close(Either());
+    return Add(node);
+  }
+  constexpr uint32_t Close(uint32_t node) {
+    if (Next() != ')') InvalidPattern();
+    return node;
+  }
+
+  constexpr uint32_t Atom() {
+    Node node;
+    char ch = Next();
+    switch (ch) {
+      case '(':
+        return Paren();
+      case '[':
+        return Bracket();
+      case '.':
+        node.kind = Node::Any;
+        return Add(node);
+      case '^':
+        node.kind = Node::Begin;
+        return Add(node);
+      case '$':
+        node.kind = Node::End;
+        return Add(node);
+      case '*':
+      case '+':
+      case '?':
+      case '{':
+      case ')':
+        InvalidPattern();
+        break;
+      case '\\':
+        ch = Next();
+        if (Shorthand(&node, ch)) {
+          node.kind = Node::Set;
+          return Add(node);
+        }
+        break;
+      default:
+        break;
+    }
+    node.kind = Node::Char;
+    node.ch = ch;
+    return Add(node);
+  }
+
+  const FixedString<N> &s_;
+  size_t it_;
+  Ast<N> ast_;
+};
+
+// Whether every match of node `idx` begins with "^".
+template <size_t N>
+constexpr bool Anchored(const Ast<N> &ast, uint32_t idx) {
+  const Node &node = ast.nodes[idx];
+  switch (node.kind) {
+    case Node::Begin:
+      return true;
+    case Node::Atomic:
+    case Node::Concat:
+    case Node::Group:
+      return Anchored(ast, node.left);
+    case Node::Either:
+      return Anchored(ast, node.left) && Anchored(ast, node.right);
+    case Node::Repeat:
+      return node.lower > 0 && Anchored(ast, node.left);
+    default:
+      return false;
+  }
+}
+
+// The points of the tree the VMs tell apart: every node in each copy
+// `Program` unrolls the repeats around it into, and the choice of each copy
+// of a repeat to run another iteration. As the backtracker does, the
+// matcher tries a point once per position when a bit per point and
+// position fits `kVisitBudget`, which bounds a search by O(n * m) and cuts
+// off an empty iteration of a loop. Only the choices and the nodes two
+// paths may reach at the same position get a bit: a node after one of a
+// fixed width and a single way to match is tried once per try of that one.
+// The bodies of atomic groups and look-aheads are not memoized and keep
+// checking that an iteration made progress, as does every loop of a search
+// without the bits.
+template <size_t N>
+struct Points {
+  static constexpr size_t kMaxPoints = size_t{1} << 20;
+  static constexpr size_t kVisitBudget = size_t{32} << 20;  // bits
+
+  constexpr explicit Points(const Ast<N> &ast) {
+    bool ref = false;
+    // children are added before their parents
+    for (size_t i = 0; i < ast.node_num; ++i) {
+      const Node &node = ast.nodes[i];
+      ref = ref || node.kind == Node::Ref;
+      size[i] = 1;
+      switch (node.kind) {
+        case Node::Concat:
+        case Node::Either:
+          size[i] += size[node.right];
+          [[fallthrough]];
+        case Node::Ahead:
+        case Node::NegAhead:
+        case Node::Atomic:
+        case Node::Group:
+        case Node::Repeat:
+          size[i] += size[node.left];
+          break;
+        default:
+          break;
+      }
+      switch (node.kind) {
+        case Node::Concat:
+          fixed[i] = fixed[node.left] && fixed[node.right];
+          break;
+        case Node::Atomic:
+        case Node::Group:
+          fixed[i] = fixed[node.left];
+          break;
+        case Node::Repeat:
+          fixed[i] = node.lower == node.upper && fixed[node.left];
+          break;
+        case Node::Either:
+        case Node::Ref:
+          fixed[i] = false;
+          break;
+        default:
+          // a byte or none, a look-ahead goes on once where it began
+          fixed[i] = true;
+          break;
+      }
+    }
+    copies[ast.root] = 1;
+    for (size_t i = ast.node_num; i-- > 0;) {
+      const Node &node = ast.nodes[i];
+      guarded[i] = guarded[i] || node.kind == Node::Ahead ||
+                   node.kind == Node::NegAhead || node.kind == Node::Atomic ||
+                   (node.kind == Node::Repeat &&
+                    node.greed == Node::Possessive);
+      size_t inner = copies[i];
+      if (joined[i]) {
+        entry[i] = num;
+        num = Add(num, copies[i]);
+      }
+      if (node.kind == Node::Repeat) {
+        // `lower` copies then a loop, or `upper` copies
+        iterations[i] = node.upper == kInfinite ? node.lower + 1 : node.upper;
+        inner = Mul(inner, iterations[i]);
+        loop[i] = num;
+        num = Add(num, inner);
+      }
+      switch (node.kind) {
+        case Node::Concat:
+        case Node::Either:
+          copies[node.right] = inner;
+          guarded[node.right] = guarded[i];
+          [[fallthrough]];
+        case Node::Ahead:
+        case Node::NegAhead:
+        case Node::Atomic:
+        case Node::Group:
+        case Node::Repeat:
+          copies[node.left] = inner;
+          guarded[node.left] = guarded[i];
+          break;
+        default:
+          break;
+      }
+      // the copies of a body up to `lower` follow each other without a
+      // choice, those past it are run once per choice
+      if (node.kind == Node::Concat) {
+        joined[node.right] = !fixed[node.left];
+      } else if (node.kind == Node::Repeat) {
+        joined[node.left] = node.lower > 1 && !fixed[node.left];
+      }
+    }
+    // the outcome of a back-reference depends on the groups, not only on
+    // the point and the position, and a tree without repeats where no two
+    // paths meet has nothing to mark
+    memo = !ref && num != 0 && num <= kMaxPoints;
+  }
+
+  // Whether the visited points of a search of `len` bytes fit the budget.
+  [[nodiscard]] constexpr bool Fits(size_t len) const {
+    return memo && len < kVisitBudget / num;
+  }
+
+  // Products and sums saturate past `kMaxPoints`.
+  static constexpr size_t Add(size_t a, size_t b) {
+    return a + b > kMaxPoints ? kMaxPoints + 1 : a + b;
+  }
+  static constexpr size_t Mul(size_t a, size_t b) {
+    return b != 0 && a > kMaxPoints / b ? kMaxPoints + 1 : a * b;
+  }
+
+  bool guarded[Ast<N>::kMaxNodes] = {};  // inside an atomic group or look
+  bool fixed[Ast<N>::kMaxNodes] = {};    // fixed width, one way to match
+  bool joined[Ast<N>::kMaxNodes] = {};   // reached twice at one position
+  size_t size[Ast<N>::kMaxNodes] = {};   // nodes of the subtree
+  size_t copies[Ast<N>::kMaxNodes] = {};
+  size_t iterations[Ast<N>::kMaxNodes] = {};  // copies of a repeat body
+  size_t entry[Ast<N>::kMaxNodes] = {};  // first point of the node copies
+  size_t loop[Ast<N>::kMaxNodes] = {};   // first choice of a repeat
+  size_t num = 0;
+  bool memo = false;  // whether the visited points may be kept
+};
+
+// State of one search: the text and the capture offsets, [2 * i, 2 * i + 1]
+// for group i, `kUnset` when the group did not participate, then the points
+// tried at each position if `memo`, which the matcher owns. Every
+// iteration of a repeat of more than one byte nests the frames of the next
+// one, `depth` counts the nodes of the bodies being run and the search
+// gives up past `kMaxDepth`, which fits an 8 MiB stack even in unoptimized
+// builds.
+template <size_t G>
+struct Context {
+  static constexpr size_t kUnset = kInfinite;
+  static constexpr size_t kMaxDepth = size_t{1} << 14;
+
+  // Whether `point` is tried at `pos` for the first time, marking it.
+  constexpr bool Visit(size_t point, size_t pos) {
+    size_t bit = point * (s.size() + 1) + pos;
+    uint64_t mask = uint64_t{1} << (bit & 63);
+    if (visited[bit >> 6] & mask) return false;
+    visited[bit >> 6] |= mask;
+    return true;
+  }
+
+  std::string_view s;
+  std::array<size_t, G * 2> slots;
+  bool memo = false;
+  uint64_t *visited = nullptr;
+  size_t depth = 0;
+  bool overflowed = false;
+};
+
+// Match copy `copy` of node `I` of the tree of `Re` at `pos`, then call the
+// continuation `k` with the position reached; alternatives are tried until
+// `k` accepts.
+template <typename Re, uint32_t I, typename Ctx, typename K>
+constexpr bool Run(Ctx &ctx, size_t pos, size_t copy, const K &k);
+
+template <typename Re, uint32_t I, typename Ctx, typename K>
+constexpr bool Loop(Ctx &ctx, size_t pos, size_t copy, size_t count,
+                    const K &k) {
+  constexpr const Node &node = Re::kAst.nodes[I];
+  constexpr bool kMemo = Re::kPoints.memo && !Re::kPoints.guarded[I];
+  constexpr size_t kIterations = Re::kPoints.iterations[I];
+  // the copy of the body running iteration `count`, the copies past `lower`
+  // of an unbounded repeat are its loop
+  auto body = [copy](size_t count) {
+    return copy * kIterations +
+           (count < kIterations ? count : kIterations - 1);
+  };
+  constexpr size_t kChoice = Re::kPoints.loop[I];
+  if (ctx.overflowed) return false;
+  if constexpr (Re::kAst.nodes[node.left].OneByte()) {
+    // the run of bytes a single-byte body accepts is counted in place, only
+    // the continuation is tried at each end, so long runs do not recurse
+    constexpr const Node &elem = Re::kAst.nodes[node.left];
+    bool memo = kMemo && node.upper == kInfinite && ctx.memo;
+    std::string_view s = ctx.s;
+    size_t need = count < node.lower ? node.lower - count : 0;
+    size_t most = node.upper - count;
+    if (most > s.size() - pos) most = s.size() - pos;
+    // each copy before the loop is only reached from the previous one, so
+    // only the loop is checked against the visited points
+    if constexpr (node.greed == Node::Reluctant) {
+      for (size_t n = 0;; ++n) {
+        if (n >= need) {
+          if (memo && !ctx.Visit(kChoice + body(node.lower), pos + n)) {
+            return false;
+          }
+          if (k(pos + n)) return true;
+        }
+        if (n == most || !elem.Accepts(s[pos + n])) return false;
+      }
+    } else {
+      size_t n = 0;
+      while (n < most && elem.Accepts(s[pos + n])) ++n;
+      if (n < need) return false;
+      if (memo) {
+        // the whole run passes the loop before any exit is tried, and ends
+        // where it comes back to a tried position
+        size_t end = need;
+        while (end <= n && ctx.Visit(kChoice + body(node.lower), pos + end)) {
+          ++end;
+        }
+        if (end == need) return false;
+        n = end - 1;
+      }
+      for (;; --n) {
+        if (k(pos + n)) return true;
+        if (n == need) return false;
+      }
+    }
+  } else {
+    constexpr size_t kSize = Re::kPoints.size[node.left];
+    bool memo = kMemo && ctx.memo;
+    auto iterate = [&](size_t count) {
+      if (ctx.depth > Ctx::kMaxDepth - kSize) {
+        ctx.overflowed = true;
+        return false;
+      }
+      auto again = [&](size_t next) {
+        // past the minimum, an iteration of an unbounded loop must consume
+        // something, as `Program` guards it, unless the visited points cut
+        // off the empty one at the choice it comes back to
+        return (memo || count < node.lower || node.upper != kInfinite ||
+                next != pos) &&
+               Loop<Re, I>(ctx, next, copy, count + 1, k);
+      };
+      ctx.depth += kSize;
+      bool matched = Run<Re, node.left>(ctx, pos, body(count), again);
+      ctx.depth -= kSize;
+      return matched;
+    };
+    if (count < node.lower) return iterate(count);
+    if (count == node.upper) return k(pos);
+    if (memo && !ctx.Visit(kChoice + body(count), pos)) return false;
+    if constexpr (node.greed == Node::Reluctant) {
+      return k(pos) || iterate(count);
+    } else {
+      return iterate(count) || k(pos);
+    }
+  }
+}
+
+template <typename Re, uint32_t I, typename Ctx, typename K>
+constexpr bool Run(Ctx &ctx, size_t pos, size_t copy, const K &k) {
+  constexpr const Node &node = Re::kAst.nodes[I];
+  std::string_view s = ctx.s;
+  if constexpr (Re::kPoints.memo && !Re::kPoints.guarded[I] &&
+                Re::kPoints.joined[I]) {
+    if (ctx.memo && !ctx.Visit(Re::kPoints.entry[I] + copy, pos)) {
+      return false;
+    }
+  }
+  if constexpr (node.kind == Node::Ahead || node.kind == Node::NegAhead) {
+    auto saved = ctx.slots;
+    bool matched =
+        Run<Re, node.left>(ctx, pos, copy, [](size_t) { return true; });
+    if (node.kind == Node::NegAhead) ctx.slots = saved;
+    if (matched == (node.kind == Node::Ahead) && k(pos)) return true;
+    ctx.slots = saved;
+    return false;
+  } else if constexpr (node.kind == Node::Any) {
+    return pos < s.size() && k(pos + 1);
+  } else if constexpr (node.kind == Node::Atomic ||
+                       (node.kind == Node::Repeat &&
+                        node.greed == Node::Possessive)) {
+    // only the first way the body matches is ever tried
+    auto saved = ctx.slots;
+    size_t end = 0;
+    auto first = [&end](size_t next) {
+      end = next;
+      return true;
+    };
+    bool matched;
+    if constexpr (node.kind == Node::Atomic) {
+      matched = Run<Re, node.left>(ctx, pos, copy, first);
+    } else {
+      matched = Loop<Re, I>(ctx, pos, copy, 0, first);
+    }
+    if (matched && k(end)) return true;
+    ctx.slots = saved;
+    return false;
+  } else if constexpr (node.kind == Node::Begin) {
+    return pos == 0 && k(pos);
+  } else if constexpr (node.kind == Node::Char) {
+    return pos < s.size() && s[pos] == node.ch && k(pos + 1);
+  } else if constexpr (node.kind == Node::Concat) {
+    return Run<Re, node.left>(ctx, pos, copy, [&](size_t next) {
+      return Run<Re, node.right>(ctx, next, copy, k);
+    });
+  } else if constexpr (node.kind == Node::Either) {
+    return Run<Re, node.left>(ctx, pos, copy, k) ||
+           Run<Re, node.right>(ctx, pos, copy, k);
+  } else if constexpr (node.kind == Node::Empty) {
+    return k(pos);
+  } else if constexpr (node.kind == Node::End) {
+    return pos == s.size() && k(pos);
+  } else if constexpr (node.kind == Node::Group) {
+    size_t begin = ctx.slots[node.idx * 2], end = ctx.slots[node.idx * 2 + 1];
+    ctx.slots[node.idx * 2] = pos;
+    if (Run<Re, node.left>(ctx, pos, copy, [&](size_t next) {
+          size_t last = ctx.slots[node.idx * 2 + 1];
+          ctx.slots[node.idx * 2 + 1] = next;
+          if (k(next)) return true;
+          ctx.slots[node.idx * 2 + 1] = last;
+          return false;
+        })) {
+      return true;
+    }
+    ctx.slots[node.idx * 2] = begin;
+    ctx.slots[node.idx * 2 + 1] = end;
+    return false;
+  } else if constexpr (node.kind == Node::Ref) {
+    // a group that did not participate matches the empty string
+    size_t first = ctx.slots[node.idx * 2], last = ctx.slots[node.idx * 2 + 1];
+    size_t len = first == Ctx::kUnset || last == Ctx::kUnset || last < first
+                     ? 0
+                     : last - first;
+    return s.size() - pos >= len &&
+           s.substr(pos, len) == s.substr(first, len) && k(pos + len);
+  } else if constexpr (node.kind == Node::Repeat) {
+    return Loop<Re, I>(ctx, pos, copy, 0, k);
+  } else {
+    static_assert(node.kind == Node::Set);
+    return pos < s.size() && node.Contains(s[pos]) && k(pos + 1);
+  }
+}
+
+}  // namespace ct
+
+// Result of `Static<...>::Match`, with the accessors of `Matcher`.
+template <typename Re>
+class StaticMatcher {
+ public:
+  friend Re;
+
+  constexpr explicit operator bool() const { return ok_; }
+
+  [[nodiscard]] constexpr size_t BeginIdx() const {
+    return groups_[0].begin() - s_.begin();
+  }
+  [[nodiscard]] constexpr size_t EndIdx() const {
+    return groups_[0].end() - s_.begin();
+  }
+  [[nodiscard]] constexpr size_t Size() const { return groups_[0].size(); }
+  [[nodiscard]] constexpr std::string_view Str() const { return groups_[0]; }
+  [[nodiscard]] constexpr std::string_view Group(size_t idx) const {
+    return groups_[idx];
+  }
+  [[nodiscard]] constexpr std::string_view Group(std::string_view key) const {
+    size_t idx = Re::Group(key);
+    if (idx == Re::kGroupNum) return {};
+    return groups_[idx];
+  }
+  [[nodiscard]] constexpr bool ok() const { return ok_; }
+  // Whether the search gave up past `ct::Context::kMaxDepth`, in which case
+  // no match is reported but the text may still contain one.
+  [[nodiscard]] constexpr bool overflowed() const { return overflowed_; }
+  [[nodiscard]] constexpr const std::array<std::string_view, Re::kGroupNum>
+      &groups() const {
+    return groups_;
+  }
+
+ private:
+  static constexpr size_t kInlineWords = 64;
+
+  // Cleared words for `bits` visited points.
+  constexpr uint64_t *Visited(size_t bits) {
+    size_t words = (bits + 63) / 64;
+    uint64_t *visited = words_.data();
+    if (words > words_.size()) {
+      if (visited_.size() < words) visited_.resize(words);
+      visited = visited_.data();
+    }
+    for (size_t i = 0; i < words; ++i) visited[i] = 0;
+    return visited;
+  }
+
+  bool ok_ = false;
+  bool overflowed_ = false;
+  std::string_view s_;
+  std::array<std::string_view, Re::kGroupNum> groups_{};
+  // the visited points, in `words_` unless they need more
+  std::array<uint64_t, kInlineWords> words_{};
+  std::vector<uint64_t> visited_;
+};
+
+template <FixedString P>
+class Static {
+ public:
+  static constexpr ct::Ast<sizeof(P.data)> kAst =
+      ct::Parser<sizeof(P.data)>(P).Parse();
+  static constexpr size_t kGroupNum = kAst.group_num;
+  static constexpr ct::Points<sizeof(P.data)> kPoints{kAst};
+
+  using Matcher = StaticMatcher<Static>;
+
+  // Leftmost-first match as `Graph::Match` finds it, marking the visited
+  // points in `matcher`, which keeps its buffer for the next search.
+  static constexpr void Match(std::string_view s, Matcher *matcher) {
+    ct::Context<kGroupNum> ctx{s, {}};
+    matcher->s_ = s;
+    matcher->ok_ = false;
+    // a point failed from one start fails from any later one
+    if (kPoints.Fits(s.size())) {
+      ctx.visited = matcher->Visited(kPoints.num * (s.size() + 1));
+      ctx.memo = true;
+    }
+    for (size_t start = 0;
+         start <= s.size() && !matcher->ok_ && !ctx.overflowed; ++start) {
+      ctx.slots.fill(ct::Context<kGroupNum>::kUnset);
+      ctx.slots[0] = start;
+      auto accept = [&](size_t end) {
+        ctx.slots[1] = end;
+        return true;
+      };
+      // a path tried after giving up on a preferred one may not be the
+      // leftmost-first match
+      matcher->ok_ =
+          ct::Run<Static, kAst.root>(ctx, start, 0, accept) && !ctx.overflowed;
+      // a match may only begin at the start of the text
+      if constexpr (ct::Anchored(kAst, kAst.root)) break;
+    }
+    matcher->overflowed_ = ctx.overflowed;
+    matcher->groups_ = {};
+    if (!matcher->ok_) return;
+    for (size_t i = 0; i < kGroupNum; ++i) {
+      size_t first = ctx.slots[i * 2], last = ctx.slots[i * 2 + 1];
+      if (first == ct::Context<kGroupNum>::kUnset ||
+          last == ct::Context<kGroupNum>::kUnset || last < first) {
+        continue;
+      }
+      matcher->groups_[i] = s.substr(first, last - first);
+    }
+  }
+  static constexpr Matcher Match(std::string_view s) {
+    Matcher matcher;
+    Match(s, &matcher);
+    return matcher;
+  }
+  static constexpr bool Test(std::string_view s) { return Match(s).ok(); }
+
+  // Index of the group named `name`, or `kGroupNum` if there is none.
+  static constexpr size_t Group(std::string_view name) {
+    std::string_view pattern(P.data, P.size());
+    for (size_t i = 0; i < kAst.name_num; ++i) {
+      if (pattern.substr(kAst.name_begin[i], kAst.name_len[i]) == name) {
+        return kAst.name_group[i];
+      }
+    }
+    return kGroupNum;
+  }
+};
+
+}  // namespace regex
+
+#endif  // REGEX_STATIC_H_
@@ -2,16 +2,21 @@
 // Copyright [2020] <inhzus>
 //
 // Usage: ... | rep [OPTIONS] PATTERNS
-// Search PATTERNS from STDIN.
+// Search PATTERNS from STDIN, more of them may be given with -e.
 // Example: cat ~/.vimrc | rep \"^set\"
 //
 
 #include <unistd.h>
 
+#include <algorithm>
 #include <iostream>
 #include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
 
 #include "regex/graph.h"
+#include "regex/regex_set.h"
 
 template <typename T>
 class FixedQueue {
@@ -45,6 +50,7 @@ inline void help_msg() {
   printf(
       "Usage: ... | rep [OPTIONS] PATTERNS\n"
       "Search PATTERNS from STDIN.\n"
+      "  -e PATTERN  also search PATTERN, may be repeated\n"
       "Example: cat ~/.vimrc | rep \"^set\"\n");
 }
 
@@ -56,12 +62,30 @@ inline void error_if(bool condition, const char *msg) {
   }
 }
 
+// Append the [begin, end) offsets of the non-empty matches of `graph` in
+// `line` to `spans`.
+inline void find_spans(const regex::Graph &graph, std::string_view line,
+                       regex::Matcher *matcher, regex::MatchScratch *scratch,
+                       std::vector<std::pair<size_t, size_t>> *spans) {
+  size_t base = 0;
+  while (base <= line.size()) {
+    std::string_view rest = line.substr(base);
+    graph.Match(rest, matcher, scratch);
+    if (!matcher->ok()) return;
+    if (matcher->Size() != 0) {
+      spans->emplace_back(base + matcher->BeginIdx(), base + matcher->EndIdx());
+    }
+    // step over an empty match, otherwise it would be found again
+    base += matcher->Size() == 0 ? matcher->EndIdx() + 1 : matcher->EndIdx();
+  }
+}
+
 int main(int argc, char **argv) {
   int opt;
   int kAfter = 0;
   int kBefore = 0;
-  std::string exp;
-  while ((opt = getopt(argc, argv, "-A:B:h")) != -1) {
+  std::vector<std::string> exps;
+  while ((opt = getopt(argc, argv, "-A:B:e:h")) != -1) {
     switch (opt) {
       case 'A': {
         kAfter = atoi(optarg);
@@ -81,19 +105,47 @@ int main(int argc, char **argv) {
         return 1;
       }
       default: {
-        exp = std::string(optarg);
+        // -e or a positional pattern
+        exps.emplace_back(optarg);
         break;
       }
     }
   }
-  error_if(exp.empty(), "PATTERNS arg missing");
+  error_if(exps.empty(), "PATTERNS arg missing");
   int after = 0;
   FixedQueue<std::string> queue(kBefore);
-  auto pattern = regex::Graph::Compile(exp);
+  // every line is scanned once for all the patterns
+  auto patterns = regex::RegexSet::Compile({exps.begin(), exps.end()});
+  // buffers kept from one line to the next
+  std::vector<size_t> matches;
+  std::vector<uint32_t> pcs;
+  std::vector<regex::MatchScratch> scratches(patterns.size());
+  regex::Matcher matcher;
+  std::vector<std::pair<size_t, size_t>> spans;
+  std::string s;
   std::string line;
   while (getline(std::cin, line)) {
-    std::string s = pattern.Sub("\033[31m\\0\033[0m", line);
-    if (s != line) {
+    patterns.Matches(line, &matches, &pcs);
+    if (!matches.empty()) {
+      // highlight the occurrences of every pattern that matched, merging
+      // those that overlap
+      spans.clear();
+      for (size_t idx : matches) {
+        find_spans(patterns[idx], line, &matcher, &scratches[idx], &spans);
+      }
+      std::sort(spans.begin(), spans.end());
+      s.clear();
+      size_t pos = 0;
+      for (size_t i = 0; i < spans.size();) {
+        size_t begin = spans[i].first, end = spans[i].second;
+        for (++i; i < spans.size() && spans[i].first <= end; ++i) {
+          end = std::max(end, spans[i].second);
+        }
+        s.append(line, pos, begin - pos);
+        s.append("\033[31m").append(line, begin, end - begin).append("\033[0m");
+        pos = end;
+      }
+      s.append(line, pos);
       while (!queue.Empty()) {
         std::string t = queue.Pop();
         printf("%s\n", t.c_str());
@@ -101,7 +153,7 @@ int main(int argc, char **argv) {
       printf("%s\n", s.c_str());
       after = kAfter;
     } else if (after > 0) {
-      printf("%s\n", s.c_str());
+      printf("%s\n", line.c_str());
       --after;
     } else {
       queue.Push(std::move(line));
@@ -0,0 +1,179 @@
+//
+// Copyright [2020] <inhzus>
+//
+
+#include "regex/aho_corasick.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace regex {
+
+// The literals of `exp` in the order the backtracker tries them, returns
+// false if it is not an alternation of literals.
+static bool Alternatives(const Exp &exp, size_t max,
+                         std::vector<std::string> *literals) {
+  std::vector<std::vector<std::string>> stack;
+  bool wrapped = false;  // groups may only enclose the whole pattern
+  for (const auto &id : exp.ids) {
+    switch (static_cast<int>(id.sym)) {
+      case Id::Sym::Char: {
+        if (wrapped) return false;
+        stack.push_back({std::string(1, id.ch)});
+        break;
+      }
+      case Id::Sym::Concat: {
+        // alternatives of the front come first, each followed by those of
+        // the back in order
+        if (wrapped || stack.size() < 2) return false;
+        std::vector<std::string> back(std::move(stack.back()));
+        stack.pop_back();
+        std::vector<std::string> &front = stack.back();
+        if (front.size() * back.size() > max) return false;
+        std::vector<std::string> lits;
+        lits.reserve(front.size() * back.size());
+        for (const auto &lit : front) {
+          for (const auto &next : back) lits.push_back(lit + next);
+        }
+        front = std::move(lits);
+        break;
+      }
+      case Id::Sym::Either: {
+        if (wrapped || stack.size() < 2) return false;
+        std::vector<std::string> right(std::move(stack.back()));
+        stack.pop_back();
+        std::vector<std::string> &left = stack.back();
+        if (left.size() + right.size() > max) return false;
+        left.insert(left.end(), std::make_move_iterator(right.begin()),
+                    std::make_move_iterator(right.end()));
+        break;
+      }
+      case Id::Sym::NamedPr:
+      case Id::Sym::Paren: {
+        if (stack.size() != 1) return false;
+        wrapped = true;
+        break;
+      }
+      case Id::Sym::UnParen: {
+        break;
+      }
+      default: {
+        return false;
+      }
+    }
+  }
+  if (stack.size() != 1) return false;
+  *literals = std::move(stack.back());
+  return true;
+}
+
+bool AhoCorasick::Build(const Exp &exp) {
+  std::vector<std::string> literals;
+  if (!Alternatives(exp, kMaxLiterals, &literals) ||
+      literals.size() < kMinLiterals) {
+    return false;
+  }
+  literal_num_ = literals.size();
+
+  std::fill(classes_, classes_ + 256, 0);
+  stride_ = 1;
+  for (const auto &lit : literals) {
+    for (char ch : lit) {
+      uint16_t &cls = classes_[static_cast<uint8_t>(ch)];
+      if (cls == 0) cls = stride_++;
+    }
+  }
+
+  // trie, the root is state 0
+  trans_.assign(stride_, kNone);
+  depth_.assign(1, 0);
+  match_len_.assign(1, 0);
+  match_idx_.assign(1, 0);
+  for (size_t idx = 0; idx < literals.size(); ++idx) {
+    uint32_t state = 0;
+    for (char ch : literals[idx]) {
+      size_t cell = state * stride_ + classes_[static_cast<uint8_t>(ch)];
+      if (trans_[cell] == kNone) {
+        trans_[cell] = depth_.size();
+        trans_.resize(trans_.size() + stride_, kNone);
+        depth_.push_back(depth_[state] + 1);
+        match_len_.push_back(0);
+        match_idx_.push_back(0);
+      }
+      state = trans_[cell];
+    }
+    // a repeated literal never beats its first occurrence
+    if (match_len_[state] == 0) {
+      match_len_[state] = depth_[state];
+      match_idx_[state] = idx;
+    }
+  }
+
+  // complete the missing transitions breadth first through the failure
+  // links, and let every state report the longest literal it ends with
+  std::vector<uint32_t> fail(depth_.size(), 0);
+  std::vector<uint32_t> queue;
+  for (size_t cls = 0; cls < stride_; ++cls) {
+    uint32_t &next = trans_[cls];
+    if (next == kNone) {
+      next = 0;
+    } else {
+      queue.push_back(next);
+    }
+  }
+  for (size_t head = 0; head < queue.size(); ++head) {
+    uint32_t state = queue[head];
+    uint32_t link = fail[state];
+    if (match_len_[state] == 0) {
+      match_len_[state] = match_len_[link];
+      match_idx_[state] = match_idx_[link];
+    }
+    for (size_t cls = 0; cls < stride_; ++cls) {
+      uint32_t &next = trans_[state * stride_ + cls];
+      if (next == kNone) {
+        next = trans_[link * stride_ + cls];
+      } else {
+        fail[next] = trans_[link * stride_ + cls];
+        queue.push_back(next);
+      }
+    }
+  }
+  return true;
+}
+
+bool AhoCorasick::Test(std::string_view s) const {
+  uint32_t state = 0;
+  for (char ch : s) {
+    state = Next(state, ch);
+    if (match_len_[state] != 0) return true;
+  }
+  return false;
+}
+
+bool AhoCorasick::Search(std::string_view s, size_t *begin,
+                         size_t *end) const {
+  // the first literal found may be beaten by a longer one starting earlier,
+  // or at the same offset but earlier in the alternation, so the scan goes
+  // on while the current state could still extend into such a literal
+  size_t best = std::string_view::npos;
+  uint32_t best_idx = 0;
+  uint32_t state = 0;
+  for (size_t pos = 0; pos < s.size(); ++pos) {
+    state = Next(state, s[pos]);
+    if (match_len_[state] != 0) {
+      size_t start = pos + 1 - match_len_[state];
+      if (start < best || (start == best && match_idx_[state] < best_idx)) {
+        best = start;
+        best_idx = match_idx_[state];
+        *begin = start;
+        *end = pos + 1;
+      }
+    }
+    if (best != std::string_view::npos && pos + 1 - depth_[state] > best) {
+      break;
+    }
+  }
+  return best != std::string_view::npos;
+}
+
+}  // namespace regex
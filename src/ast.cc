@@ -0,0 +1,484 @@
+//
+// Copyright [2020] <inhzus>
+//
+
+#include "regex/ast.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <limits>
+#include <utility>
+
+#include "regex/byte_set.h"
+
+namespace regex {
+
+namespace {
+
+using Node = Ast::Node;
+using NodePtr = std::unique_ptr<Node>;
+
+NodePtr NewNode(Id &&id) { return std::make_unique<Node>(std::move(id)); }
+
+bool SameSym(const Id &a, const Id &b) {
+  return static_cast<int>(a.sym) == static_cast<int>(b.sym);
+}
+
+// operands the symbol takes from the postfix stack
+size_t Arity(const Id &id) {
+  switch (static_cast<int>(id.sym)) {
+    case Id::Sym::Any:
+    case Id::Sym::Begin:
+    case Id::Sym::Char:
+    case Id::Sym::End:
+    case Id::Sym::RefPr:
+    case Id::Sym::Set:
+    case Id::Sym::SetEx:
+      return 0;
+    case Id::Sym::Concat:
+    case Id::Sym::Either:
+      return 2;
+    default:
+      return 1;
+  }
+}
+
+bool IsList(const Id &id) {
+  return id.sym == Id::Sym::Concat || id.sym == Id::Sym::Either;
+}
+
+// Append `child` to the concatenation or alternation `node`, splicing in the
+// operands of a child of the same kind.
+void Adopt(Node *node, NodePtr child) {
+  if (!SameSym(node->id, child->id)) {
+    node->children.push_back(std::move(child));
+    return;
+  }
+  for (auto &grandchild : child->children) {
+    node->children.push_back(std::move(grandchild));
+  }
+}
+
+NodePtr List(Id::Sym::_Inner sym, NodePtr lhs, NodePtr rhs) {
+  NodePtr node = NewNode(Id(sym));
+  Adopt(node.get(), std::move(lhs));
+  Adopt(node.get(), std::move(rhs));
+  return node;
+}
+
+NodePtr Quantify(Id::Sym::_Inner sym, NodePtr operand) {
+  NodePtr node = NewNode(Id(sym));
+  node->children.push_back(std::move(operand));
+  return node;
+}
+
+NodePtr Clone(const Node &node) {
+  NodePtr clone = NewNode(Id(node.id));
+  for (const auto &child : node.children) {
+    clone->children.push_back(Clone(*child));
+  }
+  return clone;
+}
+
+bool IsByte(const Node &node) {
+  return node.id.sym == Id::Sym::Any || node.id.sym == Id::Sym::Char ||
+         node.id.sym == Id::Sym::Set || node.id.sym == Id::Sym::SetEx;
+}
+
+// Whether `node` matches in at most one way at any position, so that
+// retrying it never reaches a state the first try did not.
+bool Deterministic(const Node &node) {
+  if (IsByte(node)) return true;
+  if (node.id.sym != Id::Sym::Concat) return false;
+  for (const auto &child : node.children) {
+    if (!IsByte(*child)) return false;
+  }
+  return true;
+}
+
+bool Equal(const Node &a, const Node &b) {
+  if (!SameSym(a.id, b.id) || a.children.size() != b.children.size()) {
+    return false;
+  }
+  switch (static_cast<int>(a.id.sym)) {
+    case Id::Sym::Char:
+      if (a.id.ch != b.id.ch) return false;
+      break;
+    case Id::Sym::NamedPr:
+    case Id::Sym::Paren:
+    case Id::Sym::RefPr:
+      if (a.id.store.idx != b.id.store.idx) return false;
+      break;
+    case Id::Sym::Repeat:
+    case Id::Sym::PosRepeat:
+    case Id::Sym::RelRepeat:
+      if (a.id.repeat->lower != b.id.repeat->lower ||
+          a.id.repeat->upper != b.id.repeat->upper) {
+        return false;
+      }
+      break;
+    case Id::Sym::Set:
+    case Id::Sym::SetEx:
+      if (std::memcmp(ByteSet(a.id.set->val).bits(),
+                      ByteSet(b.id.set->val).bits(), 32) != 0) {
+        return false;
+      }
+      break;
+    default:
+      break;
+  }
+  for (size_t i = 0; i < a.children.size(); ++i) {
+    if (!Equal(*a.children[i], *b.children[i])) return false;
+  }
+  return true;
+}
+
+size_t Size(const Node &node) {
+  size_t size = 1;
+  for (const auto &child : node.children) size += Size(*child);
+  return size;
+}
+
+// Whether `id` is a greedy "*", "+" or "?", with whether it requires an
+// iteration and whether it has no upper bound.
+bool Greedy(const Id &id, bool *min, bool *unbounded) {
+  switch (static_cast<int>(id.sym)) {
+    case Id::Sym::More:
+      *min = false, *unbounded = true;
+      return true;
+    case Id::Sym::Plus:
+      *min = true, *unbounded = true;
+      return true;
+    case Id::Sym::Quest:
+      *min = false, *unbounded = false;
+      return true;
+    default:
+      return false;
+  }
+}
+
+Id::Sym::_Inner GreedyOf(bool min, bool unbounded) {
+  if (!unbounded) return Id::Sym::Quest;
+  return min ? Id::Sym::Plus : Id::Sym::More;
+}
+
+// the characters `node` begins with
+size_t LeadingChars(const Node &node) {
+  if (node.id.sym == Id::Sym::Char) return 1;
+  if (node.id.sym != Id::Sym::Concat) return 0;
+  size_t len = 0;
+  while (len < node.children.size() &&
+         node.children[len]->id.sym == Id::Sym::Char) {
+    ++len;
+  }
+  return len;
+}
+
+char CharAt(const Node &node, size_t idx) {
+  return node.id.sym == Id::Sym::Char ? node.id.ch : node.children[idx]->id.ch;
+}
+
+// `node` without its first `len` characters, null when nothing is left.
+NodePtr Strip(NodePtr node, size_t len) {
+  if (node->id.sym == Id::Sym::Char) return nullptr;
+  auto &children = node->children;
+  children.erase(children.begin(), children.begin() + len);
+  if (children.empty()) return nullptr;
+  if (children.size() == 1) return std::move(children[0]);
+  return node;
+}
+
+// Alternation of `rests[idx..]`, where null stands for the empty string:
+// "x|" is "x?" and "|x" is "x??". Null if only the empty string is left.
+NodePtr Alternate(std::vector<NodePtr> *rests, size_t idx) {
+  NodePtr head = std::move((*rests)[idx]);
+  if (idx + 1 == rests->size()) return head;
+  NodePtr tail = Alternate(rests, idx + 1);
+  if (head == nullptr) {
+    return tail ? Quantify(Id::Sym::RelQuest, std::move(tail)) : nullptr;
+  }
+  if (tail == nullptr) return Quantify(Id::Sym::Quest, std::move(head));
+  return List(Id::Sym::Either, std::move(head), std::move(tail));
+}
+
+class Simplifier {
+ public:
+  explicit Simplifier(const AstPasses &passes) : passes_(passes) {}
+
+  // The rewritten `node`, its operands rewritten first.
+  NodePtr Run(NodePtr node) {
+    auto &children = node->children;
+    if (IsList(node->id)) {
+      std::vector<NodePtr> operands;
+      std::swap(operands, children);
+      for (auto &child : operands) Adopt(node.get(), Run(std::move(child)));
+    } else {
+      for (auto &child : children) child = Run(std::move(child));
+    }
+    switch (static_cast<int>(node->id.sym)) {
+      case Id::Sym::UnParen: {
+        // the postfix form needs no parentheses
+        if (passes_.drop_groups) return std::move(children[0]);
+        break;
+      }
+      case Id::Sym::AtomicPr: {
+        if (passes_.drop_groups && Deterministic(*children[0])) {
+          return std::move(children[0]);
+        }
+        break;
+      }
+      case Id::Sym::Concat: {
+        if (passes_.collapse_quantifiers) CollapseSiblings(node.get());
+        break;
+      }
+      case Id::Sym::Either: {
+        if (passes_.factor_prefixes) FactorPrefixes(node.get());
+        if (passes_.merge_classes) MergeClasses(node.get());
+        break;
+      }
+      case Id::Sym::Repeat:
+      case Id::Sym::PosRepeat:
+      case Id::Sym::RelRepeat: {
+        if (passes_.unroll_repeats) return Unroll(std::move(node));
+        break;
+      }
+      case Id::Sym::More:
+      case Id::Sym::Plus:
+      case Id::Sym::Quest: {
+        if (passes_.collapse_quantifiers) {
+          return CollapseNested(std::move(node));
+        }
+        break;
+      }
+      default:
+        break;
+    }
+    if (IsList(node->id) && children.size() == 1) return std::move(children[0]);
+    return node;
+  }
+
+ private:
+  // "x{2,4}" -> "xx(?:xx?)?", the copies the program unrolls it into, and
+  // "x{2,}" -> "xxx*". Groups in `x` are shared by the copies, the last one
+  // matched sets them as the last iteration would.
+  static NodePtr Unroll(NodePtr node) {
+    const Node &elem = *node->children[0];
+    size_t lower = node->id.repeat->lower, upper = node->id.repeat->upper;
+    bool unbounded = upper == std::numeric_limits<size_t>::max();
+    if (upper == 0 || (unbounded ? lower : upper) > Ast::kMaxUnrolled) {
+      return node;
+    }
+    bool greedy = node->id.sym != Id::Sym::RelRepeat;
+    NodePtr unrolled = NewNode(Id(Id::Sym::Concat));
+    for (size_t i = 0; i < lower; ++i) Adopt(unrolled.get(), Clone(elem));
+    NodePtr rest;
+    if (unbounded) {
+      rest = Quantify(greedy ? Id::Sym::More : Id::Sym::RelMore, Clone(elem));
+    }
+    for (size_t i = lower; !unbounded && i < upper; ++i) {
+      NodePtr copy = Clone(elem);
+      if (rest != nullptr) {
+        copy = List(Id::Sym::Concat, std::move(copy), std::move(rest));
+      }
+      rest = Quantify(greedy ? Id::Sym::Quest : Id::Sym::RelQuest,
+                      std::move(copy));
+    }
+    if (rest != nullptr) Adopt(unrolled.get(), std::move(rest));
+    if (unrolled->children.size() == 1) {
+      unrolled = std::move(unrolled->children[0]);
+    }
+    if (node->id.sym == Id::Sym::PosRepeat) {
+      unrolled = Quantify(Id::Sym::AtomicPr, std::move(unrolled));
+    }
+    return unrolled;
+  }
+
+  // "(?:x*)+" -> "x*": iterating a deterministic loop again only reaches
+  // the ends the inner loop reaches, in the same order.
+  static NodePtr CollapseNested(NodePtr node) {
+    Node &inner = *node->children[0];
+    bool outer_min, outer_unbounded, inner_min, inner_unbounded;
+    if (!Greedy(node->id, &outer_min, &outer_unbounded) ||
+        !Greedy(inner.id, &inner_min, &inner_unbounded) ||
+        !Deterministic(*inner.children[0])) {
+      return node;
+    }
+    inner.id.sym = GreedyOf(outer_min && inner_min,
+                            outer_unbounded || inner_unbounded);
+    return std::move(node->children[0]);
+  }
+
+  // "x*x+" -> "x+" for deterministic `x`, when at most one iteration is
+  // required and one of the loops is unbounded. Lazy and possessive loops
+  // only merge with a loop of their kind: "x*?x*?" -> "x*?".
+  static void CollapseSiblings(Node *node) {
+    auto &children = node->children;
+    for (size_t i = 0; i + 1 < children.size();) {
+      Node &lhs = *children[i], &rhs = *children[i + 1];
+      if (Arity(lhs.id) != 1 || Arity(rhs.id) != 1 ||
+          !Deterministic(*lhs.children[0]) ||
+          !Equal(*lhs.children[0], *rhs.children[0])) {
+        ++i;
+        continue;
+      }
+      bool lhs_min, lhs_unbounded, rhs_min, rhs_unbounded;
+      if (Greedy(lhs.id, &lhs_min, &lhs_unbounded) &&
+          Greedy(rhs.id, &rhs_min, &rhs_unbounded) &&
+          (lhs_unbounded || rhs_unbounded) && !(lhs_min && rhs_min)) {
+        lhs.id.sym = GreedyOf(lhs_min || rhs_min, true);
+      } else if (!((lhs.id.sym == Id::Sym::RelMore &&
+                    rhs.id.sym == Id::Sym::RelMore) ||
+                   (lhs.id.sym == Id::Sym::PosMore &&
+                    rhs.id.sym == Id::Sym::PosMore))) {
+        ++i;
+        continue;
+      }
+      children.erase(children.begin() + i + 1);
+    }
+  }
+
+  // "abc|abd|e" -> "ab(?:c|d)|e". Only adjacent alternatives are factored,
+  // so that every alternative is still tried in its order.
+  void FactorPrefixes(Node *node) {
+    auto &children = node->children;
+    for (size_t i = 0; i < children.size(); ++i) {
+      size_t len = LeadingChars(*children[i]);
+      if (len == 0) continue;
+      char first = CharAt(*children[i], 0);
+      size_t j = i + 1;
+      for (; j < children.size(); ++j) {
+        size_t other = LeadingChars(*children[j]);
+        if (other == 0 || CharAt(*children[j], 0) != first) break;
+        size_t common = 1;
+        while (common < std::min(len, other) &&
+               CharAt(*children[i], common) == CharAt(*children[j], common)) {
+          ++common;
+        }
+        len = common;
+      }
+      if (j - i < 2) continue;
+      NodePtr factored = NewNode(Id(Id::Sym::Concat));
+      for (size_t k = 0; k < len; ++k) {
+        factored->children.push_back(NewNode(Id(CharAt(*children[i], k))));
+      }
+      std::vector<NodePtr> rests;
+      for (size_t k = i; k < j; ++k) {
+        rests.push_back(Strip(std::move(children[k]), len));
+      }
+      if (NodePtr rest = Alternate(&rests, 0)) {
+        Adopt(factored.get(), Run(std::move(rest)));
+      }
+      if (factored->children.size() == 1) {
+        factored = std::move(factored->children[0]);
+      }
+      children[i] = std::move(factored);
+      children.erase(children.begin() + i + 1, children.begin() + j);
+    }
+  }
+
+  // "a|[bc]|d" -> "[a-d]": alternatives of one byte and no groups leave the
+  // same state whichever of them matches, so their order does not matter.
+  // `SetEx` and `Any` are left alone.
+  static void MergeClasses(Node *node) {
+    auto &children = node->children;
+    auto is_class = [](const Node &child) {
+      return child.id.sym == Id::Sym::Char || child.id.sym == Id::Sym::Set;
+    };
+    for (size_t i = 0; i < children.size(); ++i) {
+      size_t j = i;
+      while (j < children.size() && is_class(*children[j])) ++j;
+      if (j - i < 2) continue;
+      NodePtr merged = NewNode(Id::SetId());
+      CharSet &set = merged->id.set->val;
+      for (size_t k = i; k < j; ++k) {
+        const Id &id = children[k]->id;
+        if (id.sym == Id::Sym::Char) {
+          set.pos.Insert(id.ch);
+          continue;
+        }
+        for (const auto &range : id.set->val.pos.ranges) {
+          set.pos.Insert(range.val, range.last);
+        }
+        for (const auto &group : id.set->val.negs) set.negs.push_back(group);
+      }
+      set.Fold();
+      children[i] = std::move(merged);
+      children.erase(children.begin() + i + 1, children.begin() + j);
+    }
+  }
+
+  const AstPasses &passes_;
+};
+
+void Lower(NodePtr node, std::vector<Id> *ids) {
+  auto &children = node->children;
+  if (node->id.sym == Id::Sym::Concat) {
+    // right-associative, as parsed
+    for (auto &child : children) Lower(std::move(child), ids);
+    for (size_t i = 2; i < children.size(); ++i) {
+      ids->emplace_back(Id::Sym::Concat);
+    }
+  } else if (node->id.sym == Id::Sym::Either) {
+    // left-associative, as parsed
+    Lower(std::move(children[0]), ids);
+    for (size_t i = 1; i + 1 < children.size(); ++i) {
+      Lower(std::move(children[i]), ids);
+      ids->emplace_back(Id::Sym::Either);
+    }
+    Lower(std::move(children.back()), ids);
+  } else {
+    for (auto &child : children) Lower(std::move(child), ids);
+  }
+  ids->push_back(std::move(node->id));
+}
+
+}  // namespace
+
+Ast Ast::FromExp(Exp &&exp) {
+  Ast ast;
+  ast.group_num_ = exp.group_num;
+  ast.named_group_ = std::move(exp.named_group);
+  std::vector<NodePtr> stack;
+  auto pop = [&stack]() {
+    assert(!stack.empty());
+    NodePtr node = std::move(stack.back());
+    stack.pop_back();
+    return node;
+  };
+  for (auto &id : exp.ids) {
+    size_t arity = Arity(id);
+    NodePtr node = NewNode(std::move(id));
+    if (arity == 2) {
+      NodePtr rhs = pop();
+      NodePtr lhs = pop();
+      Adopt(node.get(), std::move(lhs));
+      Adopt(node.get(), std::move(rhs));
+    } else if (arity == 1) {
+      node->children.push_back(pop());
+    }
+    stack.push_back(std::move(node));
+  }
+  assert(stack.size() <= 1);
+  if (!stack.empty()) ast.root_ = pop();
+  return ast;
+}
+
+void Ast::Simplify(const AstPasses &passes) {
+  if (root_ != nullptr) root_ = Simplifier(passes).Run(std::move(root_));
+}
+
+Exp Ast::ToExp() {
+  std::vector<Id> ids;
+  if (root_ != nullptr) Lower(std::move(root_), &ids);
+  return {group_num_, std::move(ids), std::move(named_group_)};
+}
+
+size_t Ast::size() const { return root_ == nullptr ? 0 : Size(*root_); }
+
+bool Ast::operator==(const Ast &ast) const {
+  if (root_ == nullptr || ast.root_ == nullptr) return root_ == ast.root_;
+  return Equal(*root_, *ast.root_);
+}
+
+}  // namespace regex
@@ -0,0 +1,290 @@
+//
+// Copyright [2020] <inhzus>
+//
+
+#include "regex/backtrack.h"
+
+#include <algorithm>
+
+namespace regex {
+
+Backtracker::Backtracker(const Program &program, size_t visit_budget)
+    : program_(program),
+      visit_budget_(visit_budget),
+      anchor_(Unanchored),
+      memoize_(false) {
+  const auto &insts = program.insts();
+  memo_.assign(insts.size(), true);
+  run_.assign(insts.size(), false);
+  for (uint32_t pc = 0; pc < insts.size(); ++pc) {
+    // split-->set-->jmp split
+    //   |-------------------->
+    const Inst &inst = insts[pc];
+    run_[pc] = inst.op == Inst::Split && inst.split.x == pc + 1 &&
+               inst.split.y == pc + 3 &&
+               (insts[pc + 1].op == Inst::Any ||
+                insts[pc + 1].op == Inst::Set ||
+                insts[pc + 1].op == Inst::SetEx) &&
+               insts[pc + 2].op == Inst::Jmp && insts[pc + 2].jmp.x == pc;
+  }
+  for (uint32_t pc = 0; pc < insts.size(); ++pc) {
+    switch (insts[pc].op) {
+      case Inst::Atomic: {
+        uint32_t end = pc;
+        for (size_t depth = 0;; ++end) {
+          if (insts[end].op == Inst::Atomic) ++depth;
+          if (insts[end].op == Inst::AtomicEnd && --depth == 0) break;
+        }
+        std::fill(memo_.begin() + pc, memo_.begin() + end + 1, false);
+        break;
+      }
+      case Inst::Look:
+      case Inst::NegLook: {
+        std::fill(memo_.begin() + pc + 1, memo_.begin() + insts[pc].look.next,
+                  false);
+        break;
+      }
+      case Inst::Ref: {
+        visit_budget_ = 0;
+        break;
+      }
+      default: {
+        break;
+      }
+    }
+  }
+}
+
+bool Backtracker::Search(std::string_view s, size_t begin,
+                         std::vector<size_t> *slots, Anchor anchor) {
+  s_ = s;
+  anchor_ = anchor;
+  // anchored searches run from offset 0 only
+  size_t last = anchor != Unanchored || program_.anchored() ? 0 : s.size();
+  // failures do not depend on where the search started, so the visited set
+  // is shared by every start
+  size_t bits = program_.insts().size() * (s.size() + 1);
+  memoize_ = bits <= visit_budget_;
+  if (memoize_) visited_.assign((bits + 63) / 64, 0);
+  for (size_t start = last != 0 ? begin : 0; start <= last; ++start) {
+    if (last != 0 && (start = program_.FindStart(s, start)) == Prefix::npos) {
+      break;
+    }
+    stack_.clear();
+    slots_.assign(program_.slot_num(), Program::kUnset);
+    if (Run(0, start)) {
+      slots->assign(slots_.begin(),
+                    slots_.begin() + program_.group_num() * 2);
+      return true;
+    }
+  }
+  return false;
+}
+
+void Backtracker::Cut(size_t base) {
+  auto it = std::remove_if(
+      stack_.begin() + base, stack_.end(),
+      [](const Frame &frame) { return frame.kind != Frame::Restore; });
+  stack_.erase(it, stack_.end());
+}
+
+void Backtracker::Unwind(size_t base) {
+  while (stack_.size() > base) {
+    const Frame &frame = stack_.back();
+    if (frame.kind == Frame::Restore) slots_[frame.pc] = frame.pos;
+    stack_.pop_back();
+  }
+}
+
+bool Backtracker::Run(uint32_t pc, size_t pos) {
+  const auto &insts = program_.insts();
+  const auto &sets = program_.sets();
+  size_t base = stack_.size();
+  while (true) {
+    // execute the instruction at `pc`, on failure pop the latest choice
+    // point above `base` and resume from it
+    bool backtrack = false;
+    const Inst &inst = insts[pc];
+    switch (inst.op) {
+      case Inst::Any: {
+        if (pos == s_.size()) {
+          backtrack = true;
+          break;
+        }
+        ++pos;
+        ++pc;
+        break;
+      }
+      case Inst::Atomic: {
+        stack_.push_back({Frame::Barrier, pc, pos});
+        ++pc;
+        break;
+      }
+      case Inst::AtomicEnd: {
+        size_t barrier = stack_.size();
+        while (stack_[--barrier].kind != Frame::Barrier) {
+        }
+        Cut(barrier);
+        ++pc;
+        break;
+      }
+      case Inst::Begin: {
+        if (pos != 0) {
+          backtrack = true;
+          break;
+        }
+        ++pc;
+        break;
+      }
+      case Inst::Char: {
+        if (pos == s_.size() || s_[pos] != inst.ch.val) {
+          backtrack = true;
+          break;
+        }
+        ++pos;
+        ++pc;
+        break;
+      }
+      case Inst::End: {
+        if (pos != s_.size()) {
+          backtrack = true;
+          break;
+        }
+        ++pc;
+        break;
+      }
+      case Inst::Jmp: {
+        pc = inst.jmp.x;
+        break;
+      }
+      case Inst::Look:
+      case Inst::NegLook: {
+        // the body runs as a nested search sharing the stack above `top`
+        size_t top = stack_.size();
+        bool matched = Run(pc + 1, pos);
+        if (inst.op == Inst::Look) {
+          if (matched) Cut(top);  // keep the groups captured by the body
+          backtrack = !matched;
+        } else {
+          if (matched) Unwind(top);
+          backtrack = matched;
+        }
+        pc = inst.look.next;
+        break;
+      }
+      case Inst::Mark: {
+        SetSlot(inst.mark.slot, pos);
+        ++pc;
+        break;
+      }
+      case Inst::Match: {
+        // the last instruction is the one ending the whole match, the others
+        // end look-ahead bodies
+        if (anchor_ == AnchorBoth && pc + 1 == insts.size() &&
+            pos != s_.size()) {
+          backtrack = true;
+          break;
+        }
+        return true;
+      }
+      case Inst::Progress: {
+        // a memoized empty iteration is cut off at the loop head instead
+        if (!(memoize_ && memo_[pc]) && slots_[inst.mark.slot] == pos) {
+          backtrack = true;
+          break;
+        }
+        ++pc;
+        break;
+      }
+      case Inst::Ref: {
+        // a group that did not participate matches the empty string
+        size_t first = slots_[inst.ref.idx * 2];
+        size_t last = slots_[inst.ref.idx * 2 + 1];
+        size_t len =
+            first == Program::kUnset || last == Program::kUnset || last < first
+                ? 0
+                : last - first;
+        if (s_.size() - pos < len || s_.compare(pos, len, s_, first, len)) {
+          backtrack = true;
+          break;
+        }
+        pos += len;
+        ++pc;
+        break;
+      }
+      case Inst::Save: {
+        SetSlot(inst.save.slot, pos);
+        ++pc;
+        break;
+      }
+      case Inst::Set:
+      case Inst::SetEx: {
+        if (pos == s_.size() || sets[inst.set.idx].Contains(s_[pos]) !=
+                                    (inst.op == Inst::Set)) {
+          backtrack = true;
+          break;
+        }
+        ++pos;
+        ++pc;
+        break;
+      }
+      case Inst::Split: {
+        if (run_[pc]) {
+          // push the choice points of every iteration the class allows, as
+          // running the loop would, then leave it at the end of the run
+          const Inst &step = insts[pc + 1];
+          size_t end = step.op == Inst::Any
+                           ? s_.size()
+                           : sets[step.set.idx].Find(s_, pos,
+                                                     step.op == Inst::SetEx);
+          if (end == ByteSet::npos) end = s_.size();
+          bool possessive = program_.possessive(pc);
+          for (; pos < end; ++pos) {
+            if (memoize_ && memo_[pc] && !Visit(pc, pos)) break;
+            if (!possessive) {
+              stack_.push_back({Frame::Choice, inst.split.y, pos});
+            }
+          }
+          if (pos < end || (memoize_ && memo_[pc] && !Visit(pc, pos))) {
+            backtrack = true;
+            break;
+          }
+          pc = inst.split.y;
+          break;
+        }
+        // every loop and alternation passes through a split, so pruning
+        // them bounds the whole search
+        if (memoize_ && memo_[pc] && !Visit(pc, pos)) {
+          backtrack = true;
+          break;
+        }
+        if (program_.possessive(pc)) {
+          // the next byte alone tells which branch may match
+          pc = pos < s_.size() && program_.Accepts(inst.split.x, s_[pos])
+                   ? inst.split.x
+                   : inst.split.y;
+          break;
+        }
+        stack_.push_back({Frame::Choice, inst.split.y, pos});
+        pc = inst.split.x;
+        break;
+      }
+    }
+    if (backtrack) {
+      while (true) {
+        if (stack_.size() == base) return false;
+        Frame frame = stack_.back();
+        stack_.pop_back();
+        if (frame.kind == Frame::Restore) {
+          slots_[frame.pc] = frame.pos;
+        } else if (frame.kind == Frame::Choice) {
+          pc = frame.pc;
+          pos = frame.pos;
+          break;
+        }
+      }
+    }
+  }
+}
+
+}  // namespace regex
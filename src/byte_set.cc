@@ -0,0 +1,125 @@
+//
+// Copyright [2020] <inhzus>
+//
+
+#include "regex/byte_set.h"
+
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define REGEX_BYTE_SET_SIMD 1
+#endif
+
+namespace regex {
+
+ByteSet::ByteSet(const CharSet &set) : ByteSet() {
+  for (int byte = 0; byte < 256; ++byte) {
+    if (set.Contains(static_cast<char>(byte))) Insert(byte);
+  }
+}
+
+ByteSet ByteSet::All() { return ~ByteSet(); }
+
+ByteSet &ByteSet::operator|=(const ByteSet &set) {
+  for (int i = 0; i < 4; ++i) bits_[i] |= set.bits_[i];
+  for (int i = 0; i < 16; ++i) {
+    low_[i] |= set.low_[i];
+    high_[i] |= set.high_[i];
+  }
+  return *this;
+}
+
+ByteSet ByteSet::operator~() const {
+  ByteSet set;
+  for (int i = 0; i < 4; ++i) set.bits_[i] = ~bits_[i];
+  for (int i = 0; i < 16; ++i) {
+    set.low_[i] = ~low_[i];
+    set.high_[i] = ~high_[i];
+  }
+  return set;
+}
+
+size_t ByteSet::Count() const {
+  size_t count = 0;
+  for (uint64_t word : bits_) count += __builtin_popcountll(word);
+  return count;
+}
+
+#ifdef REGEX_BYTE_SET_SIMD
+__attribute__((target("ssse3"))) bool ByteSet::Scan(std::string_view s,
+                                                    size_t *pos,
+                                                    bool in) const {
+  const __m128i nibble = _mm_set1_epi8(0x0f);
+  const __m128i seven = _mm_set1_epi8(7);
+  const __m128i low = _mm_load_si128(reinterpret_cast<const __m128i *>(low_));
+  const __m128i high =
+      _mm_load_si128(reinterpret_cast<const __m128i *>(high_));
+  // the bit of a row a high nibble selects
+  const __m128i bit = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8,
+                                    16, 32, 64, -128);
+  size_t p = *pos;
+  for (; p + 16 <= s.size(); p += 16) {
+    __m128i chunk =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(s.data() + p));
+    __m128i lo = _mm_and_si128(chunk, nibble);
+    __m128i hi = _mm_and_si128(_mm_srli_epi16(chunk, 4), nibble);
+    __m128i upper = _mm_cmpgt_epi8(hi, seven);
+    __m128i row = _mm_or_si128(
+        _mm_andnot_si128(upper, _mm_shuffle_epi8(low, lo)),
+        _mm_and_si128(upper, _mm_shuffle_epi8(high, lo)));
+    __m128i mask = _mm_shuffle_epi8(bit, hi);
+    int found =
+        _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(row, mask), mask));
+    if (!in) found = ~found & 0xffff;
+    if (found != 0) {
+      *pos = p + __builtin_ctz(found);
+      return true;
+    }
+  }
+  *pos = p;
+  return false;
+}
+#else
+bool ByteSet::Scan(std::string_view, size_t *, bool) const { return false; }
+#endif
+
+size_t ByteSet::Find(std::string_view s, size_t pos, bool in) const {
+#ifdef REGEX_BYTE_SET_SIMD
+  static const bool kSsse3 = __builtin_cpu_supports("ssse3");
+  if (kSsse3 && Scan(s, &pos, in)) return pos;
+#endif
+  for (; pos < s.size(); ++pos) {
+    if (Contains(s[pos]) == in) return pos;
+  }
+  return npos;
+}
+
+ByteClasses ByteClasses::Singletons() {
+  ByteClasses classes;
+  for (int byte = 0; byte < 256; ++byte) classes.map_[byte] = byte;
+  classes.num_ = 256;
+  return classes;
+}
+
+void ByteClasses::Split(const ByteSet &set) {
+  // class of the bytes of old class `c` which are (not) in `set`
+  uint16_t rename[2][256];
+  std::fill(&rename[0][0], &rename[0][0] + 2 * 256, UINT16_MAX);
+  uint16_t num = 0;
+  for (int byte = 0; byte < 256; ++byte) {
+    uint16_t &cls = rename[set.Contains(static_cast<char>(byte))][map_[byte]];
+    if (cls == UINT16_MAX) cls = num++;
+    map_[byte] = cls;
+  }
+  num_ = num;
+}
+
+std::vector<uint8_t> ByteClasses::Representatives() const {
+  std::vector<uint8_t> reps(num_);
+  // classes are numbered by their smallest byte, so walking down leaves it
+  for (int byte = 255; byte >= 0; --byte) reps[map_[byte]] = byte;
+  return reps;
+}
+
+}  // namespace regex
@@ -0,0 +1,548 @@
+//
+// Copyright [2020] <inhzus>
+//
+
+#include "regex/dfa.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <utility>
+
+namespace regex {
+
+// The search gives up once the cache has been cleared `kMinClears` times and
+// less than `kMinBytesPerState` bytes were scanned for every state built.
+static constexpr size_t kMinClears = 3, kMinBytesPerState = 10;
+// bookkeeping bytes of a state besides its key and transitions
+static constexpr size_t kStateOverhead = 64;
+// flags heading the key of a state
+static constexpr uint32_t kBeginFlag = 1, kMatchFlag = 2;
+
+LazyDfa::LazyDfa(std::shared_ptr<const Program> program, size_t cache_size,
+                 Kind kind)
+    : program_(std::move(program)),
+      cache_size_(cache_size),
+      cache_used_(0),
+      kind_(kind),
+      match_num_(0),
+      stride_(program_->classes().size() + 1),
+      end_of_text_(program_->classes().size()),
+      reps_(program_->classes().Representatives()),
+      clears_(0),
+      pos_(0),
+      clear_pos_(0),
+      hit_(program_->insts().size(), false),
+      start_{kUnknown, kUnknown},
+      sparse_(program_->insts().size() + 1),
+      dense_(program_->insts().size() + 1),
+      visited_(0),
+      matched_(false) {
+  assert(!program_->backtrack());
+  for (const Inst &inst : program_->insts()) {
+    match_num_ += inst.op == Inst::Match;
+  }
+  ClearCache();
+}
+
+void LazyDfa::ClearCache() {
+  map_.clear();
+  states_.clear();
+  matches_.clear();
+  reported_.clear();
+  trans_.clear();
+  cache_used_ = 0;
+  start_[0] = start_[1] = kUnknown;
+  // the dead state never leaves the cache
+  states_.emplace_back(1, 0);
+  matches_.push_back(false);
+  trans_.resize(stride_, kDead);
+}
+
+void LazyDfa::AddClosure(uint32_t pc, bool at_begin, bool at_end) {
+  const auto &insts = program_->insts();
+  stack_.push_back(pc);
+  while (!stack_.empty()) {
+    pc = stack_.back();
+    stack_.pop_back();
+    bool stop = false;
+    while (!stop) {
+      if (sparse_[pc] < visited_ && dense_[sparse_[pc]] == pc) break;
+      sparse_[pc] = visited_;
+      dense_[visited_++] = pc;
+      const Inst &inst = insts[pc];
+      switch (inst.op) {
+        case Inst::Begin: {
+          stop = !at_begin;
+          ++pc;
+          break;
+        }
+        case Inst::End: {
+          // waits for the end of the text unless already there
+          if (!at_end) {
+            list_.push_back(pc);
+            stop = true;
+          }
+          ++pc;
+          break;
+        }
+        case Inst::Jmp: {
+          pc = inst.jmp.x;
+          break;
+        }
+        case Inst::Mark:
+        case Inst::Progress:
+        case Inst::Save: {
+          ++pc;
+          break;
+        }
+        case Inst::Match: {
+          list_.push_back(pc);
+          matched_ = true;
+          stop = true;
+          if (kind_ != Forward) break;
+          // threads of lower priority can never win
+          stack_.clear();
+          return;
+        }
+        case Inst::Split: {
+          stack_.push_back(inst.split.y);
+          pc = inst.split.x;
+          break;
+        }
+        default: {
+          list_.push_back(pc);
+          stop = true;
+          break;
+        }
+      }
+    }
+  }
+}
+
+uint32_t LazyDfa::Insert(bool at_begin) {
+  if (list_.empty()) return kDead;
+  std::vector<uint32_t> key;
+  key.reserve(list_.size() + 1);
+  key.push_back((at_begin ? kBeginFlag : 0) | (matched_ ? kMatchFlag : 0));
+  key.insert(key.end(), list_.begin(), list_.end());
+  return InsertKey(std::move(key));
+}
+
+uint32_t LazyDfa::InsertKey(std::vector<uint32_t> &&key) {
+  auto it = map_.find(key);
+  if (it != map_.end()) return it->second;
+  size_t cost = key.size() * sizeof(uint32_t) * 2 +
+                stride_ * sizeof(uint32_t) + kStateOverhead;
+  if (cache_used_ + cost > cache_size_) return kUnknown;
+  cache_used_ += cost;
+  auto state = static_cast<uint32_t>(states_.size());
+  states_.push_back(key);
+  matches_.push_back(key[0] & kMatchFlag);
+  trans_.resize(trans_.size() + stride_, kUnknown);
+  map_.emplace(std::move(key), state);
+  return state;
+}
+
+uint32_t LazyDfa::Start(bool at_begin) {
+  if (start_[at_begin] != kUnknown) return start_[at_begin];
+  for (int retry = 0; retry < 2; ++retry) {
+    list_.clear();
+    visited_ = 0;
+    matched_ = false;
+    AddClosure(0, at_begin, false);
+    // an anchored program has nothing to restart, so the automaton dies as
+    // soon as its only match attempt fails
+    if (kind_ == Overlapping ||
+        (kind_ == Forward && !matched_ && !program_->anchored())) {
+      list_.push_back(Restart());
+    }
+    start_[at_begin] = Insert(at_begin);
+    if (start_[at_begin] != kUnknown) return start_[at_begin];
+    ClearCache();
+    ++clears_;
+  }
+  return kUnknown;
+}
+
+uint32_t LazyDfa::Next(uint32_t state, uint32_t cls) {
+  const auto &insts = program_->insts();
+  const auto &sets = program_->sets();
+  std::vector<uint32_t> src(states_[state]);
+  bool at_begin = src[0] & kBeginFlag;
+  list_.clear();
+  visited_ = 0;
+  matched_ = false;
+  for (auto it = src.begin() + 1;
+       it != src.end() && (!matched_ || kind_ != Forward); ++it) {
+    uint32_t pc = *it;
+    if (pc == Restart()) {
+      if (cls == end_of_text_) continue;
+      AddClosure(0, false, false);
+      if (!matched_ || kind_ == Overlapping) list_.push_back(pc);
+      continue;
+    }
+    const Inst &inst = insts[pc];
+    if (cls == end_of_text_) {
+      if (inst.op == Inst::End) AddClosure(pc + 1, at_begin, true);
+      continue;
+    }
+    auto ch = static_cast<char>(reps_[cls]);
+    bool step = false;
+    switch (inst.op) {
+      case Inst::Any: {
+        step = true;
+        break;
+      }
+      case Inst::Char: {
+        step = inst.ch.val == ch;
+        break;
+      }
+      case Inst::Set:
+      case Inst::SetEx: {
+        step = sets[inst.set.idx].Contains(ch) == (inst.op == Inst::Set);
+        break;
+      }
+      default: {
+        break;
+      }
+    }
+    if (step) AddClosure(pc + 1, false, false);
+  }
+  bool next_begin = cls == end_of_text_ && at_begin;
+  uint32_t next = Insert(next_begin);
+  if (next == kUnknown) {
+    // the cache is full: clear it unless the states do not live long enough
+    // to pay for themselves, then rebuild the source state to record the
+    // transition
+    ++clears_;
+    if (clears_ >= kMinClears &&
+        pos_ - clear_pos_ < kMinBytesPerState * states_.size()) {
+      return kUnknown;
+    }
+    ClearCache();
+    clear_pos_ = pos_;
+    state = InsertKey(std::move(src));
+    next = Insert(next_begin);
+    if (state == kUnknown || next == kUnknown) return kUnknown;
+  }
+  trans_[state * stride_ + cls] = next;
+  return next;
+}
+
+LazyDfa::Status LazyDfa::Search(std::string_view s, size_t *end) {
+  clears_ = 0;
+  pos_ = clear_pos_ = 0;
+  const Prefix &prefix = program_->prefix();
+  const ByteClasses &classes = program_->classes();
+  size_t pos = 0;
+  uint32_t state = Start(true);
+  if (!prefix.empty()) {
+    if ((pos = prefix.Find(s, 0)) == Prefix::npos) return NoMatch;
+    if (pos > 0) state = Start(false);
+  }
+  if (state == kUnknown) return GaveUp;
+  bool found = false;
+  for (; pos < s.size(); ++pos) {
+    // only restarts are pending, skip to where the next match may begin
+    if (state == start_[0] && !prefix.empty() &&
+        (pos = prefix.Find(s, pos)) == Prefix::npos) {
+      return found ? Matched : NoMatch;
+    }
+    if (matches_[state]) {
+      found = true;
+      *end = pos;
+    }
+    uint32_t cls = classes[s[pos]];
+    uint32_t next = trans_[state * stride_ + cls];
+    if (next == kUnknown) {
+      pos_ = pos;
+      next = Next(state, cls);
+      if (next == kUnknown) return GaveUp;
+    }
+    if (next == kDead) return found ? Matched : NoMatch;
+    state = next;
+  }
+  if (matches_[state]) {
+    found = true;
+    *end = s.size();
+  }
+  uint32_t next = trans_[state * stride_ + end_of_text_];
+  pos_ = s.size();
+  if (next == kUnknown) next = Next(state, end_of_text_);
+  if (next == kUnknown) return GaveUp;
+  if (matches_[next]) {
+    found = true;
+    *end = s.size();
+  }
+  return found ? Matched : NoMatch;
+}
+
+LazyDfa::Status LazyDfa::SearchReverse(std::string_view s, bool at_end,
+                                       size_t *start) {
+  assert(kind_ == Reverse);
+  const ByteClasses &classes = program_->classes();
+  clears_ = 0;
+  pos_ = clear_pos_ = 0;
+  uint32_t state = Start(at_end);
+  if (state == kUnknown) return GaveUp;
+  bool found = false;
+  for (size_t pos = s.size(); pos > 0; --pos) {
+    if (matches_[state]) {
+      found = true;
+      *start = pos;
+    }
+    uint32_t cls = classes[s[pos - 1]];
+    uint32_t next = trans_[state * stride_ + cls];
+    if (next == kUnknown) {
+      pos_ = s.size() - pos;
+      next = Next(state, cls);
+      if (next == kUnknown) return GaveUp;
+    }
+    if (next == kDead) return found ? Matched : NoMatch;
+    state = next;
+  }
+  if (matches_[state]) {
+    found = true;
+    *start = 0;
+  }
+  uint32_t next = trans_[state * stride_ + end_of_text_];
+  pos_ = s.size();
+  if (next == kUnknown) next = Next(state, end_of_text_);
+  if (next == kUnknown) return GaveUp;
+  if (matches_[next]) {
+    found = true;
+    *start = 0;
+  }
+  return found ? Matched : NoMatch;
+}
+
+LazyDfa::Status LazyDfa::SearchOverlapping(std::string_view s,
+                                           std::vector<uint32_t> *matched,
+                                           bool any) {
+  assert(kind_ == Overlapping);
+  clears_ = 0;
+  pos_ = clear_pos_ = 0;
+  matched->clear();
+  reported_.assign(states_.size(), false);
+  const auto &insts = program_->insts();
+  const ByteClasses &classes = program_->classes();
+  // collect the `Match` instructions of a state the first time it is seen,
+  // returns true once all of them, or with `any` one, were reached
+  auto report = [&](uint32_t state) {
+    if (!matches_[state]) return false;
+    if (reported_.size() <= state) reported_.resize(states_.size(), false);
+    if (reported_[state]) return false;
+    reported_[state] = true;
+    const auto &key = states_[state];
+    for (auto it = key.begin() + 1; it != key.end(); ++it) {
+      if (*it == Restart() || insts[*it].op != Inst::Match || hit_[*it]) {
+        continue;
+      }
+      hit_[*it] = true;
+      matched->push_back(*it);
+    }
+    return matched->size() == match_num_ || (any && !matched->empty());
+  };
+  // only the reported instructions were marked
+  auto finish = [&](Status status) {
+    for (uint32_t pc : *matched) hit_[pc] = false;
+    return status;
+  };
+  uint32_t state = Start(true);
+  if (state == kUnknown) return GaveUp;
+  bool done = false;
+  for (size_t pos = 0; pos < s.size() && !done; ++pos) {
+    done = report(state);
+    uint32_t cls = classes[s[pos]];
+    uint32_t next = trans_[state * stride_ + cls];
+    if (next == kUnknown) {
+      pos_ = pos;
+      next = Next(state, cls);
+      if (next == kUnknown) return finish(GaveUp);
+    }
+    state = next;
+  }
+  if (!done && !report(state)) {
+    uint32_t next = trans_[state * stride_ + end_of_text_];
+    pos_ = s.size();
+    if (next == kUnknown) next = Next(state, end_of_text_);
+    if (next == kUnknown) return finish(GaveUp);
+    report(next);
+  }
+  std::sort(matched->begin(), matched->end());
+  return finish(matched->empty() ? NoMatch : Matched);
+}
+
+bool Dfa::Build(std::shared_ptr<const Program> program, size_t max_states) {
+  if (program->backtrack()) return false;
+  LazyDfa lazy(std::move(program), SIZE_MAX);
+  classes_ = lazy.program_->classes();
+  stride_ = lazy.end_of_text_;
+  // explore every state reachable from the start, numbered in order of
+  // discovery with the dead state first
+  std::vector<uint32_t> order{LazyDfa::kDead, lazy.Start(true)};
+  std::vector<uint32_t> index(order[1] + 1, LazyDfa::kUnknown);
+  index[order[0]] = 0;
+  index[order[1]] = 1;
+  std::vector<uint8_t> flags;
+  for (size_t i = 0; i < order.size(); ++i) {
+    uint32_t state = order[i];
+    for (uint32_t cls = 0; cls < stride_; ++cls) {
+      uint32_t next = lazy.trans_[state * lazy.stride_ + cls];
+      if (next == LazyDfa::kUnknown) next = lazy.Next(state, cls);
+      if (next >= index.size()) index.resize(next + 1, LazyDfa::kUnknown);
+      if (index[next] != LazyDfa::kUnknown) continue;
+      if (order.size() >= max_states) return false;
+      index[next] = order.size();
+      order.push_back(next);
+    }
+    uint32_t end = lazy.trans_[state * lazy.stride_ + lazy.end_of_text_];
+    if (end == LazyDfa::kUnknown) end = lazy.Next(state, lazy.end_of_text_);
+    flags.push_back((lazy.matches_[state] ? MatchFlag : 0) |
+                    (lazy.matches_[end] ? EndMatchFlag : 0));
+  }
+  std::vector<uint32_t> trans(order.size() * stride_);
+  for (size_t i = 0; i < order.size(); ++i) {
+    for (uint32_t cls = 0; cls < stride_; ++cls) {
+      trans[i * stride_ + cls] =
+          index[lazy.trans_[order[i] * lazy.stride_ + cls]];
+    }
+  }
+  std::vector<uint32_t> block(Minimize(trans, flags, 1, 0));
+  // the state waiting for a new match, where the prefix search takes over
+  prefix_ = lazy.program_->prefix();
+  restart_ = LazyDfa::kUnknown;
+  uint32_t restart = lazy.Start(false);
+  if (restart < index.size() && index[restart] != LazyDfa::kUnknown) {
+    restart_ = block[index[restart]];
+  }
+  return true;
+}
+
+std::vector<uint32_t> Dfa::Minimize(const std::vector<uint32_t> &trans,
+                                    const std::vector<uint8_t> &flags,
+                                    uint32_t start, uint32_t dead) {
+  size_t n = flags.size();
+  // predecessors of state `t` on class `cls` are
+  // preds[pred_begin[cls * n + t], pred_begin[cls * n + t + 1])
+  std::vector<uint32_t> pred_begin(stride_ * n + 1, 0), preds(stride_ * n);
+  for (uint32_t p = 0; p < n; ++p) {
+    for (uint32_t cls = 0; cls < stride_; ++cls) {
+      ++pred_begin[cls * n + trans[p * stride_ + cls] + 1];
+    }
+  }
+  for (size_t i = 1; i < pred_begin.size(); ++i) {
+    pred_begin[i] += pred_begin[i - 1];
+  }
+  std::vector<uint32_t> fill(pred_begin.begin(), pred_begin.end() - 1);
+  for (uint32_t p = 0; p < n; ++p) {
+    for (uint32_t cls = 0; cls < stride_; ++cls) {
+      preds[fill[cls * n + trans[p * stride_ + cls]]++] = p;
+    }
+  }
+
+  // the initial partition separates states by what the search observes
+  std::vector<uint32_t> block(n);
+  std::vector<std::vector<uint32_t>> blocks;
+  uint32_t flag_block[4];
+  std::fill(flag_block, flag_block + 4, LazyDfa::kUnknown);
+  for (uint32_t p = 0; p < n; ++p) {
+    if (flag_block[flags[p]] == LazyDfa::kUnknown) {
+      flag_block[flags[p]] = blocks.size();
+      blocks.emplace_back();
+    }
+    block[p] = flag_block[flags[p]];
+    blocks[block[p]].push_back(p);
+  }
+  std::vector<uint32_t> work;
+  std::vector<uint8_t> in_work(blocks.size(), true);
+  for (uint32_t b = 0; b < blocks.size(); ++b) work.push_back(b);
+
+  std::vector<uint32_t> count(blocks.size(), 0), touched, marked_list;
+  std::vector<uint8_t> marked(n, false);
+  while (!work.empty()) {
+    uint32_t splitter_block = work.back();
+    work.pop_back();
+    in_work[splitter_block] = false;
+    std::vector<uint32_t> splitter(blocks[splitter_block]);
+    for (uint32_t cls = 0; cls < stride_; ++cls) {
+      // mark the states entering the splitter on `cls`
+      for (uint32_t t : splitter) {
+        for (uint32_t i = pred_begin[cls * n + t];
+             i < pred_begin[cls * n + t + 1]; ++i) {
+          uint32_t p = preds[i];
+          if (marked[p]) continue;
+          marked[p] = true;
+          marked_list.push_back(p);
+          if (count[block[p]]++ == 0) touched.push_back(block[p]);
+        }
+      }
+      for (uint32_t b : touched) {
+        if (count[b] < blocks[b].size()) {
+          std::vector<uint32_t> in, out;
+          for (uint32_t p : blocks[b]) (marked[p] ? in : out).push_back(p);
+          auto nb = static_cast<uint32_t>(blocks.size());
+          for (uint32_t p : in) block[p] = nb;
+          blocks[b] = std::move(out);
+          blocks.push_back(std::move(in));
+          count.push_back(0);
+          in_work.push_back(false);
+          // Hopcroft's trick: one half is enough unless both are pending
+          uint32_t half = in_work[b] || blocks[nb].size() < blocks[b].size()
+                              ? nb
+                              : b;
+          work.push_back(half);
+          in_work[half] = true;
+        }
+        count[b] = 0;
+      }
+      touched.clear();
+      for (uint32_t p : marked_list) marked[p] = false;
+      marked_list.clear();
+    }
+  }
+
+  trans_.resize(blocks.size() * stride_);
+  flags_.resize(blocks.size());
+  for (uint32_t b = 0; b < blocks.size(); ++b) {
+    uint32_t p = blocks[b][0];
+    for (uint32_t cls = 0; cls < stride_; ++cls) {
+      trans_[b * stride_ + cls] = block[trans[p * stride_ + cls]];
+    }
+    flags_[b] = flags[p];
+  }
+  start_ = block[start];
+  dead_ = block[dead];
+  return block;
+}
+
+bool Dfa::Search(std::string_view s, size_t *end) const {
+  bool skip = !prefix_.empty() && restart_ != LazyDfa::kUnknown;
+  uint32_t state = start_;
+  size_t pos = 0;
+  if (skip) {
+    if ((pos = prefix_.Find(s, 0)) == Prefix::npos) return false;
+    if (pos > 0) state = restart_;
+  }
+  bool found = false;
+  for (; pos < s.size(); ++pos) {
+    if (state == restart_ && skip &&
+        (pos = prefix_.Find(s, pos)) == Prefix::npos) {
+      return found;
+    }
+    if (flags_[state] & MatchFlag) {
+      found = true;
+      *end = pos;
+    }
+    state = trans_[state * stride_ + classes_[s[pos]]];
+    if (state == dead_) return found;
+  }
+  if (flags_[state] & (MatchFlag | EndMatchFlag)) {
+    found = true;
+    *end = s.size();
+  }
+  return found;
+}
+
+}  // namespace regex
@@ -5,6 +5,7 @@
 #include "regex/exp.h"
 
 #include <cassert>
+#include <limits>
 
 namespace regex {
 
@@ -139,10 +140,14 @@ Exp Exp::FromStr(std::string_view s) {
         vector.push_back(std::move(id));
         return;
     }
+    // concatenation is right-associative, otherwise a quantifier read after
+    // the third operand of "abc?" would apply to the popped "bc"
+    bool right = id.sym == Id::Sym::Concat;
     while (!stack.empty()) {
       Id &top = stack.top();
       if (top.sym.IsParen()) break;
-      if (top.sym.order() <= id.sym.order()) {
+      if (top.sym.order() < id.sym.order() ||
+          (!right && top.sym.order() == id.sym.order())) {
         stack.pop();
         vector.push_back(std::move(top));
       } else {
@@ -5,54 +5,180 @@
 #include "regex/graph.h"
 
 #include <cassert>
-#include <functional>
+#include <limits>
 #include <queue>
 #include <stack>
 #include <unordered_map>
 
+#include "regex/backtrack.h"
+#include "regex/pike.h"
+
 namespace regex {
 
-Edge::Edge(Edge &&e) noexcept : type(e.type), next(e.next), bound(e.bound) {
-  e.type = Empty;
-  e.bound = {};
+namespace {
+
+// The walker graph while it is built. Edges are added as (node, edge)
+// pairs, then counting-sorted by their node into flat arrays, keeping their
+// priority order, and rewritten in place there before being packed into
+// the arena of the `Graph`.
+struct Draft {
+  static constexpr uint32_t kNone = UINT32_MAX;
+
+  uint32_t NewNode() {
+    nodes.push_back(Node::Default);
+    return static_cast<uint32_t>(nodes.size() - 1);
+  }
+  void Add(uint32_t from, Edge edge) { added.emplace_back(from, edge); }
+  // Move the added edges into `edges`, grouped by node.
+  void Sort();
+  [[nodiscard]] GraphSize size() const {
+    return {static_cast<uint32_t>(nodes.size()),
+            static_cast<uint32_t>(edges.size())};
+  }
+  [[nodiscard]] uint32_t Degree(uint32_t node) const {
+    return begin[node + 1] - begin[node];
+  }
+  [[nodiscard]] Edge &First(uint32_t node) { return edges[begin[node]]; }
+  // Call `f` on every node index an edge refers to.
+  template <typename F>
+  static void ForEachTarget(Edge *edge, F f) {
+    f(&edge->next);
+    if (edge->type == Edge::Ahead || edge->type == Edge::NegAhead) {
+      f(&edge->ahead.start);
+    }
+  }
+
+  void Optimize();
+  // Point every reference to a node whose only edge is an epsilon at the
+  // end of its chain of such nodes, which leaves them unreachable.
+  void CollapseEpsilons();
+  // Fold every node entered only by a character, and left only by one,
+  // into a `String` edge.
+  void MergeStrings();
+  // Drop the nodes not reachable from `start`, renumbering the rest in the
+  // order they are found.
+  void RemoveUnreachable();
+
+  uint32_t start = 0;
+  std::vector<Node::Status> nodes;
+  std::vector<std::pair<uint32_t, Edge>> added;  // emptied by `Sort`
+  // the edges of node `i` are [begin[i], begin[i + 1]) of `edges`
+  std::vector<uint32_t> begin;
+  std::vector<Edge> edges;
+  std::vector<std::string> strings;  // of the `String` edges
+};
+
+void Draft::Sort() {
+  begin.assign(nodes.size() + 1, 0);
+  for (const auto &[from, edge] : added) ++begin[from + 1];
+  for (size_t i = 0; i < nodes.size(); ++i) begin[i + 1] += begin[i];
+  edges.resize(added.size(), Edge::EpsilonEdge(0));
+  std::vector<uint32_t> offsets(begin.begin(), begin.end() - 1);
+  for (const auto &[from, edge] : added) edges[offsets[from]++] = edge;
+  added.clear();
+  added.shrink_to_fit();
 }
 
-Edge &Edge::operator=(Edge &&e) noexcept {
-  type = e.type;
-  next = e.next;
-  named = e.named;
-  e.type = Empty;
-  return *this;
+void Draft::Optimize() {
+  CollapseEpsilons();
+  RemoveUnreachable();
+  MergeStrings();
+  RemoveUnreachable();
 }
 
-Edge::~Edge() {
-  switch (type) {
-    case Ahead:
-    case NegAhead:
-      delete ahead.graph;
-      break;
-    case Brake:
-      delete brake.pass;
-      break;
-    case Func:
-      delete func.f;
-      break;
-    case Repeat:
-      delete repeat.val;
-      break;
-    case Lower:
-    case Upper:
-      delete bound;
-      break;
-    case Set:
-    case SetEx:
-      delete set;
-      break;
-    default:
-      break;
+void Draft::CollapseEpsilons() {
+  auto lone = [this](uint32_t node) {
+    return nodes[node] == Node::Default && Degree(node) == 1 &&
+           First(node).IsEpsilon();
+  };
+  std::vector<uint32_t> target(nodes.size(), kNone);
+  std::vector<uint32_t> path;
+  for (uint32_t node = 0; node < nodes.size(); ++node) {
+    uint32_t end = node;
+    // a node met again on the path closes a cycle of lone epsilons, which
+    // is left as it is
+    while (target[end] == kNone && lone(end)) {
+      target[end] = end;
+      path.push_back(end);
+      end = First(end).next;
+    }
+    if (target[end] == kNone) target[end] = end;
+    end = target[end];
+    for (uint32_t p : path) target[p] = end;
+    path.clear();
+  }
+  for (Edge &edge : edges) {
+    ForEachTarget(&edge, [&](uint32_t *node) { *node = target[*node]; });
   }
+  start = target[start];
 }
 
+void Draft::MergeStrings() {
+  std::vector<uint32_t> preds(nodes.size(), 0);
+  ++preds[start];
+  for (Edge &edge : edges) {
+    ForEachTarget(&edge, [&preds](uint32_t *node) { ++preds[*node]; });
+  }
+  // Every node of a reachable cycle but its entry has a single
+  // predecessor, so the chains below always end.
+  auto chained = [&](uint32_t node) {
+    return preds[node] == 1 && nodes[node] == Node::Default &&
+           Degree(node) == 1 &&
+           (First(node).type == Edge::Char || First(node).type == Edge::String);
+  };
+  for (Edge &edge : edges) {
+    if (edge.type != Edge::Char || !chained(edge.next)) continue;
+    std::string text(1, edge.ch.val);
+    uint32_t next = edge.next;
+    for (; chained(next); next = First(next).next) {
+      const Edge &link = First(next);
+      if (link.type == Edge::Char) {
+        text.push_back(link.ch.val);
+      } else {
+        text.append(strings[link.str.idx]);
+      }
+    }
+    edge = Edge::StringEdge(next, static_cast<uint32_t>(strings.size()), 0);
+    strings.push_back(std::move(text));
+  }
+}
+
+void Draft::RemoveUnreachable() {
+  std::vector<uint32_t> index(nodes.size(), kNone);
+  std::vector<uint32_t> order{start};
+  index[start] = 0;
+  for (size_t i = 0; i < order.size(); ++i) {
+    for (uint32_t e = begin[order[i]]; e < begin[order[i] + 1]; ++e) {
+      ForEachTarget(&edges[e], [&](uint32_t *node) {
+        if (index[*node] != kNone) return;
+        index[*node] = order.size();
+        order.push_back(*node);
+      });
+    }
+  }
+  std::vector<Node::Status> kept_nodes;
+  std::vector<uint32_t> kept_begin{0};
+  std::vector<Edge> kept_edges;
+  kept_nodes.reserve(order.size());
+  kept_begin.reserve(order.size() + 1);
+  kept_edges.reserve(edges.size());
+  for (uint32_t node : order) {
+    kept_nodes.push_back(nodes[node]);
+    for (uint32_t e = begin[node]; e < begin[node + 1]; ++e) {
+      kept_edges.push_back(edges[e]);
+      ForEachTarget(&kept_edges.back(),
+                    [&index](uint32_t *next) { *next = index[*next]; });
+    }
+    kept_begin.push_back(static_cast<uint32_t>(kept_edges.size()));
+  }
+  nodes = std::move(kept_nodes);
+  begin = std::move(kept_begin);
+  edges = std::move(kept_edges);
+  start = 0;
+}
+
+}  // namespace
+
 namespace ch {
 static constexpr const char kBackslash = '\\', kGroup = 'g', kAngle = '<',
                             kAngleEnd = '>';
@@ -101,45 +227,62 @@ std::string Matcher::Sub(std::string_view s) const {
 #define FallThrough \
   do {              \
   } while (false)
-Graph Graph::Compile(std::string_view s) { return Compile(Exp::FromStr(s)); }
-Graph Graph::Compile(Exp &&exp) {
+Graph Graph::Compile(std::string_view s, const Options &options) {
+  return Compile(Exp::FromStr(s), options);
+}
+Graph Graph::Compile(Exp &&parsed, const Options &options) {
+  // the literal alternations it scans for are found before factoring
+  auto aho_corasick = std::make_unique<AhoCorasick>();
+  if (!aho_corasick->Build(parsed)) aho_corasick.reset();
+  Ast ast = Ast::FromExp(std::move(parsed));
+  ast.Simplify(options.passes);
+  Exp exp = ast.ToExp();
+  auto program = std::make_shared<const Program>(
+      Program::Compile(exp, false, options.max_program_size));
+  auto reverse = std::make_shared<const Program>(
+      Program::Compile(exp, true, options.max_program_size));
+  auto shift_and = std::make_unique<ShiftAnd>();
+  if (!shift_and->Build(exp)) shift_and.reset();
+  Prefilter prefilter;
+  prefilter.Build(exp);
   std::stack<Segment> stack;
-  std::vector<Node *> nodes;  // for memory management
+  Draft draft;
+  std::vector<Node::Status> &nodes = draft.nodes;
+  std::vector<ByteSet> sets;
+  uint32_t counter_num = 0, brake_num = 0;
+  nodes.reserve(exp.ids.size() * 2 + 1);
+  draft.added.reserve(exp.ids.size() * 2 + 1);
+  auto new_node = [&draft]() { return draft.NewNode(); };
+  auto add = [&draft](uint32_t from, Edge edge) { draft.Add(from, edge); };
 
   for (auto &id : exp.ids) {
     switch (static_cast<int>(id.sym)) {
       case Id::Sym::AheadPr:
       case Id::Sym::NegAheadPr: {
-        //        {sub-graph}
-        //             |
+        //        {body}
+        //          |
         // start=0-->ahead-->end=0
-        // Build a sub-graph with segment at the top of stack.
-        // Memory management of nodes still belongs to the parent graph.
-        // Need group_num to assign matched groups in the sub-graph to the
-        // groups passed to the parent graph.
+        // The body is walked on its own from its start, up to its end
+        // marked as a match node.
         Segment seg(stack.top());
         stack.pop();
-        seg.end->status = Node::Match;
-        auto *sub_graph = new Graph(exp.group_num, seg.start, {}, {});
-        auto end = new Node;
-        nodes.push_back(end);
-        Node *start;
+        nodes[seg.end] = Node::Match;
+        auto end = new_node();
+        auto start = new_node();
         if (id.sym == Id::Sym::AheadPr) {
-          start = new Node(Edge::AheadEdge(end, sub_graph));
+          add(start, Edge::AheadEdge(end, seg.start));
         } else {
           // as id.sym == Id::Sym::NegAheadPr
-          start = new Node(Edge::NegAheadEdge(end, sub_graph));
+          add(start, Edge::NegAheadEdge(end, seg.start));
         }
-        nodes.push_back(start);
         stack.push(Segment(start, end));
         break;
       }
       case Id::Sym::Any: {
         // start=0-->any-->end=0
-        auto end = new Node;
-        nodes.push_back(end);
-        auto start = new Node(Edge::AnyEdge(end));
-        nodes.push_back(start);
+        auto end = new_node();
+        auto start = new_node();
+        add(start, Edge::AnyEdge(end));
         stack.push(Segment(start, end));
         break;
       }
@@ -149,31 +292,26 @@ Graph Graph::Compile(Exp &&exp) {
         //              |elem|
         Segment elem(stack.top());
         stack.pop();
-        auto end = new Node;
-        nodes.push_back(end);
-        elem.end->edges.push_back(Edge::BrakeEdge(end, new bool));
-        auto start = new Node(Edge::FuncEdge(
-            elem.start,
-            new std::function<void()>(
-                [b = elem.end->edges.back().brake.pass]() { *b = true; })));
-        nodes.push_back(start);
+        auto end = new_node();
+        auto brake = brake_num++;
+        add(elem.end, Edge::BrakeEdge(end, brake));
+        auto start = new_node();
+        add(start, Edge::ArmEdge(elem.start, brake));
         stack.push(Segment(start, end));
         break;
       }
       case Id::Sym::Begin: {
-        auto end = new Node;
-        nodes.push_back(end);
-        auto start = new Node(Edge::BeginEdge(end));
-        nodes.push_back(start);
+        auto end = new_node();
+        auto start = new_node();
+        add(start, Edge::BeginEdge(end));
         stack.push(Segment(start, end));
         break;
       }
       case Id::Sym::Char: {
         // start=0-->ch=0-->end=0
-        auto end = new Node;
-        nodes.push_back(end);
-        auto start = new Node(Edge::CharEdge(end, id.ch));
-        nodes.push_back(start);
+        auto end = new_node();
+        auto start = new_node();
+        add(start, Edge::CharEdge(end, id.ch));
         stack.push(Segment(start, end));
         break;
       }
@@ -183,7 +321,7 @@ Graph Graph::Compile(Exp &&exp) {
         Segment back(stack.top());
         stack.pop();
         Segment &front(stack.top());
-        front.end->edges.push_back(Edge::EpsilonEdge(back.start));
+        add(front.end, Edge::EpsilonEdge(back.start));
         front.end = back.end;
         break;
       }
@@ -197,21 +335,19 @@ Graph Graph::Compile(Exp &&exp) {
         stack.pop();
         Segment left(stack.top());
         stack.pop();
-        auto start = new Node(Edge::EpsilonEdge(left.start),
-                              Edge::EpsilonEdge(right.start));
-        nodes.push_back(start);
-        auto end = new Node;
-        nodes.push_back(end);
-        left.end->edges.push_back(Edge::EpsilonEdge(end));
-        right.end->edges.push_back(Edge::EpsilonEdge(end));
+        auto start = new_node();
+        add(start, Edge::EpsilonEdge(left.start));
+        add(start, Edge::EpsilonEdge(right.start));
+        auto end = new_node();
+        add(left.end, Edge::EpsilonEdge(end));
+        add(right.end, Edge::EpsilonEdge(end));
         stack.push(Segment(start, end));
         break;
       }
       case Id::Sym::End: {
-        auto end = new Node;
-        nodes.push_back(end);
-        auto start = new Node(Edge::EndEdge(end));
-        nodes.push_back(start);
+        auto end = new_node();
+        auto start = new_node();
+        add(start, Edge::EndEdge(end));
         stack.push(Segment(start, end));
         break;
       }
@@ -223,45 +359,42 @@ Graph Graph::Compile(Exp &&exp) {
         //       |-->.-->.-->.-->|
         Segment elem(stack.top());
         stack.pop();
-        auto end = new Node;
-        nodes.push_back(end);
-        std::vector<Edge> edges;
-        Node *start;
+        auto end = new_node();
+        uint32_t start;
         switch (static_cast<int>(id.sym)) {
           case Id::Sym::More: {
-            start =
-                new Node(Edge::EpsilonEdge(elem.start), Edge::EpsilonEdge(end));
+            start = new_node();
+            add(start, Edge::EpsilonEdge(elem.start));
+            add(start, Edge::EpsilonEdge(end));
             break;
           }
           case Id::Sym::RelMore: {
-            start =
-                new Node(Edge::EpsilonEdge(end), Edge::EpsilonEdge(elem.start));
+            start = new_node();
+            add(start, Edge::EpsilonEdge(end));
+            add(start, Edge::EpsilonEdge(elem.start));
             break;
           }
           default:  // ain't fall to default case, only to avoid clang warning
           case Id::Sym::PosMore: {
-            std::function<void()> initializer;
-            auto loop = new Node(Edge::EpsilonEdge(elem.start),
-                                 Edge::BrakeEdge(end, new bool));
-            nodes.push_back(loop);
-            start = new Node(Edge::FuncEdge(
-                loop, new std::function<void()>{
-                          [b = loop->edges[1].brake.pass]() { *b = true; }}));
+            auto brake = brake_num++;
+            auto loop = new_node();
+            add(loop, Edge::EpsilonEdge(elem.start));
+            add(loop, Edge::BrakeEdge(end, brake));
+            start = new_node();
+            add(start, Edge::ArmEdge(loop, brake));
           }
         }
-        nodes.push_back(start);
-        elem.end->edges.push_back(Edge::EpsilonEdge(start));
+        add(elem.end, Edge::EpsilonEdge(start));
         stack.push(Segment(start, end));
         break;
       }
       case Id::Sym::NamedPr: {
         Segment elem(stack.top());
         stack.pop();
-        auto end = new Node;
-        nodes.push_back(end);
-        auto start = new Node(Edge::NamedEdge(elem.start, id.named.idx));
-        nodes.push_back(start);
-        elem.end->edges.push_back(Edge::NamedEndEdge(end, id.named.idx));
+        auto end = new_node();
+        auto start = new_node();
+        add(start, Edge::NamedEdge(elem.start, id.named.idx));
+        add(elem.end, Edge::NamedEndEdge(end, id.named.idx));
         stack.push(Segment(start, end));
         break;
       }
@@ -270,11 +403,10 @@ Graph Graph::Compile(Exp &&exp) {
         // start=0-->0==>0-->end=0
         Segment elem(stack.top());
         stack.pop();
-        auto end = new Node;
-        nodes.push_back(end);
-        auto start = new Node(Edge::StoreEdge(elem.start, id.store.idx));
-        nodes.push_back(start);
-        elem.end->edges.push_back(Edge::StoreEndEdge(end, id.store.idx));
+        auto end = new_node();
+        auto start = new_node();
+        add(start, Edge::StoreEdge(elem.start, id.store.idx));
+        add(elem.end, Edge::StoreEndEdge(end, id.store.idx));
         stack.push(Segment(start, end));
         break;
       }
@@ -287,36 +419,27 @@ Graph Graph::Compile(Exp &&exp) {
         // special case as {1,}
         Segment elem(stack.top());
         stack.pop();
-        auto end = new Node;
-        nodes.push_back(end);
-        auto repeat = new size_t;
-        auto loop = new Node(Edge::EpsilonEdge(elem.start),
-                             Edge::LowerEdge(end, repeat, 1));
-        nodes.push_back(loop);
-        elem.end->edges.push_back(Edge::RepeatEdge(loop, repeat));
-        auto start = new Node(Edge::FuncEdge(
-            loop, new std::function<void()>({[r = repeat]() { *r = 0; }})));
-        nodes.push_back(start);
-        switch (static_cast<int>(id.sym)) {
-          case Id::Sym::Plus: {
-            break;
-          }
-          case Id::Sym::RelPlus: {
-            std::reverse(loop->edges.begin(), loop->edges.end());
-            break;
-          }
-          case Id::Sym::PosPlus: {
-            auto brake_end = new Node;
-            nodes.push_back(brake_end);
-            end->edges.push_back(Edge::BrakeEdge(brake_end, new bool));
-            start = new Node(Edge::FuncEdge(
-                start,
-                new std::function<void()>(
-                    [b = end->edges.back().brake.pass]() { *b = true; })));
-            nodes.push_back(start);
-            end = brake_end;
-            break;
-          }
+        auto end = new_node();
+        auto repeat = counter_num++;
+        auto loop = new_node();
+        if (id.sym == Id::Sym::RelPlus) {
+          add(loop, Edge::LowerEdge(end, repeat, 1));
+          add(loop, Edge::EpsilonEdge(elem.start));
+        } else {
+          add(loop, Edge::EpsilonEdge(elem.start));
+          add(loop, Edge::LowerEdge(end, repeat, 1));
+        }
+        add(elem.end, Edge::RepeatEdge(loop, repeat));
+        auto start = new_node();
+        add(start, Edge::FuncEdge(loop, repeat, 0));
+        if (id.sym == Id::Sym::PosPlus) {
+          auto brake = brake_num++;
+          auto brake_end = new_node();
+          add(end, Edge::BrakeEdge(brake_end, brake));
+          auto func = new_node();
+          add(func, Edge::ArmEdge(start, brake));
+          start = func;
+          end = brake_end;
         }
         stack.push(Segment(start, end));
         break;
@@ -330,20 +453,21 @@ Graph Graph::Compile(Exp &&exp) {
         //       |-->.-->.-->|
         Segment elem(stack.top());
         stack.pop();
-        auto end = new Node;
-        nodes.push_back(end);
-        Node *start;
+        auto end = new_node();
+        uint32_t start;
         switch (static_cast<int>(id.sym)) {
           case Id::Sym::Quest: {
-            start =
-                new Node(Edge::EpsilonEdge(elem.start), Edge::EpsilonEdge(end));
-            elem.end->edges.push_back(Edge::EpsilonEdge(end));
+            start = new_node();
+            add(start, Edge::EpsilonEdge(elem.start));
+            add(start, Edge::EpsilonEdge(end));
+            add(elem.end, Edge::EpsilonEdge(end));
             break;
           }
           case Id::Sym::RelQuest: {
-            start =
-                new Node(Edge::EpsilonEdge(end), Edge::EpsilonEdge(elem.start));
-            elem.end->edges.push_back(Edge::EpsilonEdge(end));
+            start = new_node();
+            add(start, Edge::EpsilonEdge(end));
+            add(start, Edge::EpsilonEdge(elem.start));
+            add(elem.end, Edge::EpsilonEdge(end));
             break;
           }
           default:
@@ -352,31 +476,28 @@ Graph Graph::Compile(Exp &&exp) {
             //      |func-brake|      |-->0==>0-->|    |brake|
             // start=0-->.-->loop=0-->|           |-->0-->.-->end=0
             //                        |-->.-->.-->|
-            auto loop =
-                new Node(Edge::EpsilonEdge(elem.start), Edge::EpsilonEdge(end));
-            nodes.push_back(loop);
-            auto brake_end = new Node;
-            nodes.push_back(brake_end);
-            end->edges.push_back(Edge::BrakeEdge(brake_end, new bool));
-            start = new Node(Edge::FuncEdge(
-                loop, new std::function<void()>{
-                          [b = end->edges[0].brake.pass]() { *b = true; }}));
-            elem.end->edges.push_back(Edge::EpsilonEdge(end));
+            auto loop = new_node();
+            add(loop, Edge::EpsilonEdge(elem.start));
+            add(loop, Edge::EpsilonEdge(end));
+            auto brake = brake_num++;
+            auto brake_end = new_node();
+            add(end, Edge::BrakeEdge(brake_end, brake));
+            start = new_node();
+            add(start, Edge::ArmEdge(loop, brake));
+            add(elem.end, Edge::EpsilonEdge(end));
             end = brake_end;
             break;
           }
         }
-        nodes.push_back(start);
         stack.push(Segment(start, end));
         break;
       }
       case Id::Sym::RefPr: {
         //          | ref |
         // start=0-->0-->0-->end=0
-        auto end = new Node;
-        nodes.push_back(end);
-        auto start = new Node(Edge::RefEdge(end, id.ref.idx));
-        nodes.push_back(start);
+        auto end = new_node();
+        auto start = new_node();
+        add(start, Edge::RefEdge(end, id.ref.idx));
         stack.push(Segment(start, end));
         break;
       }
@@ -391,73 +512,50 @@ Graph Graph::Compile(Exp &&exp) {
         //                    |-->.-->.-->.-->|
         Segment elem(stack.top());
         stack.pop();
-        auto loop = new Node;
-        nodes.push_back(loop);
-        auto repeat = new size_t;
-        elem.end->edges.push_back(Edge::RepeatEdge(loop, repeat));
-        auto start = new Node(Edge::FuncEdge(
-            loop, new std::function<void()>{[r = repeat]() { *r = 0; }}));
-        nodes.push_back(start);
-        if (id.repeat->upper != std::numeric_limits<size_t>::max()) {
-          loop->edges.push_back(
-              Edge::UpperEdge(elem.start, repeat, id.repeat->upper));
-        } else {
-          loop->edges.push_back(Edge::EpsilonEdge(elem.start));
+        auto loop = new_node();
+        auto repeat = counter_num++;
+        add(elem.end, Edge::RepeatEdge(loop, repeat));
+        auto start = new_node();
+        add(start, Edge::FuncEdge(loop, repeat, 0));
+        auto end = new_node();
+        auto upper = static_cast<uint32_t>(id.repeat->upper);
+        auto lower = static_cast<uint32_t>(id.repeat->lower);
+        Edge more = id.repeat->upper != std::numeric_limits<size_t>::max()
+                        ? Edge::UpperEdge(elem.start, repeat, upper)
+                        : Edge::EpsilonEdge(elem.start);
+        Edge done = lower != 0 ? Edge::LowerEdge(end, repeat, lower)
+                               : Edge::EpsilonEdge(end);
+        if (id.sym == Id::Sym::RelRepeat) std::swap(more, done);
+        add(loop, more);
+        add(loop, done);
+        if (id.sym == Id::Sym::PosRepeat) {
+          //                    Upper
+          //                     |-->0==>0-->|
+          //       |func-repeat| |  Repeat   |
+          // start=0-->=0-->loop=0<--.<--.<--|              brake
+          //   /func-brake|      |  Lower        |-->end=0-->|
+          //                     |-->.-->.-->.-->|           0=brake_end
+          auto brake = brake_num++;
+          auto brake_end = new_node();
+          add(end, Edge::BrakeEdge(brake_end, brake));
+          auto func = new_node();
+          add(func, Edge::ArmEdge(start, brake));
+          start = func;
+          end = brake_end;
         }
-        auto end = new Node;
-        nodes.push_back(end);
-        if (id.repeat->lower != 0) {
-          loop->edges.push_back(Edge::LowerEdge(end, repeat, id.repeat->lower));
-        } else {
-          loop->edges.push_back(Edge::EpsilonEdge(end));
-        }
-        switch (static_cast<int>(id.sym)) {
-          default:
-          case Id::Sym::Repeat: {
-            break;
-          }
-          case Id::Sym::RelRepeat: {
-            std::reverse(loop->edges.begin(), loop->edges.end());
-            break;
-          }
-          case Id::Sym::PosRepeat: {
-            //                    Upper
-            //                     |-->0==>0-->|
-            //       |func-repeat| |  Repeat   |
-            // start=0-->=0-->loop=0<--.<--.<--|              brake
-            //   /func-brake|      |  Lower        |-->end=0-->|
-            //                     |-->.-->.-->.-->|           0=brake_end
-            auto brake_end = new Node;
-            nodes.push_back(brake_end);
-            end->edges.push_back(Edge::BrakeEdge(brake_end, new bool));
-            start = new Node(Edge::FuncEdge(
-                start, new std::function<void()>(
-                           [b = end->edges[0].brake.pass]() { *b = true; })));
-            nodes.push_back(start);
-            end = brake_end;
-            break;
-          }
-        }
-        stack.push(Segment(start, end));
-        break;
-      }
-      case Id::Sym::Set: {
-        //          set
-        // start=0-->.-->end=0
-        auto end = new Node;
-        nodes.push_back(end);
-        auto start = new Node(Edge::SetEdge(end, std::move(id.set->val)));
-        nodes.push_back(start);
         stack.push(Segment(start, end));
         break;
       }
+      case Id::Sym::Set:
       case Id::Sym::SetEx: {
         //          set
         // start=0-->.-->end=0
-        auto end = new Node;
-        nodes.push_back(end);
-        auto start = new Node(Edge::SetExEdge(end, std::move(id.set->val)));
-        nodes.push_back(start);
+        auto end = new_node();
+        auto start = new_node();
+        auto idx = static_cast<uint32_t>(sets.size());
+        sets.emplace_back(id.set->val);
+        add(start, id.sym == Id::Sym::Set ? Edge::SetEdge(end, idx)
+                                          : Edge::SetExEdge(end, idx));
         stack.push(Segment(start, end));
         break;
       }
@@ -469,45 +567,317 @@ Graph Graph::Compile(Exp &&exp) {
   }
   assert(stack.size() == 1);
   Segment &seg(stack.top());
-  Node *end = new Node;
-  end->status = Node::Match;
-  seg.end->edges.push_back(Edge::MatchEdge(end));
-  nodes.push_back(end);
-  Graph graph(exp.group_num, seg.start, std::move(nodes),
-              std::move(exp.named_group));
+  auto end = new_node();
+  nodes[end] = Node::Match;
+  add(seg.end, Edge::MatchEdge(end));
+
+  draft.start = seg.start;
+
+  Graph graph(exp.group_num, std::move(exp.named_group));
+  draft.Sort();
+  graph.unoptimized_size_ = draft.size();
+  draft.Optimize();
+  GraphSize size = draft.size();
+  graph.start_ = draft.start;
+  graph.node_num_ = size.nodes;
+  graph.edge_num_ = size.edges;
+  graph.arena_ = std::make_unique<uint8_t[]>(size.nodes * sizeof(Node) +
+                                             size.edges * sizeof(Edge));
+  auto *arena_nodes = reinterpret_cast<Node *>(graph.arena_.get());
+  auto *arena_edges = reinterpret_cast<Edge *>(arena_nodes + size.nodes);
+  for (uint32_t i = 0; i < size.nodes; ++i) {
+    arena_nodes[i] = {draft.begin[i], draft.begin[i + 1], nodes[i]};
+  }
+  for (uint32_t i = 0; i < size.edges; ++i) {
+    Edge edge = draft.edges[i];
+    if (edge.type == Edge::String) {
+      const std::string &text = draft.strings[edge.str.idx];
+      edge = Edge::StringEdge(edge.next,
+                              static_cast<uint32_t>(graph.strings_.size()),
+                              static_cast<uint32_t>(text.size()));
+      graph.strings_.append(text);
+    }
+    arena_edges[i] = edge;
+  }
+  graph.nodes_ = arena_nodes;
+  graph.edges_ = arena_edges;
+  graph.sets_ = std::move(sets);
+  graph.counter_num_ = counter_num;
+  graph.brake_num_ = brake_num;
+  if (!program->backtrack() && !program->empty() && !reverse->empty()) {
+    graph.lazy_dfa_ =
+        std::make_unique<LazyDfa>(program, options.dfa_cache_size);
+    graph.reverse_dfa_ = std::make_unique<LazyDfa>(
+        std::move(reverse), options.dfa_cache_size, LazyDfa::Reverse);
+  }
+#ifdef REGEX_JIT
+  if (options.jit) {
+    graph.jit_ = std::make_unique<Jit>();
+    if (!graph.jit_->Build(*program, options.visit_budget)) graph.jit_.reset();
+  }
+#endif
+  graph.options_ = options;
+  graph.program_ = std::move(program);
+  graph.shift_and_ = std::move(shift_and);
+  graph.prefilter_ = std::move(prefilter);
+  graph.aho_corasick_ = std::move(aho_corasick);
   return graph;
 }
 
+bool Graph::CompileDfa(size_t max_states) {
+  if (program_->empty()) return false;
+  auto dfa = std::make_unique<Dfa>();
+  if (!dfa->Build(program_, max_states)) return false;
+  dfa_ = std::move(dfa);
+  return true;
+}
+
+bool Graph::Test(std::string_view s) const {
+  if (Rejected(s)) return false;
+  if (aho_corasick_ != nullptr) return aho_corasick_->Test(s);
+  size_t end;
+  if (dfa_ != nullptr) return dfa_->Search(s, &end);
+  if (LazyDfa::Borrowed lazy_dfa{lazy_dfa_.get()}) {
+    switch (lazy_dfa->Search(s, &end)) {
+      case LazyDfa::Matched:
+        return true;
+      case LazyDfa::NoMatch:
+        return false;
+      case LazyDfa::GaveUp:
+        break;
+    }
+  }
+  // the lazy DFA is faster where it runs, shift-and answers when it is busy
+  // or gave up
+  if (shift_and_ != nullptr) return shift_and_->Test(s);
+  return Match(s).ok();
+}
+
+int Graph::MatchEnd(std::string_view s) const {
+  if (Rejected(s)) return -1;
+  size_t begin, end;
+  if (aho_corasick_ != nullptr) {
+    return aho_corasick_->Search(s, &begin, &end) ? static_cast<int>(end) : -1;
+  }
+  if (dfa_ != nullptr) {
+    return dfa_->Search(s, &end) ? static_cast<int>(end) : -1;
+  }
+  if (LazyDfa::Borrowed lazy_dfa{lazy_dfa_.get()}) {
+    switch (lazy_dfa->Search(s, &end)) {
+      case LazyDfa::Matched:
+        return static_cast<int>(end);
+      case LazyDfa::NoMatch:
+        return -1;
+      case LazyDfa::GaveUp:
+        break;
+    }
+  }
+  Matcher matcher = Match(s);
+  if (!matcher.ok()) return -1;
+  return static_cast<int>(matcher.EndIdx());
+}
+
 int Graph::MatchLen(std::string_view s) const {
-  std::vector<std::string_view> groups;
-  if (!MatchGroups(s, &groups)) return -1;
-  return groups[0].size();
+  Matcher matcher = Match(s);
+  if (!matcher.ok()) return -1;
+  return static_cast<int>(matcher.Size());
 }
 bool Graph::MatchGroups(std::string_view s,
                         std::vector<std::string_view> *groups) const {
   Matcher matcher = Match(s);
-  if (groups != nullptr) *groups = matcher.groups_;
+  if (groups != nullptr) *groups = std::move(matcher.groups_);
   return matcher.ok();
 }
 
-void Graph::Match(std::string_view s, Matcher *matcher) const {
-  struct Pos {
-    std::string_view::const_iterator it;
-    Node *node;
-    size_t idx;
+void MatchScratch::Bind(const std::shared_ptr<const Program> &program) {
+  if (program_ == program) return;
+  program_ = program;
+  pike_.reset();
+  backtracker_.reset();
+}
 
-    Pos(std::string_view::const_iterator it, Node *node, size_t idx)
-        : it(it), node(node), idx(idx) {}
-  };
+PikeVm *MatchScratch::pike() {
+  if (pike_ == nullptr) pike_ = std::make_unique<PikeVm>(*program_);
+  return pike_.get();
+}
+
+Backtracker *MatchScratch::backtracker(size_t visit_budget) {
+  if (backtracker_ == nullptr) {
+    backtracker_ = std::make_unique<Backtracker>(*program_, visit_budget);
+  }
+  return backtracker_.get();
+}
 
-  std::stack<Pos> stack;
-  std::vector<std::pair<std::string_view::const_iterator,
-                        std::string_view::const_iterator>>
-      boundary;
-  auto start = s.begin();
+void Graph::Match(std::string_view s, Matcher *matcher,
+                  MatchScratch *scratch) const {
+  if (scratch == nullptr) {
+    MatchScratch local;
+    Match(s, matcher, &local);
+    return;
+  }
+  // patterns without back-references, look-ahead or atomic groups run on the
+  // linear-time Pike VM, so hostile inputs can not blow up the backtracker
+  matcher->Reset(s, group_num_, named_group_);
+  size_t candidate = Candidate(s);
+  if (candidate == Prefilter::npos) return;
+  if (aho_corasick_ != nullptr) {
+    // every group encloses the whole alternation
+    size_t begin, end;
+    matcher->ok_ = aho_corasick_->Search(s, &begin, &end);
+    if (!matcher->ok()) return;
+    for (auto &group : matcher->groups_) group = s.substr(begin, end - begin);
+    return;
+  }
+  if (program_->empty()) {
+    Walk(s, Unanchored, matcher, scratch);
+    return;
+  }
+  std::vector<size_t> &slots = matcher->slots_;
+  scratch->Bind(program_);
+  if (program_->backtrack()) {
+    matcher->ok_ = scratch->backtracker(options_.visit_budget)
+                       ->Search(s, candidate, &slots);
+  } else {
+    // the automata reject most non-matching inputs without tracking
+    // captures, then find the span of the match in two linear scans
+    size_t begin = candidate, end = s.size();
+    bool located = false;
+    if (dfa_ != nullptr) {
+      located = dfa_->Search(s, &end);
+      if (!located) {
+        matcher->ok_ = false;
+        return;
+      }
+    } else if (LazyDfa::Borrowed lazy_dfa{lazy_dfa_.get()}) {
+      switch (lazy_dfa->Search(s, &end)) {
+        case LazyDfa::Matched:
+          located = true;
+          break;
+        case LazyDfa::NoMatch:
+          matcher->ok_ = false;
+          return;
+        case LazyDfa::GaveUp:
+          end = s.size();
+          break;
+      }
+    }
+    if (!located && shift_and_ != nullptr && !shift_and_->Test(s)) {
+      // the lazy DFA was busy or gave up, shift-and still rejects but does
+      // not tell where a match lies
+      matcher->ok_ = false;
+      return;
+    }
+    if (located) {
+      LazyDfa::Borrowed reverse_dfa{reverse_dfa_.get()};
+      if (!reverse_dfa ||
+          reverse_dfa->SearchReverse(s.substr(0, end), end == s.size(),
+                                     &begin) != LazyDfa::Matched) {
+        begin = candidate;
+        end = s.size();
+      }
+    }
+    Jit::Status status = Jit::GaveUp;
+    if (jit_ != nullptr) {
+      status = jit_->Search(s, begin, &slots, Unanchored, &scratch->jit_);
+    }
+    matcher->ok_ = status == Jit::GaveUp
+                       ? scratch->pike()->Search(s, begin, end, &slots)
+                       : status == Jit::Matched;
+  }
+  if (matcher->ok()) SetGroups(s, slots, matcher);
+}
+
+void Graph::Match(std::string_view s, Anchor anchor, Matcher *matcher,
+                  MatchScratch *scratch) const {
+  if (scratch == nullptr) {
+    MatchScratch local;
+    Match(s, anchor, matcher, &local);
+    return;
+  }
+  if (program_->empty()) {
+    Walk(s, anchor, matcher, scratch);
+    return;
+  }
+  // the automata only find unanchored matches, so the VM runs alone
+  matcher->Reset(s, group_num_, named_group_);
+  std::vector<size_t> &slots = matcher->slots_;
+  scratch->Bind(program_);
+  if (Rejected(s)) {
+    matcher->ok_ = false;
+  } else if (program_->backtrack()) {
+    matcher->ok_ = scratch->backtracker(options_.visit_budget)
+                       ->Search(s, &slots, anchor);
+  } else {
+    Jit::Status status = Jit::GaveUp;
+    if (jit_ != nullptr) {
+      status = jit_->Search(s, 0, &slots, anchor, &scratch->jit_);
+    }
+    matcher->ok_ = status == Jit::GaveUp
+                       ? scratch->pike()->Search(s, &slots, anchor)
+                       : status == Jit::Matched;
+  }
+  if (matcher->ok()) SetGroups(s, slots, matcher);
+}
+
+void Graph::SetGroups(std::string_view s, const std::vector<size_t> &slots,
+                      Matcher *matcher) const {
+  for (size_t i = 0; i < group_num_; ++i) {
+    if (slots[i * 2] == Program::kUnset ||
+        slots[i * 2 + 1] == Program::kUnset) {
+      continue;
+    }
+    matcher->groups_[i] =
+        s.substr(slots[i * 2], slots[i * 2 + 1] - slots[i * 2]);
+  }
+}
+
+void Graph::Walk(std::string_view s, Matcher *matcher,
+                 MatchScratch *scratch) const {
+  // an anchored pattern can not match further on
+  Walk(s, program_->anchored() ? AnchorStart : Unanchored, matcher, scratch);
+}
+
+void Graph::Walk(std::string_view s, Anchor anchor, Matcher *matcher,
+                 MatchScratch *scratch) const {
+  if (scratch == nullptr) {
+    MatchScratch local;
+    Walk(s, anchor, matcher, &local);
+    return;
+  }
+  matcher->Reset(s, group_num_, named_group_);
+  // positions are kept as 32-bit offsets
+  if (s.size() >= UINT32_MAX) return;
+  Frame &frame = scratch->frame_;
+  frame.counters.assign(counter_num_, 0);
+  frame.brakes.assign(brake_num_, false);
+  frame.trail.clear();
+  frame.overflowed = false;
+  matcher->ok_ = Walk(s, start_, anchor, 0, scratch);
+  matcher->overflowed_ = frame.overflowed;
+  if (!matcher->ok()) return;
+  const Boundary &boundary = scratch->boundaries_[0];
+  for (size_t i = 0; i < boundary.size(); ++i) {
+    if (boundary[i].first >= boundary[i].second) continue;
+    matcher->groups_[i] = std::string_view(
+        boundary[i].first, boundary[i].second - boundary[i].first);
+  }
+}
+
+bool Graph::Walk(std::string_view s, uint32_t start_node, Anchor anchor,
+                 size_t depth, MatchScratch *scratch) const {
+  Frame *frame = &scratch->frame_;
+  // the positions below `base` belong to the walks enclosing this one
+  std::vector<Pos> &stack = scratch->stack_;
+  size_t base = stack.size();
+  if (scratch->boundaries_.size() <= depth) {
+    scratch->boundaries_.resize(depth + 1);
+  }
+  Boundary &boundary = scratch->boundaries_[depth];
+  uint32_t start = 0;
+  bool matched = false;
   do {
-    Pos cur(start, start_, 0);
-    boundary.assign(group_num_, {cur.it, cur.it});
+    Pos cur(start, start_node, nodes_[start_node].begin, frame->trail.size());
+    boundary.assign(group_num_, {s.begin() + start, s.begin() + start});
 
     while (true) {
       // set backtrack false
@@ -517,20 +887,28 @@ void Graph::Match(std::string_view s, Matcher *matcher) const {
       // else
       //   go dig children
       bool backtrack = false;
-      auto &edge = cur.node->edges[cur.idx];
+      // every edge is tried from where the walk entered the node
+      auto it = s.begin() + cur.pos;
+      const Edge &edge = edges_[cur.idx];
       switch (edge.type) {
         case Edge::Any:
         case Edge::Char:
         case Edge::Set:
         case Edge::SetEx: {
-          if (cur.it == s.end()) {
+          if (it == s.end()) {
             backtrack = true;
           }
           break;
         }
         case Edge::Ref: {
           auto &pair = boundary[edge.ref.idx];
-          if (pair.second - pair.first > s.end() - cur.it) {
+          if (pair.second - pair.first > s.end() - it) {
+            backtrack = true;
+          }
+          break;
+        }
+        case Edge::String: {
+          if (s.end() - it < edge.str.len) {
             backtrack = true;
           }
           break;
@@ -541,62 +919,73 @@ void Graph::Match(std::string_view s, Matcher *matcher) const {
       if (!backtrack) {
         switch (edge.type) {
           case Edge::Ahead: {
-            edge.ahead.graph->Match(std::string_view(cur.it, s.end() - cur.it),
-                                    matcher);
-            if (!matcher->ok()) {
+            // the body must match right here, the groups it captures are
+            // kept only once it did
+            if (!Walk(std::string_view(it, s.end() - it), edge.ahead.start,
+                      AnchorStart, depth + 1, scratch)) {
+              if (frame->overflowed) goto overflow;
               backtrack = true;
+              break;
+            }
+            const Boundary &inner = scratch->boundaries_[depth + 1];
+            for (size_t i = 1; i < inner.size(); ++i) {
+              if (inner[i].first < inner[i].second) boundary[i] = inner[i];
             }
             break;
           }
           case Edge::NegAhead: {
-            edge.ahead.graph->Match(std::string_view(cur.it, s.end() - cur.it),
-                                    matcher);
-            if (matcher->ok()) {
+            if (Walk(std::string_view(it, s.end() - it),
+                     edge.neg_ahead.start, AnchorStart, depth + 1, scratch)) {
               backtrack = true;
             }
+            if (frame->overflowed) goto overflow;
             break;
           }
           case Edge::Any: {
-            ++cur.it;
+            ++it;
             FallThrough;
           }
           case Edge::Epsilon: {
             break;
           }
+          case Edge::Arm: {
+            frame->brakes[edge.arm.reg] = true;
+            break;
+          }
           case Edge::Begin: {
-            if (cur.it != s.begin()) {
+            if (it != s.begin()) {
               backtrack = true;
             }
             break;
           }
           case Edge::Brake: {
-            if (*edge.brake.pass) {
-              *edge.brake.pass = false;
+            if (frame->brakes[edge.brake.reg]) {
+              frame->brakes[edge.brake.reg] = false;
             } else {
               backtrack = true;
             }
             break;
           }
           case Edge::Char: {
-            if (*cur.it != edge.ch.val) {
+            if (*it != edge.ch.val) {
               backtrack = true;
               break;
             }
-            ++cur.it;
+            ++it;
             break;
           }
           case Edge::End: {
-            if (cur.it != s.end()) {
+            if (it != s.end()) {
               backtrack = true;
             }
             break;
           }
           case Edge::Func: {
-            (*edge.func.f)();
+            frame->Set(edge.func.reg, edge.func.val);
             break;
           }
           case Edge::Lower: {
-            if (*edge.bound->repeat < edge.bound->num) {
+            if (frame->counters[edge.bound.reg] < edge.bound.num) {
               backtrack = true;
             }
             break;
@@ -605,25 +994,25 @@ void Graph::Match(std::string_view s, Matcher *matcher) const {
             break;
           }
           case Edge::Named: {
-            boundary[edge.named.idx].first = cur.it;
+            boundary[edge.named.idx].first = it;
             break;
           }
           case Edge::NamedEnd: {
-            boundary[edge.named_end.idx].second = cur.it;
+            boundary[edge.named_end.idx].second = it;
             break;
           }
           case Edge::Store: {
-            boundary[edge.store.idx].first = cur.it;
+            boundary[edge.store.idx].first = it;
             break;
           }
           case Edge::StoreEnd: {
-            boundary[edge.store_end.idx].second = cur.it;
+            boundary[edge.store_end.idx].second = it;
             break;
           }
           case Edge::Ref: {
             auto &pair = boundary[edge.ref.idx];
             std::string_view view(&*pair.first, pair.second - pair.first);
-            auto p = cur.it;
+            auto p = it;
             auto vit = view.begin();
             for (; vit != view.end(); ++vit, ++p) {
               if (*p != *vit) {
@@ -633,32 +1022,41 @@ void Graph::Match(std::string_view s, Matcher *matcher) const {
             }
             if (!backtrack) {
               assert(vit == view.end());
-              cur.it = p;
+              it = p;
             }
             break;
           }
           case Edge::Repeat: {
-            ++*edge.repeat.val;
+            frame->Set(edge.repeat.reg, frame->counters[edge.repeat.reg] + 1);
             break;
           }
           case Edge::Set: {
-            if (edge.set->val.Contains(*cur.it)) {
-              ++cur.it;
+            if (sets_[edge.set.idx].Contains(*it)) {
+              ++it;
             } else {
               backtrack = true;
             }
             break;
           }
           case Edge::SetEx: {
-            if (edge.set->val.Contains(*cur.it)) {
+            if (sets_[edge.set.idx].Contains(*it)) {
               backtrack = true;
             } else {
-              ++cur.it;
+              ++it;
+            }
+            break;
+          }
+          case Edge::String: {
+            if (std::memcmp(&*it, strings_.data() + edge.str.idx,
+                            edge.str.len) != 0) {
+              backtrack = true;
+              break;
             }
+            it += edge.str.len;
             break;
           }
           case Edge::Upper: {
-            if (*edge.bound->repeat >= edge.bound->num) {
+            if (frame->counters[edge.bound.reg] >= edge.bound.num) {
               backtrack = true;
             }
             break;
@@ -666,74 +1064,128 @@ void Graph::Match(std::string_view s, Matcher *matcher) const {
           default:
             break;
         }
+        // counter updates stay trailed until backtracked over, so an
+        // endless run of empty lazy iterations grows the trail instead
+        if (frame->trail.size() > options_.max_stack_depth) {
+          frame->overflowed = true;
+          goto overflow;
+        }
+      }
+      // a full match may only end at the end of the text
+      if (!backtrack && anchor == AnchorBoth &&
+          nodes_[edge.next].status == Node::Match && it != s.end()) {
+        backtrack = true;
       }
       if (backtrack) {
-        // go other children, or pop the parent node
+        // go other children, or pop the parent node, with the counters as
+        // they were when the node was entered
         while (true) {
-          if (++cur.idx < cur.node->edges.size()) break;
-          if (stack.empty()) {
-            matcher->ok_ = false;
+          frame->Undo(cur.trail);
+          if (++cur.idx < nodes_[cur.node].end) break;
+          if (stack.size() == base) {
+            matched = false;
             goto finally;
           }
-          cur = stack.top();
-          stack.pop();
+          cur = stack.back();
+          stack.pop_back();
         }
       } else {
-        auto *next = edge.next;
-        if (next->status == Node::Match) {
-          matcher->ok_ = true;
-          boundary[0].second = cur.it;
+        uint32_t next = edge.next;
+        if (nodes_[next].status == Node::Match) {
+          matched = true;
+          boundary[0].second = it;
           goto finally;
         }
-        if (!next->edges.empty()) {  // traverse the children
-          stack.push(cur);
-          cur = Pos(cur.it, next, 0);
+        if (nodes_[next].begin != nodes_[next].end) {  // traverse the children
+          // only a node with edges left to try is returned to
+          if (cur.idx + 1 < nodes_[cur.node].end) {
+            if (stack.size() - base >= options_.max_stack_depth) {
+              frame->overflowed = true;
+              goto overflow;
+            }
+            stack.push_back(cur);
+          }
+          cur = Pos(static_cast<uint32_t>(it - s.begin()), next,
+                    nodes_[next].begin, frame->trail.size());
         } else {
           assert(false);
         }
       }
     }
   finally:
-    if (!matcher->ok()) continue;
-    //    groups->clear();  // to collect groups in look-ahead sub-graph
-    for (size_t i = 0; i < boundary.size(); ++i) {
-      if (boundary[i].first >= boundary[i].second) continue;
-      matcher->groups_[i] = std::string_view(
-          boundary[i].first, boundary[i].second - boundary[i].first);
-    }
-    return;
-  } while (start++ != s.end());
+    if (!matched) continue;
+    stack.resize(base, cur);
+    return true;
+  } while (anchor == Unanchored && start++ != s.size());
+  return false;
+overflow:
+  // give up the whole walk, its outcome is unknown
+  stack.erase(stack.begin() + base, stack.end());
+  return false;
 }
 
 Matcher Graph::Match(std::string_view s) const {
-  Matcher matcher(s, group_num_, named_group_);
+  Matcher matcher;
   Match(s, &matcher);
   return matcher;
 }
 
+void Graph::MatchAnchored(std::string_view s, Matcher *matcher,
+                          MatchScratch *scratch) const {
+  Match(s, AnchorStart, matcher, scratch);
+}
+
+Matcher Graph::MatchAnchored(std::string_view s) const {
+  Matcher matcher;
+  Match(s, AnchorStart, &matcher, nullptr);
+  return matcher;
+}
+
+void Graph::FullMatch(std::string_view s, Matcher *matcher,
+                      MatchScratch *scratch) const {
+  Match(s, AnchorBoth, matcher, scratch);
+}
+
+Matcher Graph::FullMatch(std::string_view s) const {
+  Matcher matcher;
+  Match(s, AnchorBoth, &matcher, nullptr);
+  return matcher;
+}
+
 std::string Graph::Sub(std::string_view sub, std::string_view s) const {
   std::string ret;
+  // one matcher and one scratch serve every replacement
+  Matcher matcher;
+  MatchScratch scratch;
   while (true) {
-    auto matcher = Match(s);
+    Match(s, &matcher, &scratch);
     if (!matcher.ok()) {
       ret.append(s);
       return ret;
     }
     ret.append(s.substr(0, matcher.BeginIdx()));
     ret.append(matcher.Sub(sub));
+    if (matcher.Size() == 0) {
+      // step over an empty match, otherwise it would be found again
+      if (matcher.EndIdx() == s.size()) return ret;
+      ret.push_back(s[matcher.EndIdx()]);
+      s = s.substr(matcher.EndIdx() + 1);
+      continue;
+    }
     s = s.substr(matcher.EndIdx());
   }
 }
 
 void Graph::DrawMermaid() const {
   int id = 0;
-  std::unordered_map<Node *, int> map{{start_, id++}};
-  std::stack<Node *> stack;
+  std::unordered_map<uint32_t, int> map{{start_, id++}};
+  std::stack<uint32_t> stack;
   stack.push(start_);
   while (!stack.empty()) {
-    Node *node = stack.top();
+    uint32_t node = stack.top();
     stack.pop();
-    for (const Edge &edge : node->edges) {
+    for (uint32_t i = nodes_[node].begin; i < nodes_[node].end; ++i) {
+      const Edge &edge = edges_[i];
       if (!map.contains(edge.next)) {
         map[edge.next] = id++;
         stack.push(edge.next);
@@ -749,6 +1201,9 @@ void Graph::DrawMermaid() const {
         case Edge::Any:
           s = "any";
           break;
+        case Edge::Arm:
+          s = "arm";
+          break;
         case Edge::Begin:
           s = "begin";
           break;
@@ -765,7 +1220,7 @@ void Graph::DrawMermaid() const {
           s = "func";
           break;
         case Edge::Lower:
-          s = "lower: " + std::to_string(edge.bound->num);
+          s = "lower: " + std::to_string(edge.bound.num);
           break;
         case Edge::Match:
           s = "match";
@@ -790,14 +1245,17 @@ void Graph::DrawMermaid() const {
           break;
         case Edge::Set:
           s = std::string(1, '[') +
-              std::to_string(edge.set->val.pos.ranges.size()) + ']';
+              std::to_string(sets_[edge.set.idx].Count()) + ']';
           break;
         case Edge::SetEx:
           s = std::string("[^") +
-              std::to_string(edge.set->val.pos.ranges.size()) + ']';
+              std::to_string(sets_[edge.set.idx].Count()) + ']';
+          break;
+        case Edge::String:
+          s = "string: " + strings_.substr(edge.str.idx, edge.str.len);
           break;
         case Edge::Upper:
-          s = "upper: " + std::to_string(edge.bound->num);
+          s = "upper: " + std::to_string(edge.bound.num);
           break;
         default:
           break;
@@ -807,7 +1265,7 @@ void Graph::DrawMermaid() const {
       } else {
         printf("%d-->|%s|%d\n", map[node], s.c_str(), map[edge.next]);
       }
-      if (Node::Match == edge.next->status) {
+      if (Node::Match == nodes_[edge.next].status) {
         printf("%d-->|match|%d\n", map[edge.next], map[edge.next]);
       }
     }
@@ -815,10 +1273,4 @@ void Graph::DrawMermaid() const {
   printf("\n");
 }
 
-void Graph::Deallocate() {
-  for (Node *node : nodes_) {
-    delete node;
-  }
-}
-
 }  // namespace regex
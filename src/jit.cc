@@ -0,0 +1,401 @@
+//
+// Copyright [2020] <inhzus>
+//
+
+#include "regex/jit.h"
+
+#ifdef REGEX_JIT
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <initializer_list>
+#endif
+
+namespace regex {
+
+#ifdef REGEX_JIT
+
+namespace {
+
+// Register allocation of the generated code:
+//   rdi text, rsi text size, rdx position, rcx slots, r8 stack top,
+//   r9 stack base, r10 stack end, r12 visited bits, r13 stride,
+//   r15 full match flag, rax/r11/r14 scratch.
+// A stack frame is three words: [0, slot, old value] to restore a slot, or
+// [resume address, position, 0] for a choice point.
+constexpr size_t kFrameSize = 24;
+
+class Assembler {
+ public:
+  explicit Assembler(size_t label_num) : labels_(label_num, kUnbound) {}
+
+  size_t NewLabel() {
+    labels_.push_back(kUnbound);
+    return labels_.size() - 1;
+  }
+  void Bind(size_t label) { labels_[label] = code_.size(); }
+
+  void Emit(std::initializer_list<uint8_t> bytes) {
+    code_.insert(code_.end(), bytes);
+  }
+  void Emit32(uint32_t val) {
+    for (int i = 0; i < 4; ++i) code_.push_back(val >> (i * 8) & 0xff);
+  }
+  // rel32 operand resolved against `label` by `Finish`
+  void EmitRel(size_t label) {
+    fixups_.push_back({code_.size(), label});
+    Emit32(0);
+  }
+  void Jmp(size_t label) {
+    Emit({0xe9});
+    EmitRel(label);
+  }
+  // `cc` is the low nibble of the condition: 2 b, 3 ae, 4 e, 5 ne
+  void Jcc(uint8_t cc, size_t label) {
+    Emit({0x0f, static_cast<uint8_t>(0x80 | cc)});
+    EmitRel(label);
+  }
+  void Align(size_t alignment) {
+    while (code_.size() % alignment) code_.push_back(0xcc);
+  }
+
+  std::vector<uint8_t> Finish() {
+    for (auto [at, label] : fixups_) {
+      auto rel = static_cast<uint32_t>(labels_[label] - (at + 4));
+      for (int i = 0; i < 4; ++i) code_[at + i] = rel >> (i * 8) & 0xff;
+    }
+    return std::move(code_);
+  }
+
+ private:
+  static constexpr size_t kUnbound = static_cast<size_t>(-1);
+
+  struct Fixup {
+    size_t at;
+    size_t label;
+  };
+
+  std::vector<uint8_t> code_;
+  std::vector<size_t> labels_;
+  std::vector<Fixup> fixups_;
+};
+
+constexpr uint8_t kB = 0x2, kAE = 0x3, kE = 0x4, kNE = 0x5;
+
+// cmp r8, r10; jae overflow
+void CheckRoom(Assembler *as, size_t overflow) {
+  as->Emit({0x4d, 0x39, 0xd0});
+  as->Jcc(kAE, overflow);
+}
+
+// cmp rdx, rsi; jae fail
+void CheckLeft(Assembler *as, size_t fail) {
+  as->Emit({0x48, 0x39, 0xf2});
+  as->Jcc(kAE, fail);
+}
+
+}  // namespace
+
+Jit::~Jit() {
+  if (code_ != nullptr) munmap(code_, code_size_);
+}
+
+bool Jit::Build(const Program &program, size_t visit_budget) {
+  if (program.empty() || program.backtrack()) return false;
+  const auto &insts = program.insts();
+  const auto &sets = program.sets();
+  Assembler as(insts.size());
+  size_t fail = as.NewLabel(), overflow = as.NewLabel(),
+         epilogue = as.NewLabel();
+  std::vector<size_t> set_labels;
+  for (size_t i = 0; i < sets.size(); ++i) set_labels.push_back(as.NewLabel());
+
+  // push rbx, r12, r13, r14, r15; mov rbx, rdi
+  as.Emit({0x53, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57});
+  as.Emit({0x48, 0x89, 0xfb});
+  as.Emit({0x48, 0x8b, 0x7b, offsetof(Context, text)});
+  as.Emit({0x48, 0x8b, 0x73, offsetof(Context, size)});
+  as.Emit({0x48, 0x8b, 0x53, offsetof(Context, pos)});
+  as.Emit({0x48, 0x8b, 0x4b, offsetof(Context, slots)});
+  as.Emit({0x4c, 0x8b, 0x43, offsetof(Context, stack)});
+  as.Emit({0x4d, 0x89, 0xc1});  // mov r9, r8
+  as.Emit({0x4c, 0x8b, 0x53, offsetof(Context, stack_end)});
+  as.Emit({0x4c, 0x8b, 0x63, offsetof(Context, visited)});
+  as.Emit({0x4c, 0x8b, 0x6b, offsetof(Context, stride)});
+  as.Emit({0x4c, 0x8b, 0x7b, offsetof(Context, full)});
+
+  for (uint32_t pc = 0; pc < insts.size(); ++pc) {
+    as.Bind(pc);
+    const Inst &inst = insts[pc];
+    switch (inst.op) {
+      case Inst::Any: {
+        CheckLeft(&as, fail);
+        as.Emit({0x48, 0xff, 0xc2});  // inc rdx
+        break;
+      }
+      case Inst::Begin: {
+        as.Emit({0x48, 0x85, 0xd2});  // test rdx, rdx
+        as.Jcc(kNE, fail);
+        break;
+      }
+      case Inst::Char: {
+        CheckLeft(&as, fail);
+        // cmp byte [rdi + rdx], imm8
+        as.Emit({0x80, 0x3c, 0x17, static_cast<uint8_t>(inst.ch.val)});
+        as.Jcc(kNE, fail);
+        as.Emit({0x48, 0xff, 0xc2});
+        break;
+      }
+      case Inst::End: {
+        as.Emit({0x48, 0x39, 0xf2});  // cmp rdx, rsi
+        as.Jcc(kNE, fail);
+        break;
+      }
+      case Inst::Jmp: {
+        if (inst.jmp.x != pc + 1) as.Jmp(inst.jmp.x);
+        break;
+      }
+      case Inst::Mark:
+      case Inst::Save: {
+        uint32_t disp = inst.save.slot * 8;
+        CheckRoom(&as, overflow);
+        as.Emit({0x49, 0xc7, 0x00});  // mov qword [r8], 0
+        as.Emit32(0);
+        as.Emit({0x49, 0xc7, 0x40, 0x08});  // mov qword [r8 + 8], slot
+        as.Emit32(inst.save.slot);
+        as.Emit({0x48, 0x8b, 0x81});  // mov rax, [rcx + disp]
+        as.Emit32(disp);
+        as.Emit({0x49, 0x89, 0x40, 0x10});  // mov [r8 + 16], rax
+        as.Emit({0x49, 0x83, 0xc0, kFrameSize});  // add r8, 24
+        as.Emit({0x48, 0x89, 0x91});  // mov [rcx + disp], rdx
+        as.Emit32(disp);
+        break;
+      }
+      case Inst::Match: {
+        // only the full match needs the end of the text
+        size_t ok = as.NewLabel();
+        as.Emit({0x4d, 0x85, 0xff});  // test r15, r15
+        as.Jcc(kE, ok);
+        as.Emit({0x48, 0x39, 0xf2});
+        as.Jcc(kNE, fail);
+        as.Bind(ok);
+        as.Emit({0xb8});  // mov eax, 1
+        as.Emit32(1);
+        as.Jmp(epilogue);
+        break;
+      }
+      case Inst::Progress: {
+        as.Emit({0x48, 0x39, 0x91});  // cmp [rcx + disp], rdx
+        as.Emit32(inst.mark.slot * 8);
+        as.Jcc(kE, fail);
+        break;
+      }
+      case Inst::Set:
+      case Inst::SetEx: {
+        CheckLeft(&as, fail);
+        as.Emit({0x0f, 0xb6, 0x04, 0x17});  // movzx eax, byte [rdi + rdx]
+        as.Emit({0x4c, 0x8d, 0x35});        // lea r14, [rip + bitmap]
+        as.EmitRel(set_labels[inst.set.idx]);
+        as.Emit({0x49, 0x0f, 0xa3, 0x06});  // bt [r14], rax
+        as.Jcc(inst.op == Inst::Set ? kAE : kB, fail);
+        as.Emit({0x48, 0xff, 0xc2});
+        break;
+      }
+      case Inst::Split: {
+        // skip (pc, position) pairs already known to fail
+        as.Emit({0xb8});  // mov eax, pc
+        as.Emit32(pc);
+        as.Emit({0x49, 0x0f, 0xaf, 0xc5});  // imul rax, r13
+        as.Emit({0x48, 0x01, 0xd0});        // add rax, rdx
+        as.Emit({0x49, 0x0f, 0xab, 0x04, 0x24});  // bts [r12], rax
+        as.Jcc(kB, fail);
+        if (program.possessive(pc)) {
+          // the next byte alone tells which branch may match, no choice
+          // point is pushed
+          const Inst &next = insts[inst.split.x];
+          CheckLeft(&as, inst.split.y);
+          if (next.op == Inst::Char) {
+            // cmp byte [rdi + rdx], imm8
+            as.Emit({0x80, 0x3c, 0x17, static_cast<uint8_t>(next.ch.val)});
+            as.Jcc(kNE, inst.split.y);
+          } else if (next.op != Inst::Any) {
+            as.Emit({0x0f, 0xb6, 0x04, 0x17});  // movzx eax, byte [rdi + rdx]
+            as.Emit({0x4c, 0x8d, 0x35});        // lea r14, [rip + bitmap]
+            as.EmitRel(set_labels[next.set.idx]);
+            as.Emit({0x49, 0x0f, 0xa3, 0x06});  // bt [r14], rax
+            as.Jcc(next.op == Inst::Set ? kAE : kB, inst.split.y);
+          }
+          if (inst.split.x != pc + 1) as.Jmp(inst.split.x);
+          break;
+        }
+        CheckRoom(&as, overflow);
+        as.Emit({0x48, 0x8d, 0x05});  // lea rax, [rip + y]
+        as.EmitRel(inst.split.y);
+        as.Emit({0x49, 0x89, 0x00});        // mov [r8], rax
+        as.Emit({0x49, 0x89, 0x50, 0x08});  // mov [r8 + 8], rdx
+        as.Emit({0x49, 0xc7, 0x40, 0x10});  // mov qword [r8 + 16], 0
+        as.Emit32(0);
+        as.Emit({0x49, 0x83, 0xc0, kFrameSize});
+        if (inst.split.x != pc + 1) as.Jmp(inst.split.x);
+        break;
+      }
+      default: {
+        return false;
+      }
+    }
+  }
+
+  // pop frames until a choice point, restoring slots on the way
+  size_t restore = as.NewLabel(), empty = as.NewLabel();
+  as.Bind(fail);
+  as.Emit({0x4d, 0x39, 0xc8});  // cmp r8, r9
+  as.Jcc(kE, empty);
+  as.Emit({0x49, 0x83, 0xe8, kFrameSize});  // sub r8, 24
+  as.Emit({0x49, 0x8b, 0x00});              // mov rax, [r8]
+  as.Emit({0x48, 0x85, 0xc0});              // test rax, rax
+  as.Jcc(kE, restore);
+  as.Emit({0x49, 0x8b, 0x50, 0x08});  // mov rdx, [r8 + 8]
+  as.Emit({0xff, 0xe0});              // jmp rax
+  as.Bind(restore);
+  as.Emit({0x4d, 0x8b, 0x58, 0x08});  // mov r11, [r8 + 8]
+  as.Emit({0x49, 0x8b, 0x40, 0x10});  // mov rax, [r8 + 16]
+  as.Emit({0x4a, 0x89, 0x04, 0xd9});  // mov [rcx + r11 * 8], rax
+  as.Jmp(fail);
+  as.Bind(empty);
+  as.Emit({0x31, 0xc0});  // xor eax, eax
+  as.Jmp(epilogue);
+  as.Bind(overflow);
+  as.Emit({0x48, 0xc7, 0xc0});  // mov rax, -1
+  as.Emit32(static_cast<uint32_t>(-1));
+  as.Bind(epilogue);
+  // pop r15, r14, r13, r12, rbx; ret
+  as.Emit({0x41, 0x5f, 0x41, 0x5e, 0x41, 0x5d, 0x41, 0x5c, 0x5b, 0xc3});
+
+  as.Align(32);
+  for (size_t i = 0; i < sets.size(); ++i) {
+    as.Bind(set_labels[i]);
+    const auto *bitmap = reinterpret_cast<const uint8_t *>(sets[i].bits());
+    for (int j = 0; j < 32; ++j) as.Emit({bitmap[j]});
+  }
+
+  std::vector<uint8_t> code = as.Finish();
+  // written while only writable, then only executable
+  size_t size = code.size();
+  void *page = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (page == MAP_FAILED) return false;
+  std::memcpy(page, code.data(), size);
+  if (mprotect(page, size, PROT_READ | PROT_EXEC) != 0) {
+    munmap(page, size);
+    return false;
+  }
+  if (code_ != nullptr) munmap(code_, code_size_);
+  code_ = page;
+  code_size_ = size;
+  inst_num_ = insts.size();
+  slot_num_ = program.slot_num();
+  group_num_ = program.group_num();
+  visit_budget_ = visit_budget;
+  anchored_ = program.anchored();
+  prefix_ = program.prefix();
+  first_ = program.first();
+  return true;
+}
+
+Jit::Status Jit::Search(std::string_view s, size_t begin,
+                        std::vector<size_t> *slots, Anchor anchor) const {
+  // most searches fit in a small stack, the others run again from the start
+  // with the largest one
+  uint64_t stack[kInlineFrames * kFrameSize / 8];
+  Scratch scratch;
+  Status status =
+      Search(s, begin, slots, anchor, stack, kInlineFrames, &scratch);
+  if (status != GaveUp) return status;
+  scratch.stack.resize(kMaxFrames * kFrameSize / 8);
+  return Search(s, begin, slots, anchor, scratch.stack.data(), kMaxFrames,
+                &scratch);
+}
+
+Jit::Status Jit::Search(std::string_view s, size_t begin,
+                        std::vector<size_t> *slots, Anchor anchor,
+                        Scratch *scratch) const {
+  // the stack stays at its largest size once a search needed it
+  if (scratch->stack.empty()) {
+    scratch->stack.resize(kInlineFrames * kFrameSize / 8);
+  }
+  size_t frames = scratch->stack.size() * 8 / kFrameSize;
+  Status status = Search(s, begin, slots, anchor, scratch->stack.data(),
+                         frames, scratch);
+  if (status != GaveUp || frames == kMaxFrames) return status;
+  scratch->stack.resize(kMaxFrames * kFrameSize / 8);
+  return Search(s, begin, slots, anchor, scratch->stack.data(), kMaxFrames,
+                scratch);
+}
+
+Jit::Status Jit::Search(std::string_view s, size_t begin,
+                        std::vector<size_t> *slots, Anchor anchor,
+                        uint64_t *stack, size_t frames,
+                        Scratch *scratch) const {
+  Context ctx{};
+  ctx.text = s.data();
+  ctx.size = s.size();
+  ctx.stack = stack;
+  ctx.stack_end = stack + frames * kFrameSize / 8;
+  ctx.stride = s.size() + 1;
+  ctx.full = anchor == AnchorBoth;
+  // failures do not depend on where the search started, so the visited set
+  // is shared by every start. Without it the search is exponential on
+  // ambiguous patterns, the linear interpreter runs instead.
+  size_t bits = inst_num_ * (s.size() + 1);
+  if (bits > visit_budget_) return GaveUp;
+  scratch->visited.assign((bits + 63) / 64, 0);
+  ctx.visited = scratch->visited.data();
+  std::vector<uint64_t> &regs = scratch->regs;
+  regs.resize(slot_num_);
+  ctx.slots = regs.data();
+  auto run = reinterpret_cast<Function>(code_);
+  size_t last = anchor != Unanchored || anchored_ ? 0 : s.size();
+  if (last == 0) begin = 0;
+  for (size_t start = begin; start <= last; ++start) {
+    if (last != 0 && !prefix_.empty()) start = prefix_.Find(s, start);
+    if (last != 0 && prefix_.empty() && !first_.full()) {
+      start = first_.Find(s, start);
+    }
+    if (start == Prefix::npos) break;
+    std::fill(regs.begin(), regs.end(), Program::kUnset);
+    ctx.pos = start;
+    switch (run(&ctx)) {
+      case 1:
+        slots->assign(regs.begin(), regs.begin() + group_num_ * 2);
+        return Matched;
+      case 0:
+        break;
+      default:
+        return GaveUp;
+    }
+  }
+  return NoMatch;
+}
+
+#else  // REGEX_JIT
+
+// elsewhere nothing is generated and the interpreters run every program
+Jit::~Jit() = default;
+
+bool Jit::Build(const Program &, size_t) { return false; }
+
+Jit::Status Jit::Search(std::string_view, size_t, std::vector<size_t> *,
+                        Anchor) const {
+  return GaveUp;
+}
+
+Jit::Status Jit::Search(std::string_view, size_t, std::vector<size_t> *,
+                        Anchor, Scratch *) const {
+  return GaveUp;
+}
+
+#endif  // REGEX_JIT
+
+}  // namespace regex
@@ -0,0 +1,145 @@
+//
+// Copyright [2020] <inhzus>
+//
+
+#include "regex/pike.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace regex {
+
+PikeVm::PikeVm(const Program &program)
+    : program_(program),
+      slot_num_(program.group_num() * 2),
+      init_(slot_num_, Program::kUnset),
+      cur_(program.insts().size(), slot_num_),
+      next_(program.insts().size(), slot_num_) {
+  assert(!program.backtrack());
+}
+
+void PikeVm::AddThread(Threads *threads, uint32_t pc, size_t pos,
+                       size_t *slots) {
+  const auto &insts = program_.insts();
+  stack_.push_back({Frame::Explore, pc, 0});
+  while (!stack_.empty()) {
+    Frame frame = stack_.back();
+    stack_.pop_back();
+    if (frame.kind == Frame::Restore) {
+      slots[frame.pc] = frame.val;
+      continue;
+    }
+    pc = frame.pc;
+    bool stop = false;
+    while (!stop && !threads->Contains(pc)) {
+      threads->Insert(pc);
+      const Inst &inst = insts[pc];
+      switch (inst.op) {
+        case Inst::Begin: {
+          stop = pos != 0;
+          ++pc;
+          break;
+        }
+        case Inst::End: {
+          stop = pos != s_.size();
+          ++pc;
+          break;
+        }
+        case Inst::Jmp: {
+          pc = inst.jmp.x;
+          break;
+        }
+        case Inst::Mark:
+        case Inst::Progress: {
+          // an empty iteration reaches the loop head again at the same
+          // position, which is already in `threads`
+          ++pc;
+          break;
+        }
+        case Inst::Save: {
+          stack_.push_back({Frame::Restore, inst.save.slot,
+                            slots[inst.save.slot]});
+          slots[inst.save.slot] = pos;
+          ++pc;
+          break;
+        }
+        case Inst::Split: {
+          stack_.push_back({Frame::Explore, inst.split.y, 0});
+          pc = inst.split.x;
+          break;
+        }
+        default: {
+          // the thread waits for the next character or matches
+          std::copy(slots, slots + slot_num_,
+                    threads->slots.begin() + pc * slot_num_);
+          stop = true;
+          break;
+        }
+      }
+    }
+  }
+}
+
+bool PikeVm::Search(std::string_view s, size_t begin, size_t end,
+                    std::vector<size_t> *slots, Anchor anchor) {
+  const auto &insts = program_.insts();
+  const auto &sets = program_.sets();
+  s_ = s;
+  bool matched = false;
+  cur_.size = 0;
+  bool anchored = anchor != Unanchored || program_.anchored();
+  for (size_t pos = begin;; ++pos) {
+    if (anchored && pos > begin && cur_.size == 0) break;
+    // without threads, skip to where the next match may begin
+    if (!anchored && !matched && cur_.size == 0 &&
+        (pos = program_.FindStart(s.substr(0, end), pos)) == Prefix::npos) {
+      break;
+    }
+    // a new thread starting at `pos` has the lowest priority, and none is
+    // started once a match is found
+    if (!matched && (!anchored || pos == begin)) {
+      AddThread(&cur_, 0, pos, init_.data());
+    }
+    if (matched && cur_.size == 0) break;
+    next_.size = 0;
+    for (uint32_t i = 0; i < cur_.size; ++i) {
+      uint32_t pc = cur_.dense[i];
+      const Inst &inst = insts[pc];
+      size_t *thread_slots = &cur_.slots[pc * slot_num_];
+      bool step = false;
+      switch (inst.op) {
+        case Inst::Any: {
+          step = pos < end;
+          break;
+        }
+        case Inst::Char: {
+          step = pos < end && s[pos] == inst.ch.val;
+          break;
+        }
+        case Inst::Set:
+        case Inst::SetEx: {
+          step = pos < end && sets[inst.set.idx].Contains(s[pos]) ==
+                                  (inst.op == Inst::Set);
+          break;
+        }
+        case Inst::Match: {
+          if (anchor == AnchorBoth && pos != s.size()) break;
+          // threads of lower priority are cut off
+          matched = true;
+          slots->assign(thread_slots, thread_slots + slot_num_);
+          i = cur_.size;
+          break;
+        }
+        default: {
+          break;
+        }
+      }
+      if (step) AddThread(&next_, pc + 1, pos + 1, thread_slots);
+    }
+    if (pos == end) break;
+    std::swap(cur_, next_);
+  }
+  return matched;
+}
+
+}  // namespace regex
@@ -0,0 +1,311 @@
+//
+// Copyright [2020] <inhzus>
+//
+
+#include "regex/prefilter.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define REGEX_TEDDY 1
+#endif
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+namespace regex {
+
+using Strings = std::vector<std::string>;
+
+// What is known about the strings matched by a sub-expression. `exact` is the
+// whole language when not empty; every match begins with some `prefix`, ends
+// with some `suffix` and contains some `inner` literal. A set holding the
+// empty string carries no information.
+struct Factors {
+  Strings exact;
+  Strings prefix;
+  Strings suffix;
+  Strings inner;
+};
+
+static const Strings kUnknown{""};
+
+static Strings Normalize(Strings lits) {
+  std::sort(lits.begin(), lits.end());
+  lits.erase(std::unique(lits.begin(), lits.end()), lits.end());
+  if (lits.size() > Prefilter::kMaxLiterals) return kUnknown;
+  if (!lits.empty() && lits[0].empty()) return kUnknown;
+  return lits;
+}
+
+static Strings Union(Strings lits, const Strings &other) {
+  lits.insert(lits.end(), other.begin(), other.end());
+  std::sort(lits.begin(), lits.end());
+  lits.erase(std::unique(lits.begin(), lits.end()), lits.end());
+  return lits;
+}
+
+// Every concatenation of `front` and `back`, empty if there are too many.
+static Strings Cross(const Strings &front, const Strings &back) {
+  if (front.size() * back.size() > Prefilter::kMaxLiterals) return {};
+  Strings lits;
+  for (const auto &lit : front) {
+    for (const auto &next : back) lits.push_back(lit + next);
+  }
+  return Union({}, lits);
+}
+
+// Bytes other than lowercase letters, digits and spaces are taken as twice
+// as rare, a set is as rare as its most common literal.
+static size_t Rarity(const Strings &lits) {
+  if (lits.empty() || lits[0].empty()) return 0;
+  size_t rarity = SIZE_MAX;
+  for (const auto &lit : lits) {
+    size_t score = 0;
+    for (char ch : lit) {
+      bool common = (ch >= 'a' && ch <= 'z') || (ch >= '0' && ch <= '9') ||
+                    ch == ' ';
+      score += common ? 1 : 2;
+    }
+    rarity = std::min(rarity, score);
+  }
+  return rarity;
+}
+
+static Strings Rarest(std::initializer_list<const Strings *> candidates) {
+  const Strings *best = &kUnknown;
+  for (const Strings *lits : candidates) {
+    if (lits->empty() || Normalize(*lits) != *lits) continue;
+    size_t rarity = Rarity(*lits), best_rarity = Rarity(*best);
+    if (rarity > best_rarity ||
+        (rarity == best_rarity && lits->size() < best->size())) {
+      best = lits;
+    }
+  }
+  return *best;
+}
+
+static Factors Any() { return {{}, kUnknown, kUnknown, kUnknown}; }
+static Factors Empty() { return {{""}, kUnknown, kUnknown, kUnknown}; }
+
+static Factors Concat(const Factors &front, const Factors &back) {
+  Factors factors;
+  if (!front.exact.empty() && !back.exact.empty()) {
+    factors.exact = Cross(front.exact, back.exact);
+  }
+  factors.prefix = front.prefix;
+  if (!front.exact.empty()) {
+    Strings prefix(Cross(front.exact, back.prefix));
+    factors.prefix = Normalize(prefix.empty() ? front.exact : prefix);
+  }
+  factors.suffix = back.suffix;
+  if (!back.exact.empty()) {
+    Strings suffix(Cross(front.suffix, back.exact));
+    factors.suffix = Normalize(suffix.empty() ? back.exact : suffix);
+  }
+  Strings junction(Normalize(Cross(front.suffix, back.prefix)));
+  factors.inner = Rarest({&front.inner, &back.inner, &junction,
+                          &factors.prefix, &factors.suffix, &factors.exact});
+  return factors;
+}
+
+static Factors Either(const Factors &left, const Factors &right) {
+  Factors factors;
+  if (!left.exact.empty() && !right.exact.empty()) {
+    factors.exact = Union(left.exact, right.exact);
+    if (factors.exact.size() > Prefilter::kMaxLiterals) factors.exact.clear();
+  }
+  factors.prefix = Normalize(Union(left.prefix, right.prefix));
+  factors.suffix = Normalize(Union(left.suffix, right.suffix));
+  factors.inner = Normalize(Union(left.inner, right.inner));
+  return factors;
+}
+
+// One or more repetitions of `elem`.
+static Factors Repeated(const Factors &elem) {
+  Strings exact(Normalize(elem.exact));
+  return {{}, elem.prefix, elem.suffix, Rarest({&elem.inner, &exact})};
+}
+
+bool Prefilter::Build(const Exp &exp) {
+  literals_.clear();
+  leading_ = false;
+  std::vector<Factors> stack;
+  auto pop = [&stack]() {
+    Factors factors(std::move(stack.back()));
+    stack.pop_back();
+    return factors;
+  };
+  for (const auto &id : exp.ids) {
+    switch (static_cast<int>(id.sym)) {
+      case Id::Sym::AheadPr:
+      case Id::Sym::NegAheadPr: {
+        pop();
+        stack.push_back(Empty());
+        break;
+      }
+      case Id::Sym::Begin:
+      case Id::Sym::End: {
+        stack.push_back(Empty());
+        break;
+      }
+      case Id::Sym::Char: {
+        Strings lit{std::string(1, id.ch)};
+        stack.push_back({lit, lit, lit, lit});
+        break;
+      }
+      case Id::Sym::Concat: {
+        Factors back(pop());
+        stack.back() = Concat(stack.back(), back);
+        break;
+      }
+      case Id::Sym::Either: {
+        Factors right(pop());
+        stack.back() = Either(stack.back(), right);
+        break;
+      }
+      case Id::Sym::More:
+      case Id::Sym::PosMore:
+      case Id::Sym::RelMore: {
+        stack.back() = Any();
+        break;
+      }
+      case Id::Sym::Plus:
+      case Id::Sym::PosPlus:
+      case Id::Sym::RelPlus: {
+        stack.back() = Repeated(stack.back());
+        break;
+      }
+      case Id::Sym::Quest:
+      case Id::Sym::PosQuest:
+      case Id::Sym::RelQuest: {
+        Factors factors(Any());
+        if (!stack.back().exact.empty()) {
+          factors.exact = Union(stack.back().exact, {""});
+        }
+        stack.back() = std::move(factors);
+        break;
+      }
+      case Id::Sym::Repeat:
+      case Id::Sym::PosRepeat:
+      case Id::Sym::RelRepeat: {
+        stack.back() =
+            id.repeat->lower == 0 ? Any() : Repeated(stack.back());
+        break;
+      }
+      case Id::Sym::Set:
+      case Id::Sym::SetEx: {
+        Strings lits;
+        for (size_t byte = 0; byte < 256; ++byte) {
+          auto ch = static_cast<char>(byte);
+          if (id.set->val.Contains(ch) == (id.sym == Id::Sym::Set)) {
+            lits.emplace_back(1, ch);
+          }
+        }
+        if (lits.size() > kMaxLiterals) {
+          stack.push_back(Any());
+        } else {
+          stack.push_back({lits, lits, lits, lits});
+        }
+        break;
+      }
+      case Id::Sym::Any:
+      case Id::Sym::RefPr: {
+        stack.push_back(Any());
+        break;
+      }
+      default: {
+        break;
+      }
+    }
+  }
+  if (stack.empty()) return false;
+  const Factors &root = stack.back();
+  Strings exact(Normalize(root.exact));
+  Strings lits(Rarest({&root.inner, &root.prefix, &root.suffix, &exact}));
+  if (lits[0].empty()) return false;
+  leading_ = lits == Normalize(root.prefix);
+  literals_ = std::move(lits);
+
+  // the fingerprint is as long as the shortest literal allows
+  fingerprint_ = kMaxFingerprint;
+  for (const auto &lit : literals_) {
+    fingerprint_ = std::min(fingerprint_, lit.size());
+  }
+  std::memset(lo_, 0, sizeof(lo_));
+  std::memset(hi_, 0, sizeof(hi_));
+  std::memset(first_, 0, sizeof(first_));
+  for (size_t b = 0; b < literals_.size(); ++b) {
+    auto bit = static_cast<uint8_t>(1 << b);
+    for (size_t i = 0; i < fingerprint_; ++i) {
+      auto byte = static_cast<uint8_t>(literals_[b][i]);
+      lo_[i][byte & 0xf] |= bit;
+      hi_[i][byte >> 4] |= bit;
+    }
+    first_[static_cast<uint8_t>(literals_[b][0])] |= bit;
+  }
+  return true;
+}
+
+bool Prefilter::Verify(std::string_view s, size_t pos, uint8_t buckets) const {
+  for (; buckets != 0; buckets &= buckets - 1) {
+    const std::string &lit = literals_[__builtin_ctz(buckets)];
+    if (s.compare(pos, lit.size(), lit) == 0) return true;
+  }
+  return false;
+}
+
+#ifdef REGEX_TEDDY
+__attribute__((target("ssse3"))) bool Prefilter::Teddy(std::string_view s,
+                                                       size_t *pos) const {
+  const __m128i nibble = _mm_set1_epi8(0x0f);
+  __m128i lo[kMaxFingerprint], hi[kMaxFingerprint];
+  for (size_t i = 0; i < fingerprint_; ++i) {
+    lo[i] = _mm_load_si128(reinterpret_cast<const __m128i *>(lo_[i]));
+    hi[i] = _mm_load_si128(reinterpret_cast<const __m128i *>(hi_[i]));
+  }
+  size_t p = *pos;
+  for (; p + fingerprint_ - 1 + 16 <= s.size(); p += 16) {
+    // lane j keeps the literals whose fingerprint matches at p + j
+    __m128i res = _mm_set1_epi8(-1);
+    for (size_t i = 0; i < fingerprint_; ++i) {
+      __m128i chunk =
+          _mm_loadu_si128(reinterpret_cast<const __m128i *>(s.data() + p + i));
+      __m128i low = _mm_and_si128(chunk, nibble);
+      __m128i high = _mm_and_si128(_mm_srli_epi16(chunk, 4), nibble);
+      res = _mm_and_si128(res, _mm_and_si128(_mm_shuffle_epi8(lo[i], low),
+                                             _mm_shuffle_epi8(hi[i], high)));
+    }
+    int mask = ~_mm_movemask_epi8(_mm_cmpeq_epi8(res, _mm_setzero_si128())) &
+               0xffff;
+    if (mask == 0) continue;
+    alignas(16) uint8_t lanes[16];
+    _mm_store_si128(reinterpret_cast<__m128i *>(lanes), res);
+    for (; mask != 0; mask &= mask - 1) {
+      int j = __builtin_ctz(mask);
+      if (Verify(s, p + j, lanes[j])) {
+        *pos = p + j;
+        return true;
+      }
+    }
+  }
+  *pos = p;
+  return false;
+}
+#else
+bool Prefilter::Teddy(std::string_view, size_t *) const { return false; }
+#endif
+
+size_t Prefilter::Find(std::string_view s, size_t pos) const {
+#ifdef REGEX_TEDDY
+  static const bool kSsse3 = __builtin_cpu_supports("ssse3");
+  if (kSsse3 && Teddy(s, &pos)) return pos;
+#endif
+  for (; pos < s.size(); ++pos) {
+    uint8_t buckets = first_[static_cast<uint8_t>(s[pos])];
+    if (buckets != 0 && Verify(s, pos, buckets)) return pos;
+  }
+  return npos;
+}
+
+}  // namespace regex
@@ -0,0 +1,222 @@
+//
+// Copyright [2020] <inhzus>
+//
+
+#include "regex/prefix.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+namespace regex {
+
+// Literals a sub-expression may begin with. An exact literal is everything
+// the sub-expression matches, so what follows may extend it; the others are
+// only prefixes. The empty inexact literal stands for "anything".
+struct Literal {
+  std::string s;
+  bool exact;
+
+  bool operator==(const Literal &lit) const {
+    return s == lit.s && exact == lit.exact;
+  }
+};
+using Literals = std::vector<Literal>;
+
+static Literals Anything() { return {{"", false}}; }
+
+static Literals Inexact(Literals lits) {
+  for (auto &lit : lits) lit.exact = false;
+  return lits;
+}
+
+static Literals Union(Literals lits, const Literals &other) {
+  for (const auto &lit : other) {
+    if (std::find(lits.begin(), lits.end(), lit) == lits.end()) {
+      lits.push_back(lit);
+    }
+  }
+  if (lits.size() > Prefix::kMaxLiterals) return Anything();
+  return lits;
+}
+
+static Literals Concat(const Literals &front, const Literals &back) {
+  Literals lits;
+  for (const auto &lit : front) {
+    if (!lit.exact) {
+      lits.push_back(lit);
+      continue;
+    }
+    for (const auto &next : back) {
+      Literal cat{lit.s + next.s, next.exact};
+      if (cat.s.size() > Prefix::kMaxLength) {
+        cat.s.resize(Prefix::kMaxLength);
+        cat.exact = false;
+      }
+      lits.push_back(std::move(cat));
+    }
+  }
+  // too many combinations, keep the front as prefixes
+  if (lits.size() > Prefix::kMaxLiterals) return Inexact(front);
+  return Union({}, lits);
+}
+
+bool Prefix::Build(const Exp &exp) {
+  literals_.clear();
+  std::vector<Literals> stack;
+  auto pop = [&stack]() {
+    Literals lits(std::move(stack.back()));
+    stack.pop_back();
+    return lits;
+  };
+  for (const auto &id : exp.ids) {
+    switch (static_cast<int>(id.sym)) {
+      case Id::Sym::AheadPr:
+      case Id::Sym::NegAheadPr: {
+        // zero-width, the body says nothing about the match itself
+        pop();
+        stack.push_back({{"", true}});
+        break;
+      }
+      case Id::Sym::Any: {
+        stack.push_back(Anything());
+        break;
+      }
+      case Id::Sym::Begin:
+      case Id::Sym::End: {
+        stack.push_back({{"", true}});
+        break;
+      }
+      case Id::Sym::Char: {
+        stack.push_back({{std::string(1, id.ch), true}});
+        break;
+      }
+      case Id::Sym::Concat: {
+        Literals back(pop());
+        stack.back() = Concat(stack.back(), back);
+        break;
+      }
+      case Id::Sym::Either: {
+        Literals right(pop());
+        stack.back() = Union(std::move(stack.back()), right);
+        break;
+      }
+      case Id::Sym::More:
+      case Id::Sym::PosMore:
+      case Id::Sym::RelMore: {
+        Literals elem(Inexact(pop()));
+        stack.push_back(Union({{"", true}}, elem));
+        break;
+      }
+      case Id::Sym::Plus:
+      case Id::Sym::PosPlus:
+      case Id::Sym::RelPlus: {
+        stack.back() = Inexact(std::move(stack.back()));
+        break;
+      }
+      case Id::Sym::Quest:
+      case Id::Sym::PosQuest:
+      case Id::Sym::RelQuest: {
+        stack.back() = Union(std::move(stack.back()), {{"", true}});
+        break;
+      }
+      case Id::Sym::RefPr: {
+        stack.push_back(Anything());
+        break;
+      }
+      case Id::Sym::Repeat:
+      case Id::Sym::PosRepeat:
+      case Id::Sym::RelRepeat: {
+        Literals elem(Inexact(pop()));
+        if (id.repeat->lower == 0) elem = Union({{"", true}}, elem);
+        stack.push_back(std::move(elem));
+        break;
+      }
+      case Id::Sym::Set:
+      case Id::Sym::SetEx: {
+        Literals lits;
+        for (size_t byte = 0; byte < 256; ++byte) {
+          auto ch = static_cast<char>(byte);
+          if (id.set->val.Contains(ch) != (id.sym == Id::Sym::Set)) continue;
+          if (lits.size() == kMaxLiterals) {
+            lits = Anything();
+            break;
+          }
+          lits.push_back({std::string(1, ch), true});
+        }
+        stack.push_back(std::move(lits));
+        break;
+      }
+      default: {
+        break;
+      }
+    }
+  }
+  if (stack.empty()) return false;
+  for (const auto &lit : stack.back()) {
+    if (lit.s.empty()) return false;
+  }
+  for (const auto &lit : stack.back()) literals_.push_back(lit.s);
+  // a literal extending another one never adds a candidate
+  std::sort(literals_.begin(), literals_.end());
+  auto last = std::unique(
+      literals_.begin(), literals_.end(),
+      [](const std::string &prev, const std::string &lit) {
+        return lit.compare(0, prev.size(), prev) == 0;
+      });
+  literals_.erase(last, literals_.end());
+
+  first_bytes_.clear();
+  std::fill(first_table_, first_table_ + 256, false);
+  for (const auto &lit : literals_) {
+    if (first_table_[static_cast<uint8_t>(lit[0])]) continue;
+    first_table_[static_cast<uint8_t>(lit[0])] = true;
+    first_bytes_.push_back(lit[0]);
+  }
+  return true;
+}
+
+size_t Prefix::FindFirstByte(std::string_view s, size_t pos) const {
+#ifdef __SSE2__
+  for (; pos + 16 <= s.size(); pos += 16) {
+    __m128i chunk =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(s.data() + pos));
+    __m128i eq = _mm_setzero_si128();
+    for (char ch : first_bytes_) {
+      eq = _mm_or_si128(eq, _mm_cmpeq_epi8(chunk, _mm_set1_epi8(ch)));
+    }
+    int mask = _mm_movemask_epi8(eq);
+    if (mask != 0) return pos + __builtin_ctz(mask);
+  }
+#endif
+  for (; pos < s.size(); ++pos) {
+    if (first_table_[static_cast<uint8_t>(s[pos])]) return pos;
+  }
+  return npos;
+}
+
+size_t Prefix::Find(std::string_view s, size_t pos) const {
+  if (pos >= s.size()) return npos;
+  if (literals_.size() == 1) {
+    const std::string &lit = literals_[0];
+    const void *found =
+        lit.size() == 1
+            ? memchr(s.data() + pos, lit[0], s.size() - pos)
+            : memmem(s.data() + pos, s.size() - pos, lit.data(), lit.size());
+    if (found == nullptr) return npos;
+    return static_cast<const char *>(found) - s.data();
+  }
+  // look for the first bytes of the literals, then verify the candidates
+  for (; (pos = FindFirstByte(s, pos)) != npos; ++pos) {
+    for (const auto &lit : literals_) {
+      if (s.compare(pos, lit.size(), lit) == 0) return pos;
+    }
+  }
+  return npos;
+}
+
+}  // namespace regex
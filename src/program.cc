@@ -0,0 +1,584 @@
+//
+// Copyright [2020] <inhzus>
+//
+
+#include "regex/program.h"
+
+#include <algorithm>
+#include <cassert>
+#include <limits>
+#include <stack>
+#include <utility>
+
+namespace regex {
+
+// A compiled piece of the postfix expression. Jump targets are relative to
+// the beginning of `insts`, and the fragment exits by falling through its
+// last instruction.
+struct Fragment {
+  Fragment() : nullable(true), anchored(false) {}
+  explicit Fragment(Inst &&inst, bool nullable)
+      : nullable(nullable), anchored(false) {
+    insts.push_back(inst);
+  }
+
+  [[nodiscard]] uint32_t size() const { return insts.size(); }
+  Fragment &Push(Inst inst) {
+    insts.push_back(inst);
+    return *this;
+  }
+  Fragment &Append(const Fragment &frag) {
+    uint32_t offset = size();
+    for (Inst inst : frag.insts) {
+      inst.Relocate(offset);
+      insts.push_back(inst);
+    }
+    return *this;
+  }
+
+  std::vector<Inst> insts;
+  bool nullable;  // whether the fragment may match the empty string
+  bool anchored;  // whether every path through it begins with "^"
+};
+
+// Loop over `elem` as "*" (`min` == 0) or "+" (`min` == 1). Iterations of a
+// nullable `elem` are guarded by Mark/Progress, otherwise an empty iteration
+// would loop forever.
+static Fragment Loop(const Fragment &elem, size_t min, bool greedy,
+                     uint32_t slot) {
+  Fragment frag;
+  uint32_t n = elem.size();
+  auto split = [greedy](uint32_t loop, uint32_t exit) {
+    return greedy ? Inst::SplitInst(loop, exit) : Inst::SplitInst(exit, loop);
+  };
+  if (min == 1 && !elem.nullable) {
+    // elem-->split-->
+    //  |<-----|
+    frag.Append(elem).Push(split(0, n + 1));
+    frag.nullable = false;
+    frag.anchored = elem.anchored;
+    return frag;
+  }
+  // a nullable "+" runs its first iteration unguarded: elem-->elem*
+  if (min == 1) frag.Append(elem);
+  //      |----------------------------------->|
+  // split-->[mark]-->elem-->[progress]-->jmp split
+  uint32_t head = frag.size();
+  if (!elem.nullable) {
+    frag.Push(split(head + 1, head + n + 2))
+        .Append(elem)
+        .Push(Inst::JmpInst(head));
+  } else {
+    frag.Push(split(head + 1, head + n + 4))
+        .Push(Inst::MarkInst(slot))
+        .Append(elem)
+        .Push(Inst::ProgressInst(slot))
+        .Push(Inst::JmpInst(head));
+  }
+  frag.nullable = true;
+  return frag;
+}
+
+// Up to `num` optional copies of `elem`, every one of them exiting to the end.
+static Fragment Optional(const Fragment &elem, size_t num, bool greedy) {
+  Fragment frag;
+  uint32_t exit = num * (elem.size() + 1);
+  for (size_t i = 0; i < num; ++i) {
+    uint32_t next = frag.size() + 1;
+    frag.Push(greedy ? Inst::SplitInst(next, exit)
+                     : Inst::SplitInst(exit, next))
+        .Append(elem);
+  }
+  return frag;
+}
+
+static Fragment Possessive(Fragment &&elem) {
+  Fragment frag;
+  frag.Push(Inst::AtomicInst()).Append(elem).Push(Inst::AtomicEndInst());
+  frag.nullable = elem.nullable;
+  frag.anchored = elem.anchored;
+  return frag;
+}
+
+// Union of the bytes consumed by the instructions reachable from the start
+// without consuming input. A reachable `Match`, look-ahead or back-reference
+// may begin a match without any of them, so every byte is returned then.
+static ByteSet FirstBytes(const std::vector<Inst> &insts,
+                          const std::vector<ByteSet> &sets) {
+  ByteSet first;
+  std::vector<uint8_t> seen(insts.size(), false);
+  std::vector<uint32_t> stack{0};
+  while (!stack.empty()) {
+    uint32_t pc = stack.back();
+    stack.pop_back();
+    if (seen[pc]) continue;
+    seen[pc] = true;
+    const Inst &inst = insts[pc];
+    switch (inst.op) {
+      case Inst::Any:
+      case Inst::Look:
+      case Inst::NegLook:
+      case Inst::Match:
+      case Inst::Ref:
+        return ByteSet::All();
+      case Inst::Char:
+        first.Insert(inst.ch.val);
+        break;
+      case Inst::Set:
+        first |= sets[inst.set.idx];
+        break;
+      case Inst::SetEx:
+        first |= ~sets[inst.set.idx];
+        break;
+      case Inst::Jmp:
+        stack.push_back(inst.jmp.x);
+        break;
+      case Inst::Split:
+        stack.push_back(inst.split.y);
+        stack.push_back(inst.split.x);
+        break;
+      default:
+        stack.push_back(pc + 1);
+        break;
+    }
+  }
+  return first;
+}
+
+// Bytes the paths from every pc may begin with when a byte is left, so
+// that a path ending at "$" begins with none and one through a `Match`,
+// look-ahead or back-reference with any. The sets grow back from the
+// instructions consuming a byte along the epsilon edges, and a pc is only
+// requeued when its set grew, at most 256 times.
+static std::vector<ByteSet> FirstBytesByPc(const std::vector<Inst> &insts,
+                                           const std::vector<ByteSet> &sets) {
+  std::vector<ByteSet> first(insts.size());
+  std::vector<std::vector<uint32_t>> preds(insts.size());  // epsilon edges
+  std::vector<uint32_t> work;
+  for (uint32_t pc = 0; pc < insts.size(); ++pc) {
+    const Inst &inst = insts[pc];
+    switch (inst.op) {
+      case Inst::Any:
+      case Inst::Look:
+      case Inst::NegLook:
+      case Inst::Match:
+      case Inst::Ref:
+        first[pc] = ByteSet::All();
+        work.push_back(pc);
+        break;
+      case Inst::Char:
+        first[pc].Insert(inst.ch.val);
+        work.push_back(pc);
+        break;
+      case Inst::Set:
+        first[pc] = sets[inst.set.idx];
+        work.push_back(pc);
+        break;
+      case Inst::SetEx:
+        first[pc] = ~sets[inst.set.idx];
+        work.push_back(pc);
+        break;
+      case Inst::End:
+        break;
+      case Inst::Jmp:
+        preds[inst.jmp.x].push_back(pc);
+        break;
+      case Inst::Split:
+        preds[inst.split.x].push_back(pc);
+        preds[inst.split.y].push_back(pc);
+        break;
+      default:
+        preds[pc + 1].push_back(pc);
+        break;
+    }
+  }
+  while (!work.empty()) {
+    uint32_t pc = work.back();
+    work.pop_back();
+    for (uint32_t pred : preds[pc]) {
+      size_t count = first[pred].Count();
+      first[pred] |= first[pc];
+      if (first[pred].Count() != count) work.push_back(pred);
+    }
+  }
+  return first;
+}
+
+// Whether the `Split` at `pc` may commit to `split.x` when its first
+// instruction accepts the next byte. Every path through `split.y` has to
+// consume that byte first, so none of them may match when the bytes they
+// begin with are disjoint from the ones `split.x` accepts. A greedy loop
+// over a class such as `[^"]*"` then runs possessively.
+static std::vector<uint8_t> PossessiveSplits(const std::vector<Inst> &insts,
+                                             const std::vector<ByteSet> &sets) {
+  std::vector<uint8_t> possessive(insts.size(), false);
+  std::vector<ByteSet> first(FirstBytesByPc(insts, sets));
+  for (uint32_t pc = 0; pc < insts.size(); ++pc) {
+    const Inst &inst = insts[pc];
+    if (inst.op != Inst::Split) continue;
+    const Inst &next = insts[inst.split.x];
+    ByteSet accepted;
+    switch (next.op) {
+      case Inst::Any:
+        accepted = ByteSet::All();
+        break;
+      case Inst::Char:
+        accepted.Insert(next.ch.val);
+        break;
+      case Inst::Set:
+        accepted = sets[next.set.idx];
+        break;
+      case Inst::SetEx:
+        accepted = ~sets[next.set.idx];
+        break;
+      default:
+        continue;
+    }
+    const ByteSet &follow = first[inst.split.y];
+    bool disjoint = true;
+    for (int i = 0; i < 4; ++i) {
+      disjoint &= (accepted.bits()[i] & follow.bits()[i]) == 0;
+    }
+    possessive[pc] = disjoint;
+  }
+  return possessive;
+}
+
+// Classes of the bytes the instructions of a program tell apart. `Any`
+// accepts every byte and anchors consume none, so only characters and sets
+// split classes; a back-reference may compare any two bytes.
+static ByteClasses ClassesOf(const std::vector<Inst> &insts,
+                             const std::vector<ByteSet> &sets) {
+  ByteClasses classes;
+  for (const Inst &inst : insts) {
+    switch (inst.op) {
+      case Inst::Char: {
+        ByteSet set;
+        set.Insert(inst.ch.val);
+        classes.Split(set);
+        break;
+      }
+      case Inst::Set:
+      case Inst::SetEx:
+        classes.Split(sets[inst.set.idx]);
+        break;
+      case Inst::Ref:
+        return ByteClasses::Singletons();
+      default:
+        break;
+    }
+  }
+  return classes;
+}
+
+Program Program::Compile(const Exp &exp, bool reverse,
+                         size_t max_size) {
+  Program program;
+  program.group_num_ = exp.group_num;
+  std::stack<Fragment, std::vector<Fragment>> stack;
+  auto new_slot = [&program]() {
+    return static_cast<uint32_t>(program.group_num_ * 2 +
+                                 program.reg_num_++);
+  };
+  auto pop = [&stack]() {
+    assert(!stack.empty());
+    Fragment frag(std::move(stack.top()));
+    stack.pop();
+    return frag;
+  };
+  // whether `copies` of `size` instructions would not fit
+  auto too_large = [max_size](size_t copies, size_t size) {
+    return size != 0 && copies > max_size / size;
+  };
+
+  for (const auto &id : exp.ids) {
+    switch (static_cast<int>(id.sym)) {
+      case Id::Sym::AheadPr:
+      case Id::Sym::NegAheadPr: {
+        // look(next)-->elem-->match-->next
+        Fragment elem(pop());
+        Fragment frag;
+        frag.Push(Inst::LookInst(elem.size() + 2,
+                                 id.sym == Id::Sym::NegAheadPr))
+            .Append(elem)
+            .Push(Inst::MatchInst());
+        stack.push(std::move(frag));
+        break;
+      }
+      case Id::Sym::Any: {
+        stack.emplace(Inst::AnyInst(), false);
+        break;
+      }
+      case Id::Sym::AtomicPr: {
+        stack.push(Possessive(pop()));
+        break;
+      }
+      case Id::Sym::Begin: {
+        stack.emplace(reverse ? Inst::EndInst() : Inst::BeginInst(), true);
+        stack.top().anchored = !reverse;
+        break;
+      }
+      case Id::Sym::Char: {
+        stack.emplace(Inst::CharInst(id.ch), false);
+        break;
+      }
+      case Id::Sym::Concat: {
+        Fragment back(pop());
+        Fragment &front(stack.top());
+        if (reverse) {
+          back.Append(front);
+          std::swap(front.insts, back.insts);
+        } else {
+          front.Append(back);
+        }
+        front.nullable = front.nullable && back.nullable;
+        front.anchored = front.anchored && !reverse;
+        break;
+      }
+      case Id::Sym::Either: {
+        // split-->left-->jmp end
+        //   |-->right-->end
+        Fragment right(pop());
+        Fragment left(pop());
+        Fragment frag;
+        frag.Push(Inst::SplitInst(1, left.size() + 2))
+            .Append(left)
+            .Push(Inst::JmpInst(left.size() + right.size() + 2))
+            .Append(right);
+        frag.nullable = left.nullable || right.nullable;
+        frag.anchored = left.anchored && right.anchored;
+        stack.push(std::move(frag));
+        break;
+      }
+      case Id::Sym::End: {
+        stack.emplace(reverse ? Inst::BeginInst() : Inst::EndInst(), true);
+        break;
+      }
+      case Id::Sym::More:
+      case Id::Sym::PosMore:
+      case Id::Sym::RelMore: {
+        Fragment elem(pop());
+        uint32_t slot = elem.nullable ? new_slot() : 0;
+        Fragment frag(Loop(elem, 0, id.sym != Id::Sym::RelMore, slot));
+        if (id.sym == Id::Sym::PosMore) frag = Possessive(std::move(frag));
+        stack.push(std::move(frag));
+        break;
+      }
+      case Id::Sym::NamedPr:
+      case Id::Sym::Paren: {
+        auto idx = static_cast<uint32_t>(id.store.idx);
+        Fragment elem(pop());
+        Fragment frag;
+        frag.Push(Inst::SaveInst(idx * 2))
+            .Append(elem)
+            .Push(Inst::SaveInst(idx * 2 + 1));
+        frag.nullable = elem.nullable;
+        frag.anchored = elem.anchored;
+        stack.push(std::move(frag));
+        break;
+      }
+      case Id::Sym::UnParen: {
+        break;
+      }
+      case Id::Sym::Plus:
+      case Id::Sym::PosPlus:
+      case Id::Sym::RelPlus: {
+        Fragment elem(pop());
+        uint32_t slot = elem.nullable ? new_slot() : 0;
+        Fragment frag(Loop(elem, 1, id.sym != Id::Sym::RelPlus, slot));
+        if (id.sym == Id::Sym::PosPlus) frag = Possessive(std::move(frag));
+        stack.push(std::move(frag));
+        break;
+      }
+      case Id::Sym::Quest:
+      case Id::Sym::PosQuest:
+      case Id::Sym::RelQuest: {
+        Fragment frag(Optional(pop(), 1, id.sym != Id::Sym::RelQuest));
+        if (id.sym == Id::Sym::PosQuest) frag = Possessive(std::move(frag));
+        stack.push(std::move(frag));
+        break;
+      }
+      case Id::Sym::RefPr: {
+        stack.emplace(Inst::RefInst(id.ref.idx), true);
+        break;
+      }
+      case Id::Sym::Repeat:
+      case Id::Sym::PosRepeat:
+      case Id::Sym::RelRepeat: {
+        // {m,n} is unrolled into m copies followed by either a loop or
+        // (n - m) optional copies
+        Fragment elem(pop());
+        bool greedy = id.sym != Id::Sym::RelRepeat;
+        size_t lower = id.repeat->lower, upper = id.repeat->upper;
+        bool unbounded = upper == std::numeric_limits<size_t>::max();
+        if (too_large(lower, elem.size()) ||
+            (!unbounded && too_large(upper - lower, elem.size() + 1))) {
+          return Program();
+        }
+        Fragment frag;
+        for (size_t i = 0; i < lower; ++i) frag.Append(elem);
+        if (unbounded) {
+          uint32_t slot = elem.nullable ? new_slot() : 0;
+          frag.Append(Loop(elem, 0, greedy, slot));
+        } else if (upper > lower) {
+          frag.Append(Optional(elem, upper - lower, greedy));
+        }
+        frag.nullable = lower == 0 || elem.nullable;
+        frag.anchored = lower > 0 && elem.anchored;
+        if (id.sym == Id::Sym::PosRepeat) frag = Possessive(std::move(frag));
+        stack.push(std::move(frag));
+        break;
+      }
+      case Id::Sym::Set:
+      case Id::Sym::SetEx: {
+        auto idx = static_cast<uint32_t>(program.sets_.size());
+        program.sets_.emplace_back(id.set->val);
+        stack.emplace(Inst::SetInst(idx, id.sym == Id::Sym::SetEx), false);
+        break;
+      }
+      default: {
+        break;
+      }
+    }
+    if (!stack.empty() && stack.top().size() > max_size) return Program();
+  }
+  assert(stack.size() <= 1);
+  Fragment frag;
+  frag.Push(Inst::SaveInst(0));
+  if (!stack.empty()) frag.Append(stack.top());
+  frag.Push(Inst::SaveInst(1)).Push(Inst::MatchInst());
+  program.insts_ = std::move(frag.insts);
+  program.anchored_ = !stack.empty() && stack.top().anchored;
+  if (!reverse) {
+    program.prefix_.Build(exp);
+    program.first_ = FirstBytes(program.insts_, program.sets_);
+    program.possessive_ = PossessiveSplits(program.insts_, program.sets_);
+  }
+  program.classes_ = ClassesOf(program.insts_, program.sets_);
+  program.backtrack_ = std::any_of(
+      program.insts_.begin(), program.insts_.end(), [](const Inst &inst) {
+        return inst.op == Inst::Atomic || inst.op == Inst::Look ||
+               inst.op == Inst::NegLook || inst.op == Inst::Ref;
+      });
+  return program;
+}
+
+bool Program::Accepts(uint32_t pc, char ch) const {
+  const Inst &inst = insts_[pc];
+  switch (inst.op) {
+    case Inst::Any:
+      return true;
+    case Inst::Char:
+      return inst.ch.val == ch;
+    case Inst::Set:
+      return sets_[inst.set.idx].Contains(ch);
+    case Inst::SetEx:
+      return !sets_[inst.set.idx].Contains(ch);
+    default:
+      return false;
+  }
+}
+
+size_t Program::FindStart(std::string_view s, size_t pos) const {
+  if (!prefix_.empty()) return prefix_.Find(s, pos);
+  if (first_.full()) return pos;
+  return first_.Find(s, pos);
+}
+
+Program Program::Union(const std::vector<const Program *> &programs) {
+  // split-->p0
+  //   |-->split-->p1
+  //         |-->p2
+  Program program;
+  for (size_t i = 0; i < programs.size(); ++i) {
+    const Program &sub = *programs[i];
+    assert(!sub.backtrack());
+    auto offset = static_cast<uint32_t>(program.insts_.size());
+    bool last = i + 1 == programs.size();
+    if (!last) {
+      offset += 1;
+      program.insts_.push_back(
+          Inst::SplitInst(offset, offset + sub.insts_.size()));
+    }
+    auto set_offset = static_cast<uint32_t>(program.sets_.size());
+    for (Inst inst : sub.insts_) {
+      inst.Relocate(offset);
+      if (inst.op == Inst::Set || inst.op == Inst::SetEx) {
+        inst.set.idx += set_offset;
+      }
+      program.insts_.push_back(inst);
+    }
+    program.sets_.insert(program.sets_.end(), sub.sets_.begin(),
+                         sub.sets_.end());
+    program.group_num_ = std::max(program.group_num_, sub.group_num_);
+    program.reg_num_ = std::max(program.reg_num_, sub.reg_num_);
+  }
+  program.classes_ = ClassesOf(program.insts_, program.sets_);
+  return program;
+}
+
+std::string Program::Dump() const {
+  std::string s;
+  for (size_t pc = 0; pc < insts_.size(); ++pc) {
+    const Inst &inst = insts_[pc];
+    s += std::to_string(pc) + ": ";
+    switch (inst.op) {
+      case Inst::Any:
+        s += "any";
+        break;
+      case Inst::Atomic:
+        s += "atomic";
+        break;
+      case Inst::AtomicEnd:
+        s += "atomic end";
+        break;
+      case Inst::Begin:
+        s += "begin";
+        break;
+      case Inst::Char:
+        s += "char " + std::string(1, inst.ch.val);
+        break;
+      case Inst::End:
+        s += "end";
+        break;
+      case Inst::Jmp:
+        s += "jmp " + std::to_string(inst.jmp.x);
+        break;
+      case Inst::Look:
+        s += "look " + std::to_string(inst.look.next);
+        break;
+      case Inst::NegLook:
+        s += "neg look " + std::to_string(inst.look.next);
+        break;
+      case Inst::Mark:
+        s += "mark " + std::to_string(inst.mark.slot);
+        break;
+      case Inst::Match:
+        s += "match";
+        break;
+      case Inst::Progress:
+        s += "progress " + std::to_string(inst.mark.slot);
+        break;
+      case Inst::Ref:
+        s += "ref " + std::to_string(inst.ref.idx);
+        break;
+      case Inst::Save:
+        s += "save " + std::to_string(inst.save.slot);
+        break;
+      case Inst::Set:
+        s += "set " + std::to_string(inst.set.idx);
+        break;
+      case Inst::SetEx:
+        s += "set ex " + std::to_string(inst.set.idx);
+        break;
+      case Inst::Split:
+        s += "split " + std::to_string(inst.split.x) + ", " +
+             std::to_string(inst.split.y);
+        break;
+    }
+    s.push_back('\n');
+  }
+  return s;
+}
+
+}  // namespace regex
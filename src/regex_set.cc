@@ -0,0 +1,91 @@
+//
+// Copyright [2020] <inhzus>
+//
+
+#include "regex/regex_set.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace regex {
+
+RegexSet RegexSet::Compile(const std::vector<std::string_view> &patterns,
+                           const Options &options) {
+  RegexSet set;
+  set.graphs_.reserve(patterns.size());
+  // the union runs the same simplified bytecode as the graphs
+  std::vector<const Program *> subs;
+  for (size_t idx = 0; idx < patterns.size(); ++idx) {
+    set.graphs_.push_back(Graph::Compile(patterns[idx], options));
+    const Program &program = set.graphs_.back().program();
+    if (!program.backtrack() && !program.empty()) {
+      set.dfa_patterns_.push_back(idx);
+      subs.push_back(&program);
+    }
+  }
+  // a lone pattern is better served by the fast paths of its graph
+  if (subs.size() < 2) {
+    set.dfa_patterns_.clear();
+    return set;
+  }
+  auto program = std::make_shared<const Program>(Program::Union(subs));
+  for (uint32_t pc = 0; pc < program->insts().size(); ++pc) {
+    if (program->insts()[pc].op == Inst::Match) set.match_pcs_.push_back(pc);
+  }
+  set.dfa_ = std::make_unique<LazyDfa>(std::move(program),
+                                       options.dfa_cache_size,
+                                       LazyDfa::Overlapping);
+  return set;
+}
+
+std::vector<size_t> RegexSet::Matches(std::string_view s) const {
+  std::vector<size_t> matches;
+  std::vector<uint32_t> pcs;
+  Matches(s, &matches, &pcs);
+  return matches;
+}
+
+void RegexSet::Matches(std::string_view s, std::vector<size_t> *matches,
+                       std::vector<uint32_t> *pcs) const {
+  matches->clear();
+  bool by_dfa = false;
+  if (LazyDfa::Borrowed dfa{dfa_.get()}) {
+    by_dfa = dfa->SearchOverlapping(s, pcs) != LazyDfa::GaveUp;
+    if (by_dfa) {
+      for (uint32_t pc : *pcs) {
+        auto it = std::lower_bound(match_pcs_.begin(), match_pcs_.end(), pc);
+        matches->push_back(dfa_patterns_[it - match_pcs_.begin()]);
+      }
+    }
+  }
+  // backtracking patterns, or all of them if the DFA gave up or is busy
+  for (size_t idx = 0; idx < graphs_.size(); ++idx) {
+    if (by_dfa && Covered(idx)) continue;
+    if (graphs_[idx].Test(s)) matches->push_back(idx);
+  }
+  std::sort(matches->begin(), matches->end());
+}
+
+bool RegexSet::Test(std::string_view s) const {
+  std::vector<uint32_t> pcs;
+  bool by_dfa = false;
+  if (LazyDfa::Borrowed dfa{dfa_.get()}) {
+    switch (dfa->SearchOverlapping(s, &pcs, true)) {
+      case LazyDfa::Matched:
+        return true;
+      case LazyDfa::NoMatch:
+        by_dfa = true;
+        break;
+      case LazyDfa::GaveUp:
+        break;
+    }
+  }
+  // backtracking patterns, or all of them if the DFA gave up or is busy
+  for (size_t idx = 0; idx < graphs_.size(); ++idx) {
+    if (by_dfa && Covered(idx)) continue;
+    if (graphs_[idx].Test(s)) return true;
+  }
+  return false;
+}
+
+}  // namespace regex
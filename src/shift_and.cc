@@ -0,0 +1,179 @@
+//
+// Copyright [2020] <inhzus>
+//
+
+#include "regex/shift_and.h"
+
+#include <algorithm>
+#include <bitset>
+#include <limits>
+
+namespace regex {
+
+bool ShiftAnd::Build(const Exp &exp) {
+  std::vector<std::bitset<256>> accepts;
+  std::vector<Fragment> stack;
+  follow_.clear();
+  auto position = [this, &accepts, &stack](const std::bitset<256> &accept) {
+    if (follow_.size() == kMaxPositions) return false;
+    uint64_t bit = uint64_t{1} << follow_.size();
+    stack.push_back({bit, bit, false, static_cast<uint32_t>(follow_.size())});
+    follow_.push_back(0);
+    accepts.push_back(accept);
+    return true;
+  };
+  auto concat = [this](Fragment *front, const Fragment &back) {
+    for (uint64_t last = front->last; last != 0; last &= last - 1) {
+      follow_[__builtin_ctzll(last)] |= back.first;
+    }
+    if (front->nullable) front->first |= back.first;
+    front->last = back.last | (back.nullable ? front->last : 0);
+    front->nullable = front->nullable && back.nullable;
+  };
+  auto loop = [this](Fragment *frag) {
+    for (uint64_t last = frag->last; last != 0; last &= last - 1) {
+      follow_[__builtin_ctzll(last)] |= frag->first;
+    }
+  };
+
+  for (const auto &id : exp.ids) {
+    switch (static_cast<int>(id.sym)) {
+      case Id::Sym::Any: {
+        if (!position(std::bitset<256>().set())) return false;
+        break;
+      }
+      case Id::Sym::Char: {
+        std::bitset<256> accept;
+        accept.set(static_cast<uint8_t>(id.ch));
+        if (!position(accept)) return false;
+        break;
+      }
+      case Id::Sym::Set:
+      case Id::Sym::SetEx: {
+        std::bitset<256> accept;
+        for (size_t byte = 0; byte < 256; ++byte) {
+          accept[byte] = id.set->val.Contains(static_cast<char>(byte)) ==
+                         (id.sym == Id::Sym::Set);
+        }
+        if (!position(accept)) return false;
+        break;
+      }
+      case Id::Sym::Concat: {
+        Fragment back(stack.back());
+        stack.pop_back();
+        concat(&stack.back(), back);
+        break;
+      }
+      case Id::Sym::Either: {
+        Fragment right(stack.back());
+        stack.pop_back();
+        Fragment &left(stack.back());
+        left.first |= right.first;
+        left.last |= right.last;
+        left.nullable = left.nullable || right.nullable;
+        break;
+      }
+      case Id::Sym::More:
+      case Id::Sym::RelMore: {
+        loop(&stack.back());
+        stack.back().nullable = true;
+        break;
+      }
+      case Id::Sym::Plus:
+      case Id::Sym::RelPlus: {
+        loop(&stack.back());
+        break;
+      }
+      case Id::Sym::Quest:
+      case Id::Sym::RelQuest: {
+        stack.back().nullable = true;
+        break;
+      }
+      case Id::Sym::NamedPr:
+      case Id::Sym::Paren:
+      case Id::Sym::UnParen: {
+        break;
+      }
+      case Id::Sym::Repeat:
+      case Id::Sym::RelRepeat: {
+        // {m,n} becomes m copies followed by either a "+" on the last copy
+        // or (n - m) optional copies
+        Fragment elem(stack.back());
+        stack.pop_back();
+        size_t lower = id.repeat->lower, upper = id.repeat->upper;
+        bool infinite = upper == std::numeric_limits<size_t>::max();
+        size_t copies = infinite ? std::max<size_t>(lower, 1) : upper;
+        size_t n = follow_.size() - elem.begin;
+        if (n != 0 && (copies > kMaxPositions ||
+                       elem.begin + n * copies > kMaxPositions)) {
+          return false;
+        }
+        std::vector<uint64_t> follow(follow_.begin() + elem.begin,
+                                     follow_.end());
+        std::vector<std::bitset<256>> accept(accepts.begin() + elem.begin,
+                                             accepts.end());
+        follow_.resize(elem.begin);
+        accepts.resize(elem.begin);
+        Fragment frag{0, 0, true, elem.begin};
+        for (size_t k = 0; k < copies; ++k) {
+          size_t shift = k * n;
+          for (size_t i = 0; i < n; ++i) {
+            follow_.push_back(follow[i] << shift);
+            accepts.push_back(accept[i]);
+          }
+          Fragment copy{elem.first << shift, elem.last << shift,
+                        elem.nullable || k >= lower,
+                        static_cast<uint32_t>(elem.begin + shift)};
+          if (infinite && k + 1 == copies) {
+            loop(&copy);
+            copy.nullable = copy.nullable || lower == 0;
+          }
+          concat(&frag, copy);
+        }
+        stack.push_back(frag);
+        break;
+      }
+      default: {
+        // anchors, back-references, look-ahead, atomic groups and possessive
+        // quantifiers
+        return false;
+      }
+    }
+  }
+  if (stack.empty()) stack.push_back({0, 0, true, 0});
+  first_ = stack.back().first;
+  last_ = stack.back().last;
+  nullable_ = stack.back().nullable;
+
+  std::fill(masks_, masks_ + 256, 0);
+  for (size_t p = 0; p < follow_.size(); ++p) {
+    for (size_t byte = 0; byte < 256; ++byte) {
+      if (accepts[p][byte]) masks_[byte] |= uint64_t{1} << p;
+    }
+  }
+  chunk_num_ = (follow_.size() + kChunkBits - 1) / kChunkBits;
+  table_.assign(chunk_num_ << kChunkBits, 0);
+  for (size_t i = 0; i < chunk_num_; ++i) {
+    for (size_t val = 0; val < 256; ++val) {
+      for (size_t j = 0; j < kChunkBits; ++j) {
+        size_t p = i * kChunkBits + j;
+        if ((val >> j & 1) && p < follow_.size()) {
+          table_[i << kChunkBits | val] |= follow_[p];
+        }
+      }
+    }
+  }
+  return true;
+}
+
+bool ShiftAnd::Test(std::string_view s) const {
+  if (nullable_) return true;
+  uint64_t active = 0;
+  for (char ch : s) {
+    active = (Follow(active) | first_) & masks_[static_cast<uint8_t>(ch)];
+    if (active & last_) return true;
+  }
+  return false;
+}
+
+}  // namespace regex
@@ -0,0 +1,73 @@
+//
+// Copyright [2020] <inhzus>
+//
+
+#include "regex/aho_corasick.h"
+
+#include <catch2/catch.hpp>
+#include <string>
+#include <vector>
+
+#include "regex/backtrack.h"
+#include "regex/graph.h"
+
+static std::string Keywords(size_t n) {
+  std::string pattern;
+  for (size_t i = 0; i < n; ++i) {
+    if (i != 0) pattern.push_back('|');
+    pattern += "kw" + std::to_string(i * 7919 % 100000);
+  }
+  return pattern;
+}
+
+TEST_CASE("aho-corasick built for literal alternations only") {
+  regex::AhoCorasick ac;
+  REQUIRE(ac.Build(regex::Exp::FromStr(Keywords(100))));
+  REQUIRE(ac.literal_num() == 100);
+  REQUIRE(ac.Build(regex::Exp::FromStr("(?:a|b|c|d)(?:e|f|g)")));
+  REQUIRE(ac.literal_num() == 12);
+  REQUIRE(ac.Build(regex::Exp::FromStr("(?P<k>" + Keywords(20) + ")")));
+  REQUIRE_FALSE(ac.Build(regex::Exp::FromStr("foo|bar|baz")));
+  REQUIRE_FALSE(ac.Build(regex::Exp::FromStr(Keywords(20) + "|\\d")));
+  std::string group = "(";
+  group += Keywords(20);
+  group += ")x";
+  REQUIRE_FALSE(ac.Build(regex::Exp::FromStr(group)));
+  REQUIRE_FALSE(ac.Build(regex::Exp::FromStr("^(?:" + Keywords(20) + ")")));
+}
+
+TEST_CASE("aho-corasick keeps leftmost-first semantics") {
+  const char *pattern = "foo|foobar|bar|obarx|a|b|c|d|e|oob|ob";
+  regex::AhoCorasick ac;
+  REQUIRE(ac.Build(regex::Exp::FromStr(pattern)));
+  auto program = regex::Program::Compile(regex::Exp::FromStr(pattern));
+  std::vector<std::string> texts = {
+      "foobar", "xfoobarx", "fobarx", "obarx", "zzz", "xxoob", "food",
+      "fofoobar", "", "zzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzb"};
+  for (const auto &text : texts) {
+    std::vector<size_t> slots;
+    bool expected = regex::Backtracker(program).Search(text, &slots);
+    size_t begin, end;
+    REQUIRE(expected == ac.Search(text, &begin, &end));
+    REQUIRE(expected == ac.Test(text));
+    if (!expected) continue;
+    REQUIRE(begin == slots[0]);
+    REQUIRE(end == slots[1]);
+  }
+}
+
+TEST_CASE("aho-corasick matches through graph") {
+  // group names are views into the pattern
+  std::string pattern = "(?P<key>" + Keywords(1000) + ")";
+  auto graph = regex::Graph::Compile(pattern);
+  std::string s(300, '.');
+  s += "kw7919 kw15838";
+  auto matcher = graph.Match(s);
+  REQUIRE(matcher.ok());
+  REQUIRE(matcher.BeginIdx() == 300);
+  REQUIRE(matcher.Group("key") == "kw7919");
+  REQUIRE(graph.MatchEnd(s) == 306);
+  REQUIRE(graph.Test(s));
+  REQUIRE_FALSE(graph.Test(std::string(300, '.')));
+  REQUIRE(graph.MatchEnd("kw") == -1);
+}
@@ -0,0 +1,139 @@
+//
+// Copyright [2020] <inhzus>
+//
+
+#include "regex/ast.h"
+
+#include <catch2/catch.hpp>
+#include <string>
+#include <vector>
+
+#include "regex/graph.h"
+
+static regex::Ast Parse(std::string_view s) {
+  return regex::Ast::FromExp(regex::Exp::FromStr(s));
+}
+
+static regex::Ast Simplified(std::string_view s,
+                             const regex::AstPasses &passes = {}) {
+  regex::Ast ast = Parse(s);
+  ast.Simplify(passes);
+  return ast;
+}
+
+static regex::AstPasses NoPasses() {
+  return {false, false, false, false, false};
+}
+
+TEST_CASE("ast lowers back to the parsed postfix") {
+  for (const char *pattern :
+       {"abc", "a|b|c", "(a|bc)*d", "x(?:y|z)+?$", "(?P<n>a{2,3})(?P=n)",
+        "(?>a|ab)[^c]", "^(?=a)(?!b).", ""}) {
+    regex::Exp parsed = regex::Exp::FromStr(pattern);
+    regex::Ast ast = Parse(pattern);
+    ast.Simplify(NoPasses());
+    regex::Exp lowered = ast.ToExp();
+    REQUIRE(ast.root() == nullptr);
+    REQUIRE(lowered.group_num == parsed.group_num);
+    REQUIRE(lowered.named_group == parsed.named_group);
+    REQUIRE(lowered.ids.size() == parsed.ids.size());
+    for (size_t i = 0; i < parsed.ids.size(); ++i) {
+      REQUIRE(static_cast<int>(lowered.ids[i].sym) ==
+              static_cast<int>(parsed.ids[i].sym));
+    }
+  }
+}
+
+TEST_CASE("ast simplification passes") {
+  REQUIRE(Simplified("abc|abd") == Parse("ab[cd]"));
+  REQUIRE(Simplified("a|b|c") == Parse("[abc]"));
+  REQUIRE(Simplified("a|[b-d]|\\d|x") == Parse("[a-d0-9x]"));
+  REQUIRE(Simplified("(?:a*)*") == Parse("a*"));
+  REQUIRE(Simplified("(?:a+)?b") == Parse("a*b"));
+  REQUIRE(Simplified("(?:[ab]?)?") == Parse("[ab]?"));
+  REQUIRE(Simplified("a*a*") == Parse("a*"));
+  REQUIRE(Simplified("(?:ab)+(?:ab)*") == Simplified("(?:ab)+"));
+  REQUIRE(Simplified("x*?x*?") == Parse("x*?"));
+  REQUIRE(Simplified("(?:a)(?:(?:b)c)") == Parse("abc"));
+  REQUIRE(Simplified("(?>ab)c") == Parse("abc"));
+  // the empty rest of an alternative is tried where it stood
+  REQUIRE(Simplified("abc|ab") == Parse("abc?"));
+  REQUIRE(Simplified("ab|abc") == Parse("abc??"));
+  REQUIRE(Simplified("ab|ab") == Parse("ab"));
+  REQUIRE(Simplified("GET|POST|PUT") == Simplified("GET|P(?:OST|UT)"));
+  // small counts are unrolled, large ones keep their counter
+  REQUIRE(Simplified("a{3}") == Parse("aaa"));
+  REQUIRE(Simplified("a{2,4}") == Simplified("aa(?:aa?)?"));
+  REQUIRE(Simplified("a{1,3}?") == Simplified("a(?:aa?" "?)??"));
+  REQUIRE(Simplified("(?:ab){2,}") == Simplified("abab(?:ab)*"));
+  REQUIRE(Simplified("\\d{0,2}+") == Simplified("(?>(?:\\d\\d?)?)"));
+  REQUIRE(Simplified("(?:a{2}){3}") == Parse("aaaaaa"));
+  REQUIRE(Simplified("a{9}") == Parse("a{9}"));
+  REQUIRE(Simplified("a{0}") == Parse("a{0}"));
+
+  // what would change the matches or the groups is left alone
+  for (const char *pattern :
+       {"ab|c|ad", "(a*)*", "(?:a|ba)*c", "(a)|b", "a*?a*", "a+a+", "a?a?",
+        "(?>a|b+)c", "[^a]|b", ".|a", "(?:ab|c)*?"}) {
+    regex::Ast ast = Simplified(pattern);
+    REQUIRE(ast == Simplified(pattern, {true, false, false, false, false}));
+  }
+
+  // every pass may be turned off on its own
+  regex::AstPasses passes;
+  passes.merge_classes = false;
+  REQUIRE(Simplified("abc|abd", passes) == Simplified("ab(?:c|d)", passes));
+  passes.factor_prefixes = false;
+  REQUIRE(Simplified("abc|abd", passes) == Parse("abc|abd"));
+  passes.collapse_quantifiers = false;
+  REQUIRE(Simplified("a*a*", passes) == Parse("a*a*"));
+  passes.drop_groups = false;
+  REQUIRE(Simplified("(?:a)", passes) == Parse("(?:a)"));
+  REQUIRE(Simplified("(?:a)(?:b)").size() < Parse("(?:a)(?:b)").size());
+}
+
+TEST_CASE("ast simplification keeps the matches") {
+  std::vector<std::pair<const char *, std::vector<const char *>>> cases{
+      {"abc|abd|abe|x", {"abd", "xabe", "ab", "x"}},
+      {"(abc|ab)c", {"abcc", "abc", "ab"}},
+      {"(ab|abc)c", {"abcc", "abc", "abd"}},
+      {"(a|b|[cd])+(e)", {"abcde", "e", "dcbaf"}},
+      {"(?:a+)*(b)", {"aaab", "b", "aaa"}},
+      {"(?:a+)+(b)", {"aaab", "b", "aaa"}},
+      {"(?:a+)?(a)", {"aaa", "a", ""}},
+      {"(a*a*)b", {"aaab", "b", "ac"}},
+      {"(x*?)(x*?)y", {"xxy", "y"}},
+      {"(?>ab)c|a", {"abc", "abd"}},
+      {"GET|POST|PUT|PATCH", {"a PATCH", "PUTS", "POS"}},
+      {"(?P<t>a|b)(?P=t)|ab", {"aa", "ab", "bb"}},
+      {"\\d{1,3}(\\.\\d{1,3}){3}", {"ip 10.0.255.1", "1.2.3", "1234.5.6.7"}},
+      {"(a{2}){3}", {"aaaaaaa", "aaaaa"}},
+      {"(?:a{1,2}b){2,3}", {"abaabab", "abb"}},
+      {"(a{1,3}?)b", {"aaab", "b"}},
+      {"(a{2,}?)(a*)", {"aaaa", "a"}},
+      {"a{2,3}+a", {"aaaa", "aaa"}},
+      {"(x{0,2}y){2}", {"xyxxy", "xxxyy"}},
+      {"(a{9,})", {"aaaaaaaaaa", "aaaa"}},
+  };
+  regex::Options plain;
+  plain.passes = NoPasses();
+  for (const auto &[pattern, inputs] : cases) {
+    auto simplified = regex::Graph::Compile(pattern);
+    auto graph = regex::Graph::Compile(pattern, plain);
+    for (std::string_view s : inputs) {
+      regex::Matcher expected, actual;
+      graph.Match(s, &expected);
+      simplified.Match(s, &actual);
+      REQUIRE(expected.ok() == actual.ok());
+      REQUIRE(expected.groups() == actual.groups());
+      graph.FullMatch(s, &expected);
+      simplified.FullMatch(s, &actual);
+      REQUIRE(expected.ok() == actual.ok());
+      REQUIRE(expected.groups() == actual.groups());
+      graph.Walk(s, &expected);
+      simplified.Walk(s, &actual);
+      REQUIRE(expected.ok() == actual.ok());
+      REQUIRE(expected.groups() == actual.groups());
+    }
+  }
+}
@@ -0,0 +1,7 @@
+//
+// Copyright [2020] <inhzus>
+//
+
+#define CATCH_CONFIG_MAIN
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include <catch2/catch.hpp>
@@ -0,0 +1,115 @@
+//
+// Copyright [2020] <inhzus>
+//
+
+#include "regex/byte_set.h"
+
+#include <catch2/catch.hpp>
+#include <string>
+#include <vector>
+
+#include "regex/backtrack.h"
+#include "regex/graph.h"
+#include "regex/pike.h"
+#include "regex/program.h"
+
+static regex::Program Compile(std::string_view s) {
+  return regex::Program::Compile(regex::Exp::FromStr(s));
+}
+
+TEST_CASE("byte set folds negated groups") {
+  for (const char *pattern : {"[a-z_]", "[\\w]", "[^\\s]", "[^\\d\\W]",
+                              "[\x80-\xff" "0]"}) {
+    auto exp = regex::Exp::FromStr(pattern);
+    const regex::CharSet &set = exp.ids[0].set->val;
+    regex::ByteSet bytes(set);
+    size_t count = 0;
+    for (int byte = 0; byte < 256; ++byte) {
+      auto ch = static_cast<char>(byte);
+      REQUIRE(bytes.Contains(ch) == set.Contains(ch));
+      count += set.Contains(ch);
+    }
+    REQUIRE(bytes.Count() == count);
+    REQUIRE((~bytes).Count() == 256 - count);
+  }
+}
+
+TEST_CASE("byte set finds bytes in and out of the set") {
+  auto exp = regex::Exp::FromStr("[0-9\xe9]");
+  regex::ByteSet digits(exp.ids[0].set->val);
+  std::string s(100, 'x');
+  s[17] = '5';  // in the second block
+  s[40] = '\xe9';
+  s[98] = '0';  // left to the scalar tail
+  REQUIRE(17 == digits.Find(s, 0));
+  REQUIRE(40 == digits.Find(s, 18));
+  REQUIRE(98 == digits.Find(s, 41));
+  REQUIRE(regex::ByteSet::npos == digits.Find(s, 99));
+  REQUIRE(0 == digits.Find(s, 0, false));
+  std::string run(50, '7');
+  run[33] = '\x80';
+  REQUIRE(33 == digits.Find(run, 3, false));
+  REQUIRE(regex::ByteSet::npos == digits.Find(run.substr(0, 33), 0, false));
+}
+
+TEST_CASE("program first bytes") {
+  auto first = [](std::string_view s) { return Compile(s).first(); };
+  REQUIRE(first("\\d+ms").Count() == 10);
+  REQUIRE(first("(a|[bc])x|d").Count() == 4);
+  REQUIRE(first("x*y").Count() == 2);
+  REQUIRE(first("^[^a]").Count() == 255);
+  REQUIRE(first("a?").full());
+  REQUIRE(first("(?=a)a").full());
+  REQUIRE(first(".b").full());
+}
+
+TEST_CASE("byte classes") {
+  regex::ByteClasses classes;
+  REQUIRE(classes.size() == 1);
+  classes.Split(regex::ByteSet(regex::Exp::FromStr("[a-z]").ids[0].set->val));
+  REQUIRE(classes.size() == 2);
+  REQUIRE(classes['a'] == classes['q']);
+  REQUIRE(classes['A'] != classes['a']);
+  REQUIRE(classes['A'] == classes['{']);
+  REQUIRE(classes.Representatives() == std::vector<uint8_t>{0, 'a'});
+  auto email = regex::Graph::Compile("(\\w+)@(\\w+)\\.com");
+  REQUIRE(email.byte_classes().size() == 7);
+  auto ref = regex::Graph::Compile("(?P<a>b)(?P=a)");
+  REQUIRE(ref.byte_classes().size() == 256);
+  // bytes of one class are accepted by the same instructions
+  auto program = Compile("[^a-f0]x|.[\\d_]*(\\s)");
+  const regex::ByteClasses &program_classes = program.classes();
+  for (int x = 0; x < 256; ++x) {
+    for (int y = 0; y < 256; ++y) {
+      auto a = static_cast<char>(x), b = static_cast<char>(y);
+      if (program_classes[a] != program_classes[b]) continue;
+      REQUIRE((a == 'x') == (b == 'x'));
+      for (const regex::ByteSet &set : program.sets()) {
+        REQUIRE(set.Contains(a) == set.Contains(b));
+      }
+    }
+  }
+}
+
+TEST_CASE("class loops and start skipping agree with pike vm") {
+  std::vector<std::pair<const char *, std::vector<std::string>>> cases{
+      {"[a-z]*z\\d", {std::string(40, 'q') + "z9", "qqz", "z1z2"}},
+      {"[^\"]*\"", {"say \"hi\"", std::string(70, 'a')}},
+      {"\\d+(\\d)\\.", {"abc 12345.", std::string(33, '1') + "."}},
+      {".*?([\\w]+)@", {"mail: someone@example.com", "@"}},
+      {"(?:[ab]*c)+d", {"abcabcd", "abababcabx"}},
+  };
+  for (const auto &[pattern, inputs] : cases) {
+    auto program = Compile(pattern);
+    for (std::string_view s : inputs) {
+      std::vector<size_t> pike_slots, backtrack_slots;
+      bool pike = regex::PikeVm(program).Search(s, &pike_slots);
+      bool backtrack = regex::Backtracker(program, size_t{256} << 10)
+                           .Search(s, &backtrack_slots);
+      REQUIRE(pike == backtrack);
+      if (pike) REQUIRE(pike_slots == backtrack_slots);
+      REQUIRE(regex::Backtracker(program).Search(s, &backtrack_slots) == pike);
+      if (pike) REQUIRE(pike_slots == backtrack_slots);
+    }
+  }
+}
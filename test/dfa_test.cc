@@ -0,0 +1,168 @@
+//
+// Copyright [2020] <inhzus>
+//
+
+#include "regex/dfa.h"
+
+#include <catch2/catch.hpp>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "regex/graph.h"
+#include "regex/pike.h"
+
+static std::shared_ptr<const regex::Program> CompileProgram(
+    std::string_view s) {
+  return std::make_shared<const regex::Program>(
+      regex::Program::Compile(regex::Exp::FromStr(s)));
+}
+
+TEST_CASE("lazy dfa agrees with pike vm on match end") {
+  std::vector<std::pair<const char *, std::vector<const char *>>> cases{
+      {"aa*|b(cd*(e|fg))?h|i", {"bcdddfgh", "i", "bh", "xbcdefh", "cd"}},
+      {"(a|b)*?a", {"babac", "bbb", ""}},
+      {"(a|ab)(c|bcd)(d*)", {"abcd", "abcdd", "xabc"}},
+      {"(a*)+b", {"aab", "b", "aa"}},
+      {"a{2,3}?(a*)", {"aaaaa", "a"}},
+      {"(\\w+)@(\\w+)\\.com$", {"mail me@example.com", "me@x.co", ".com"}},
+      {"^(ab|a)(b*)$", {"abbb", "a", "ba"}},
+      {"^$|b", {"", "ab", "a"}},
+      {"a$|ab", {"ab", "xa", "abab"}},
+      {"x*", {"", "yxx", "xxy"}},
+      {".*?(\\d+)", {"abc 123 456", "none"}},
+      {"[^a-c]+d", {"abxyd", "abcd"}},
+  };
+  for (const auto &[pattern, inputs] : cases) {
+    auto program = CompileProgram(pattern);
+    regex::LazyDfa dfa(program, 1 << 20);
+    for (std::string_view s : inputs) {
+      std::vector<size_t> slots;
+      bool pike = regex::PikeVm(*program).Search(s, &slots);
+      size_t end;
+      auto status = dfa.Search(s, &end);
+      REQUIRE(status != regex::LazyDfa::GaveUp);
+      REQUIRE(pike == (status == regex::LazyDfa::Matched));
+      if (pike) REQUIRE(end == slots[1]);
+    }
+  }
+}
+
+TEST_CASE("lazy dfa survives cache clears") {
+  // every suffix of the last 12 characters is a distinct state
+  auto program = CompileProgram("a[ab]{12}c");
+  std::string s;
+  for (size_t i = 0; i < 4096; ++i) s.push_back("ab"[(i * 7 + i / 3) % 2]);
+  std::string t = s + "c";
+  regex::LazyDfa small(program, 20000);
+  size_t end;
+  // the cache only holds a handful of states, so searches keep clearing it
+  auto status = small.Search(t, &end);
+  if (status == regex::LazyDfa::Matched) REQUIRE(end == t.size());
+  REQUIRE(small.Search(s, &end) != regex::LazyDfa::Matched);
+
+  regex::LazyDfa large(program, 1 << 24);
+  REQUIRE(large.Search(t, &end) == regex::LazyDfa::Matched);
+  REQUIRE(end == t.size());
+  REQUIRE(large.Search(s, &end) == regex::LazyDfa::NoMatch);
+}
+
+TEST_CASE("graph falls back when the dfa gives up") {
+  regex::Options options;
+  options.dfa_cache_size = 1;
+  auto graph = regex::Graph::Compile("(a|b)*c", options);
+  REQUIRE(graph.Test("ababc"));
+  REQUIRE_FALSE(graph.Test("abab"));
+  REQUIRE(5 == graph.MatchEnd("ababcab"));
+  REQUIRE(-1 == graph.MatchEnd("abab"));
+
+  graph = regex::Graph::Compile("b+(?=c)");
+  REQUIRE(3 == graph.MatchEnd("abbc"));
+  REQUIRE_FALSE(graph.Test("abb"));
+}
+
+TEST_CASE("full dfa agrees with lazy dfa") {
+  std::vector<std::pair<const char *, std::vector<const char *>>> cases{
+      {"aa*|b(cd*(e|fg))?h|i", {"bcdddfgh", "i", "bh", "xbcdefh", "cd"}},
+      {"(a|b)*?a", {"babac", "bbb", ""}},
+      {"(\\w+)@(\\w+)\\.com$", {"mail me@example.com", "me@x.co", ".com"}},
+      {"^(ab|a)(b*)$", {"abbb", "a", "ba"}},
+      {"^$|b", {"", "ab", "a"}},
+      {"a$|ab", {"ab", "xa", "abab"}},
+      {"x*", {"", "yxx", "xxy"}},
+      {"[^a-c]+d", {"abxyd", "abcd"}},
+  };
+  for (const auto &[pattern, inputs] : cases) {
+    auto program = CompileProgram(pattern);
+    regex::LazyDfa lazy(program, 1 << 20);
+    regex::Dfa dfa;
+    REQUIRE(dfa.Build(program, 1000));
+    for (std::string_view s : inputs) {
+      size_t lazy_end, dfa_end;
+      bool matched = lazy.Search(s, &lazy_end) == regex::LazyDfa::Matched;
+      REQUIRE(matched == dfa.Search(s, &dfa_end));
+      if (matched) REQUIRE(lazy_end == dfa_end);
+    }
+  }
+}
+
+TEST_CASE("full dfa is minimized and bounded") {
+  regex::Dfa alternate, set;
+  REQUIRE(alternate.Build(CompileProgram("ab|cb"), 100));
+  REQUIRE(set.Build(CompileProgram("[ac]b"), 100));
+  REQUIRE(alternate.state_num() == set.state_num());
+
+  regex::Dfa dfa;
+  REQUIRE_FALSE(dfa.Build(CompileProgram("a[ab]{8}c"), 100));
+  REQUIRE_FALSE(dfa.Build(CompileProgram("(?P<a>b)(?P=a)"), 100));
+
+  auto graph = regex::Graph::Compile("a[ab]{8}c");
+  REQUIRE_FALSE(graph.CompileDfa(100));
+  REQUIRE(graph.CompileDfa(100000));
+  std::string s(20, 'a');
+  REQUIRE(-1 == graph.MatchEnd(s));
+  s.push_back('c');
+  REQUIRE(21 == graph.MatchEnd(s));
+  REQUIRE(graph.Match(s).BeginIdx() == 11);
+}
+
+TEST_CASE("reverse dfa finds the leftmost start") {
+  std::vector<std::pair<const char *, std::vector<const char *>>> cases{
+      {"aa*|b(cd*(e|fg))?h|i", {"bcdddfgh", "xxi", "bh", "xbcdefh", "cd"}},
+      {"(a|b)*?a", {"babac", "bbb", "cca"}},
+      {"(a|ab)(c|bcd)(d*)", {"abcd", "xxabcdd", "xabc"}},
+      {"(\\w+)@(\\w+)\\.com$", {"mail me@example.com", "a@b.com a@b.com"}},
+      {"^(ab|a)(b*)$", {"abbb", "a", "ba"}},
+      {"b*$|a", {"abb", "cab", ""}},
+      {"x*", {"", "yxx", "xxy"}},
+      {"[^a-c]+d", {"abxyd", "abcd"}},
+  };
+  for (const auto &[pattern, inputs] : cases) {
+    auto exp = regex::Exp::FromStr(pattern);
+    regex::Program program = regex::Program::Compile(exp);
+    regex::LazyDfa forward(std::make_shared<const regex::Program>(program),
+                           1 << 20);
+    regex::LazyDfa reverse(std::make_shared<const regex::Program>(
+                               regex::Program::Compile(exp, true)),
+                           1 << 20, regex::LazyDfa::Reverse);
+    auto graph = regex::Graph::Compile(pattern);
+    for (std::string_view s : inputs) {
+      std::vector<size_t> slots;
+      bool pike = regex::PikeVm(program).Search(s, &slots);
+      auto matcher = graph.Match(s);
+      REQUIRE(pike == matcher.ok());
+      if (!pike) continue;
+      size_t begin, end;
+      REQUIRE(forward.Search(s, &end) == regex::LazyDfa::Matched);
+      REQUIRE(reverse.SearchReverse(s.substr(0, end), end == s.size(),
+                                    &begin) == regex::LazyDfa::Matched);
+      REQUIRE(begin == slots[0]);
+      REQUIRE(end == slots[1]);
+      for (size_t i = 0; i < program.group_num(); ++i) {
+        if (slots[i * 2] == regex::Program::kUnset) continue;
+        REQUIRE(matcher.Group(i) ==
+                s.substr(slots[i * 2], slots[i * 2 + 1] - slots[i * 2]));
+      }
+    }
+  }
+}
@@ -16,6 +16,8 @@ TEST_CASE("exp", "[exp]") {
   REQUIRE("aa." == InfixToPostfix("aa"));
   REQUIRE("aa|" == InfixToPostfix("a|a"));
   REQUIRE("aa|.." == InfixToPostfix("aa\\|"));
+  // a quantifier binds to the last operand of a run
+  REQUIRE("abc?.." == InfixToPostfix("abc?"));
 
   REQUIRE("ab.(c." == InfixToPostfix("(ab)c"));
   REQUIRE("abc.(d.." == InfixToPostfix("a(bc)d"));
@@ -6,15 +6,24 @@
 
 #include <catch2/catch.hpp>
 #include <string>
+#include <thread>
 #include <vector>
 
+#include "regex/regex_set.h"
 #include "test/utils.h"
 
+// the same cases check the native code against the interpreter
+#ifdef REGEX_TEST_JIT
+static const regex::Options kOptions{.jit = true};
+#else
+static const regex::Options kOptions{};
+#endif
+
 inline regex::Graph CompileInfix(std::string_view infix,
                                  std::string_view postfix) {
   auto exp = regex::Exp::FromStr(infix);
   REQUIRE(IdsToStr(exp.ids) == postfix);
-  return regex::Graph::Compile(std::move(exp));
+  return regex::Graph::Compile(std::move(exp), kOptions);
 }
 
 TEST_CASE("graph match concat") {
@@ -49,6 +58,9 @@ TEST_CASE("graph match the element or not") {
   REQUIRE(2 == graph.MatchLen("ab"));
   REQUIRE(1 == graph.MatchLen("b"));
   REQUIRE(-1 == graph.MatchLen("a"));
+  graph = CompileInfix("abc?", "abc?..");
+  REQUIRE(graph.Match("ab").Str() == "ab");
+  REQUIRE(graph.Match("xabc").Str() == "abc");
 }
 
 TEST_CASE("graph greedy or lazy") {
@@ -231,6 +243,62 @@ TEST_CASE("graph matcher") {
   REQUIRE("b" == matcher.Group("a"));
 }
 
+TEST_CASE("graph matcher reused") {
+  auto graph = regex::Graph::Compile("(?P<x>a)|(b)", kOptions);
+  regex::Matcher matcher;
+  graph.Match("xa", &matcher);
+  REQUIRE(matcher.ok());
+  REQUIRE("a" == matcher.Group("x"));
+  // groups of the previous match do not leak into the next one
+  graph.Match("b", &matcher);
+  REQUIRE(matcher.ok());
+  REQUIRE(matcher.Group("x").empty());
+  REQUIRE("b" == matcher.Group(2));
+  graph.FullMatch("ab", &matcher);
+  REQUIRE_FALSE(matcher.ok());
+
+  auto plain = regex::Graph::Compile("(c)+", kOptions);
+  plain.Match("acc", &matcher);
+  REQUIRE(matcher.groups().size() == 2);
+  REQUIRE("cc" == matcher.Str());
+  REQUIRE(matcher.Group("x") == regex::Matcher::kEnd);
+  graph.Walk("zb", &matcher);
+  REQUIRE(matcher.ok());
+  REQUIRE("b" == matcher.Group(2));
+}
+
+TEST_CASE("graph match scratch reused") {
+  std::vector<std::pair<const char *, std::vector<const char *>>> cases{
+      {"(\\w+)@(\\w+)\\.com", {"mail me@example.com", "me@x.org"}},
+      {"(?P<a>b|c)(?P=a)(?>x+|y)z", {"bbxxz", "ccyz", "bcxz"}},
+      {"a(?=b(?!c)(d))(bd|be)", {"abd", "abcd", "xabde"}},
+      {"(ab){2,3}?c|d++e", {"ababc", "abababc", "ddde", "dd"}},
+  };
+  // one scratch serves every pattern, one after the other
+  regex::MatchScratch scratch;
+  regex::Matcher matcher;
+  for (int round = 0; round < 2; ++round) {
+    for (const auto &[pattern, inputs] : cases) {
+      auto graph = regex::Graph::Compile(pattern, kOptions);
+      for (std::string_view s : inputs) {
+        auto expected = graph.Match(s);
+        graph.Match(s, &matcher, &scratch);
+        REQUIRE(matcher.groups() == expected.groups());
+        expected = graph.MatchAnchored(s);
+        graph.MatchAnchored(s, &matcher, &scratch);
+        REQUIRE(matcher.groups() == expected.groups());
+        expected = graph.FullMatch(s);
+        graph.FullMatch(s, &matcher, &scratch);
+        REQUIRE(matcher.groups() == expected.groups());
+        regex::Matcher walker;
+        graph.Walk(s, &walker);
+        graph.Walk(s, &matcher, &scratch);
+        REQUIRE(matcher.groups() == walker.groups());
+      }
+    }
+  }
+}
+
 TEST_CASE("graph match atomic group") {
   auto graph = CompileInfix("(?>aa|a)a", "aa.a|(>a.");
 
@@ -328,6 +396,20 @@ TEST_CASE("graph match 1 or more") {
   REQUIRE(4 == graph.MatchLen("aaab"));
 }
 
+TEST_CASE("graph match stays linear on ambiguous text") {
+  // the native code only runs when it may remember what failed
+  std::string s(30000, 'a');
+  auto graph = regex::Graph::Compile("(a*)*c|a*b", kOptions);
+  REQUIRE(30001 == graph.MatchLen(s + "b"));
+  REQUIRE(30001 == graph.MatchLen(s + "c"));
+
+  regex::Options options = kOptions;
+  options.visit_budget = 0;
+  graph = regex::Graph::Compile("(a*)*c|a*b", options);
+  REQUIRE(31 == graph.MatchLen(s.substr(0, 30) + "b"));
+  REQUIRE(30001 == graph.MatchLen(s + "b"));
+}
+
 TEST_CASE("matcher subroutine") {
   auto graph = CompileInfix("a(b)(?P<foo>cd)", "ab(cd.(<>..");
   auto matcher = graph.Match("abcd");
@@ -345,3 +427,130 @@ TEST_CASE("pattern subroutine") {
           "bbcdabbcdbcbbcd");
 }
 
+TEST_CASE("graph shared across threads") {
+  std::vector<std::pair<const char *, std::vector<const char *>>> cases{
+      {"(\\w+)@(\\w+)\\.com", {"mail me@example.com", "me@x.org"}},
+      {"(a|ab)(c|bcd)(d*)", {"abcd", "xabcdd", "abx"}},
+      {"(?P<a>b|c)(?P=a)(?>x+|y)z", {"bbxxz", "ccyz", "bcxz"}},
+      {"(ab){2,3}?c|d++e", {"ababc", "abababc", "ddde", "dd"}},
+  };
+  for (const auto &[pattern, inputs] : cases) {
+    auto graph = regex::Graph::Compile(pattern, kOptions);
+    std::vector<regex::Matcher> expected;
+    for (std::string_view s : inputs) {
+      expected.push_back(graph.Match(s));
+      regex::Matcher walker(s, expected.back().groups().size(), {});
+      graph.Walk(s, &walker);
+      expected.push_back(walker);
+    }
+    // catch2 assertions are not thread-safe, mismatches are counted instead
+    std::vector<size_t> mismatches(8, 0);
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < mismatches.size(); ++t) {
+      threads.emplace_back([&, t]() {
+        regex::MatchScratch scratch;
+        regex::Matcher matcher;
+        for (int round = 0; round < 200; ++round) {
+          for (size_t i = 0; i < inputs.size(); ++i) {
+            std::string_view s = inputs[i];
+            regex::Matcher walker(s, expected[i * 2].groups().size(), {});
+            graph.Walk(s, &walker);
+            graph.Match(s, &matcher, &scratch);
+            mismatches[t] += graph.Match(s).groups() !=
+                                 expected[i * 2].groups() ||
+                             graph.Test(s) != expected[i * 2].ok() ||
+                             walker.groups() != expected[i * 2 + 1].groups() ||
+                             matcher.groups() != expected[i * 2].groups();
+          }
+        }
+      });
+    }
+    for (auto &thread : threads) thread.join();
+    for (size_t mismatch : mismatches) REQUIRE(mismatch == 0);
+  }
+
+  // the union DFA of a set is borrowed the same way
+  std::vector<std::string_view> patterns;
+  std::vector<std::string_view> texts;
+  for (const auto &[pattern, inputs] : cases) {
+    patterns.push_back(pattern);
+    texts.insert(texts.end(), inputs.begin(), inputs.end());
+  }
+  auto set = regex::RegexSet::Compile(patterns, kOptions);
+  std::vector<std::vector<size_t>> expected;
+  for (std::string_view s : texts) expected.push_back(set.Matches(s));
+  std::vector<size_t> mismatches(8, 0);
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < mismatches.size(); ++t) {
+    threads.emplace_back([&, t]() {
+      for (int round = 0; round < 200; ++round) {
+        for (size_t i = 0; i < texts.size(); ++i) {
+          mismatches[t] += set.Matches(texts[i]) != expected[i];
+        }
+      }
+    });
+  }
+  for (auto &thread : threads) thread.join();
+  for (size_t mismatch : mismatches) REQUIRE(mismatch == 0);
+}
+
+TEST_CASE("graph walker optimized") {
+  auto graph = regex::Graph::Compile("abc");
+  REQUIRE(graph.unoptimized_size().nodes == 7);
+  REQUIRE(graph.unoptimized_size().edges == 6);
+  // start --"abc"--> . --match--> end
+  REQUIRE(graph.size().nodes == 3);
+  REQUIRE(graph.size().edges == 2);
+  for (const char *pattern : {"(\\w+)@(\\w+)\\.com", "a(?=(b))(b|c)",
+                              "(ab){2,3}?c|d++", "(?P<a>b|c)(?P=a)d"}) {
+    graph = regex::Graph::Compile(pattern);
+    REQUIRE(graph.size().nodes < graph.unoptimized_size().nodes);
+    REQUIRE(graph.size().edges < graph.unoptimized_size().edges);
+  }
+}
+
+TEST_CASE("graph walker stack depth") {
+  regex::Options options;
+  options.max_stack_depth = 0;
+  // no branch point, nothing is stacked
+  auto graph = regex::Graph::Compile("abc", options);
+  regex::Matcher matcher;
+  graph.Walk("xxabc", &matcher);
+  REQUIRE(matcher.ok());
+  // every iteration stacks the loop and the alternation, two frames
+  std::string s(1000, 'a');
+  s += 'c';
+  options.max_stack_depth = 1000;
+  graph = regex::Graph::Compile("(?:a|b)*c", options);
+  graph.Walk(s, &matcher);
+  REQUIRE_FALSE(matcher.ok());
+  REQUIRE(matcher.overflowed());
+  graph.Walk("abc", &matcher);
+  REQUIRE(matcher.ok());
+  REQUIRE_FALSE(matcher.overflowed());
+  graph.Walk("abd", &matcher);
+  REQUIRE_FALSE(matcher.overflowed());
+  graph = regex::Graph::Compile("(?=(?:a|b)*c)a", options);
+  graph.Walk(s, &matcher);
+  REQUIRE_FALSE(matcher.ok());
+  REQUIRE(matcher.overflowed());
+  // empty lazy iterations stack nothing but trail their counter updates
+  graph = regex::Graph::Compile("(a?)+?b", options);
+  graph.Walk("c1aa1", &matcher);
+  REQUIRE_FALSE(matcher.ok());
+  REQUIRE(matcher.overflowed());
+  // patterns too large for the VMs report the walker giving up
+  options.max_program_size = 1;
+  graph = regex::Graph::Compile("(a?)+?b", options);
+  graph.Match("xb", &matcher);
+  REQUIRE_FALSE(matcher.ok());
+  REQUIRE(matcher.overflowed());
+  REQUIRE_FALSE(regex::Graph::Compile("(a?)+?b").Match("xb").overflowed());
+  options.max_program_size = regex::Program::kMaxSize;
+  options.max_stack_depth = 2100;
+  for (const char *pattern : {"(?:a|b)*c", "(?=(?:a|b)*c)a"}) {
+    graph = regex::Graph::Compile(pattern, options);
+    graph.Walk(s, &matcher);
+    REQUIRE(matcher.ok());
+  }
+}
@@ -0,0 +1,83 @@
+//
+// Copyright [2020] <inhzus>
+//
+
+#include "regex/jit.h"
+
+#include <catch2/catch.hpp>
+#include <string>
+#include <vector>
+
+#include "regex/backtrack.h"
+#include "regex/graph.h"
+
+TEST_CASE("jit built only without backtracking constructs") {
+  auto build = [](std::string_view s) {
+    auto program = regex::Program::Compile(regex::Exp::FromStr(s));
+    return regex::Jit().Build(program);
+  };
+  REQUIRE(build("(a|b)*c{2,3}[^d]+?"));
+  REQUIRE_FALSE(build("(?P<a>b)(?P=a)"));
+  REQUIRE_FALSE(build("a(?=b)"));
+  REQUIRE_FALSE(build("(?>a|ab)c"));
+}
+
+TEST_CASE("jit agrees with backtracker") {
+  std::vector<std::pair<const char *, std::vector<const char *>>> cases{
+      {"aa*|b(cd*(e|fg))?h|i", {"bcdddfgh", "i", "bh", "xbcdefh", "cd"}},
+      {"(a|b)*?a", {"babac", "bbb", ""}},
+      {"(a|ab)(c|bcd)(d*)", {"abcd", "abcdd", "xabc"}},
+      {"(a*)+b", {"aab", "b", "aa"}},
+      {"(a?)*?b", {"aab", "b"}},
+      {"a{2,3}?(a*)", {"aaaaa", "a"}},
+      {"(\\w+)@(\\w+)\\.com$", {"mail me@example.com", "me@x.co"}},
+      {"^(ab|a)(b*)$", {"abbb", "a", "ba"}},
+      {".*?(\\d+)", {"abc 123 456", "none"}},
+      {"[^a-c]+([\\x80-\\xff]|z)", {"dd\xe9", "abz", "ddz"}},
+      {"(\\d+):(\\d*)$", {"at 12:30", "12:3a", "1:", "12"}},
+      {"\"([^\"]*)\"x", {"say \"hi\"x", "\"a\"\"b\"x", "\"open"}},
+      {"(a*?)b|ac", {"aab", "ac", "aaa"}},
+  };
+  const size_t budget = size_t{256} << 10;
+  for (const auto &[pattern, inputs] : cases) {
+    auto program = regex::Program::Compile(regex::Exp::FromStr(pattern));
+    regex::Jit jit;
+    REQUIRE(jit.Build(program, budget));
+    for (std::string_view s : inputs) {
+      for (auto anchor : {regex::Unanchored, regex::AnchorBoth}) {
+        std::vector<size_t> jit_slots, backtrack_slots;
+        auto status = jit.Search(s, 0, &jit_slots, anchor);
+        bool backtrack = regex::Backtracker(program, budget)
+                             .Search(s, &backtrack_slots, anchor);
+        REQUIRE(status != regex::Jit::GaveUp);
+        REQUIRE((status == regex::Jit::Matched) == backtrack);
+        if (backtrack) REQUIRE(jit_slots == backtrack_slots);
+      }
+    }
+  }
+}
+
+TEST_CASE("jit gives up when the visited bits do not fit") {
+  auto program =
+      regex::Program::Compile(regex::Exp::FromStr("(a*)*c|a*b"));
+  regex::Jit jit;
+  REQUIRE(jit.Build(program));
+  std::vector<size_t> slots;
+  REQUIRE(jit.Search("aab", 0, &slots) == regex::Jit::GaveUp);
+  REQUIRE(jit.Build(program, size_t{256} << 10));
+  REQUIRE(jit.Search("aab", 0, &slots) == regex::Jit::Matched);
+  std::string s(size_t{256} << 10, 'a');
+  REQUIRE(jit.Search(s + "b", 0, &slots) == regex::Jit::GaveUp);
+}
+
+TEST_CASE("jit gives up when its stack overflows") {
+  auto program = regex::Program::Compile(regex::Exp::FromStr("(a|b)*c"));
+  regex::Jit jit;
+  REQUIRE(jit.Build(program, size_t{16} << 20));
+  std::string s(regex::Jit::kMaxFrames, 'a');
+  std::vector<size_t> slots;
+  REQUIRE(jit.Search(s, 0, &slots) == regex::Jit::GaveUp);
+
+  auto graph = regex::Graph::Compile("(a|b)*c", {.jit = true});
+  REQUIRE(graph.Match(s + "c").Size() == s.size() + 1);
+}
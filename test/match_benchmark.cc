@@ -0,0 +1,344 @@
+//
+// Copyright [2020] <inhzus>
+//
+
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include <catch2/catch.hpp>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "regex/aho_corasick.h"
+#include "regex/backtrack.h"
+#include "regex/graph.h"
+#include "regex/pike.h"
+#include "regex/prefilter.h"
+#include "regex/regex_set.h"
+#include "regex/shift_and.h"
+#include "regex/static.h"
+
+static std::string Repeat(std::string_view s, size_t n) {
+  std::string ret;
+  ret.reserve(s.size() * n);
+  for (size_t i = 0; i < n; ++i) ret.append(s);
+  return ret;
+}
+
+TEST_CASE("vm and graph walker benchmark") {
+  const std::string log =
+      Repeat("GET /index.html 200 ", 50) + "ERROR: 1234 timeout";
+  auto literal = regex::Graph::Compile("ERROR: ([0-9]+)");
+  auto alternate = regex::Graph::Compile("(GET|POST|PUT) /(\\w+)\\.html");
+  auto lazy = regex::Graph::Compile("a.*?z|[^ ]+ timeout");
+  // @formatter:off
+  BENCHMARK("walker literal") {
+    regex::Matcher matcher(log, 2, {});
+    literal.Walk(log, &matcher);
+    return matcher.ok();
+  };
+  BENCHMARK("vm literal") { return literal.Match(log).ok(); };
+  BENCHMARK("walker alternation") {
+    regex::Matcher matcher(log, 3, {});
+    alternate.Walk(log, &matcher);
+    return matcher.ok();
+  };
+  BENCHMARK("vm alternation") { return alternate.Match(log).ok(); };
+  BENCHMARK("walker lazy") {
+    regex::Matcher matcher(log, 1, {});
+    lazy.Walk(log, &matcher);
+    return matcher.ok();
+  };
+  BENCHMARK("vm lazy") { return lazy.Match(log).ok(); };
+  // @formatter:on
+}
+
+TEST_CASE("pike vm and backtracker benchmark") {
+  const std::string hostile(20, 'a');
+  auto program = regex::Program::Compile(regex::Exp::FromStr("(a|a)*b"));
+  std::vector<size_t> slots;
+  // @formatter:off
+  BENCHMARK("backtracker hostile") {
+    return regex::Backtracker(program).Search(hostile, &slots);
+  };
+  BENCHMARK("pike vm hostile") {
+    return regex::PikeVm(program).Search(hostile, &slots);
+  };
+  // @formatter:on
+}
+
+TEST_CASE("memoized backtracker benchmark") {
+  const std::string hostile(16, 'a');
+  auto program =
+      regex::Program::Compile(regex::Exp::FromStr("(a|a)*(?!x)b"));
+  std::vector<size_t> slots;
+  // @formatter:off
+  BENCHMARK("plain backtracker hostile") {
+    return regex::Backtracker(program).Search(hostile, &slots);
+  };
+  BENCHMARK("memoized backtracker hostile") {
+    return regex::Backtracker(program, 1 << 20).Search(hostile, &slots);
+  };
+  // @formatter:on
+}
+
+TEST_CASE("dfa benchmark") {
+  const std::string line = Repeat("GET /index.html 200 ", 50);
+  auto graph = regex::Graph::Compile("(\\w+)@(\\w+)\\.com");
+  auto program =
+      regex::Program::Compile(regex::Exp::FromStr("(\\w+)@(\\w+)\\.com"));
+  std::vector<size_t> slots;
+  // @formatter:off
+  BENCHMARK("pike vm reject") {
+    return regex::PikeVm(program).Search(line, &slots);
+  };
+  BENCHMARK("lazy dfa reject") { return graph.Test(line); };
+  auto full = regex::Graph::Compile("(\\w+)@(\\w+)\\.com");
+  full.CompileDfa();
+  BENCHMARK("full dfa reject") { return full.Test(line); };
+  // @formatter:on
+}
+
+TEST_CASE("shift-and benchmark") {
+  const std::string line = Repeat("GET /index.html 200 ", 50);
+  auto exp = regex::Exp::FromStr("\\d\\d-\\d\\d");
+  regex::ShiftAnd shift_and;
+  shift_and.Build(exp);
+  auto program = std::make_shared<const regex::Program>(
+      regex::Program::Compile(exp));
+  regex::LazyDfa lazy(program, 1 << 20);
+  size_t end;
+  // @formatter:off
+  BENCHMARK("lazy dfa small pattern") { return lazy.Search(line, &end); };
+  BENCHMARK("shift-and small pattern") { return shift_and.Test(line); };
+  // @formatter:on
+}
+
+TEST_CASE("match span benchmark") {
+  const std::string line =
+      Repeat("GET /index.html 200 ", 50) + "mail me@example.com";
+  const char *pattern = "(\\w+)@(\\w+)\\.com";
+  auto graph = regex::Graph::Compile(pattern);
+  auto program = regex::Program::Compile(regex::Exp::FromStr(pattern));
+  std::vector<size_t> slots;
+  // @formatter:off
+  BENCHMARK("pike vm whole line") {
+    return regex::PikeVm(program).Search(line, &slots);
+  };
+  BENCHMARK("dfa located span") { return graph.Match(line).ok(); };
+  // small enough for shift-and, the lazy DFA still locates the span
+  auto small = regex::Graph::Compile("\\d\\d-\\d\\d");
+  const std::string date = Repeat("GET /index.html 200 ", 50) + "on 12-31";
+  BENCHMARK("shift-and pattern located span") {
+    return small.Match(date).ok();
+  };
+  // @formatter:on
+}
+
+TEST_CASE("prefilter benchmark") {
+  const std::string line = Repeat("GET /index.html 200 ", 50);
+  auto exp = regex::Exp::FromStr("\\d+ms timeout");
+  regex::Prefilter prefilter;
+  prefilter.Build(exp);
+  auto program = std::make_shared<const regex::Program>(
+      regex::Program::Compile(exp));
+  regex::LazyDfa lazy(program, 1 << 20);
+  size_t end;
+  // @formatter:off
+  BENCHMARK("lazy dfa inner literal") { return lazy.Search(line, &end); };
+  BENCHMARK("teddy inner literal") { return prefilter.Find(line, 0); };
+  // @formatter:on
+}
+
+TEST_CASE("aho-corasick benchmark") {
+  std::string pattern;
+  for (size_t i = 0; i < 1000; ++i) {
+    if (i != 0) pattern.push_back('|');
+    pattern += "kw" + std::to_string(i * 7919 % 100000);
+  }
+  const std::string line = Repeat("GET /index.html 200 ", 50) + "kw7919";
+  auto exp = regex::Exp::FromStr(pattern);
+  regex::AhoCorasick ac;
+  ac.Build(exp);
+  auto program = std::make_shared<const regex::Program>(
+      regex::Program::Compile(exp));
+  regex::LazyDfa lazy(program, 16 << 20);
+  size_t begin, end;
+  // @formatter:off
+  BENCHMARK("lazy dfa keywords") { return lazy.Search(line, &end); };
+  BENCHMARK("aho-corasick keywords") { return ac.Search(line, &begin, &end); };
+  // @formatter:on
+}
+
+TEST_CASE("regex set benchmark") {
+  const std::string line = Repeat("GET /index.html 200 ", 50);
+  std::vector<std::string> keys;
+  for (size_t i = 0; i < 50; ++i) {
+    std::string key = "k";
+    key += std::to_string(i);
+    key += "=\\d+";
+    keys.push_back(std::move(key));
+  }
+  std::vector<std::string_view> patterns(keys.begin(), keys.end());
+  auto set = regex::RegexSet::Compile(patterns);
+  std::vector<regex::Graph> graphs;
+  for (auto pattern : patterns) {
+    graphs.push_back(regex::Graph::Compile(pattern));
+  }
+  // @formatter:off
+  BENCHMARK("graph per pattern") {
+    size_t n = 0;
+    for (const auto &graph : graphs) n += graph.Test(line);
+    return n;
+  };
+  BENCHMARK("regex set") { return set.Matches(line).size(); };
+  // @formatter:on
+}
+
+TEST_CASE("anchored benchmark") {
+  // the literal is there, so the prefilter lets the text through
+  const std::string line = Repeat("GET /index.html 200 ", 50) + "-404";
+  auto anchored = regex::Graph::Compile("^(?=\\w)(\\w+) 404");
+  auto unanchored = regex::Graph::Compile("(?:^|x)(?=\\w)(\\w+) 404");
+  // @formatter:off
+  BENCHMARK("backtracker every start") { return unanchored.Match(line).ok(); };
+  BENCHMARK("backtracker anchored") { return anchored.Match(line).ok(); };
+  BENCHMARK("backtracker full match") { return anchored.FullMatch(line).ok(); };
+  // @formatter:on
+}
+
+TEST_CASE("static regex benchmark") {
+  const std::string line =
+      Repeat("GET /index.html 200 ", 5) + "mail me@example.com";
+  auto graph = regex::Graph::Compile("(\\w+)@(\\w+)\\.com");
+  using Email = regex::Static<"(\\w+)@(\\w+)\\.com">;
+  // @formatter:off
+  BENCHMARK("graph match") { return graph.Match(line).ok(); };
+  BENCHMARK("static match") { return Email::Match(line).ok(); };
+  // @formatter:on
+}
+
+TEST_CASE("jit benchmark") {
+  const std::string line = "GET /api/v2/users/12345/orders?limit=20 HTTP/1.1";
+  const char *pattern = "^(GET|POST) /api/v(\\d+)/(\\w+)/(\\d+)(/\\w+)?";
+  auto graph = regex::Graph::Compile(pattern);
+  auto jit = regex::Graph::Compile(pattern, {.jit = true});
+  // @formatter:off
+  BENCHMARK("interpreter match") { return graph.Match(line).ok(); };
+  BENCHMARK("jit match") { return jit.Match(line).ok(); };
+  // @formatter:on
+}
+
+TEST_CASE("compile benchmark") {
+  const std::string pattern =
+      Repeat("(?P<x>\\w+)=(a|bc?)*[0-9]{2,4}|", 20) + "end";
+  // @formatter:off
+  BENCHMARK("compile graph") { return regex::Graph::Compile(pattern); };
+  // @formatter:on
+}
+
+TEST_CASE("class scan benchmark") {
+  const std::string text = Repeat("lorem ipsum dolor sit amet ", 40) + "id=42";
+  auto program = regex::Program::Compile(regex::Exp::FromStr("[0-9]+"));
+  regex::Backtracker backtracker(program);
+  std::vector<size_t> slots;
+  // @formatter:off
+  BENCHMARK("digits search") { return backtracker.Search(text, &slots); };
+  // @formatter:on
+}
+
+TEST_CASE("walker benchmark") {
+  const std::string line =
+      Repeat("GET /index.html 200 ", 5) + "POST /login 302";
+  auto graph = regex::Graph::Compile("POST /(login|logout) (\\d+)");
+  regex::Matcher matcher(line, 3, {});
+  // @formatter:off
+  BENCHMARK("walk") { graph.Walk(line, &matcher); return matcher.ok(); };
+  // @formatter:on
+  const std::string text = Repeat("ab", 500) + "c";
+  auto loop = regex::Graph::Compile("(?:a|b)+(c)");
+  regex::MatchScratch scratch;
+  // @formatter:off
+  BENCHMARK("walk loop") {
+    loop.Walk(text, &matcher, &scratch);
+    return matcher.ok();
+  };
+  // @formatter:on
+}
+
+TEST_CASE("matcher and scratch reuse benchmark") {
+  const std::string line = "user=alice id=42";
+  auto graph = regex::Graph::Compile("user=(?P<name>\\w+) id=(?P<id>\\d+)");
+  regex::Matcher matcher;
+  regex::MatchScratch scratch;
+  // @formatter:off
+  BENCHMARK("fresh matcher") { return graph.Match(line).Group("id"); };
+  BENCHMARK("reused matcher") {
+    graph.Match(line, &matcher);
+    return matcher.Group("id");
+  };
+  BENCHMARK("reused matcher and scratch") {
+    graph.Match(line, &matcher, &scratch);
+    return matcher.Group("id");
+  };
+  // @formatter:on
+}
+
+TEST_CASE("ast passes benchmark") {
+  const std::string text = Repeat("abcd", 50) + "xyw";
+  const char *pattern = "((?:a|b|c|d)+)(?:xyz|xyw)";
+  regex::Options plain;
+  plain.passes = {false, false, false, false, false};
+  auto unsimplified = regex::Graph::Compile(pattern, plain);
+  auto simplified = regex::Graph::Compile(pattern);
+  regex::Matcher matcher;
+  regex::MatchScratch scratch;
+  // @formatter:off
+  BENCHMARK("without passes") {
+    unsimplified.Match(text, &matcher, &scratch);
+    return matcher.ok();
+  };
+  BENCHMARK("with passes") {
+    simplified.Match(text, &matcher, &scratch);
+    return matcher.ok();
+  };
+  // @formatter:on
+}
+
+TEST_CASE("counted repetition benchmark") {
+  const std::string line =
+      Repeat("GET /index.html 200 1.5 ", 4) + "from 192.168.10.254";
+  const char *pattern = "\\d{1,3}(\\.\\d{1,3}){3}";
+  regex::Options counted;
+  counted.passes.unroll_repeats = false;
+  auto counter = regex::Graph::Compile(pattern, counted);
+  auto unrolled = regex::Graph::Compile(pattern);
+  regex::Matcher matcher;
+  regex::MatchScratch scratch;
+  // @formatter:off
+  BENCHMARK("walk with counters") {
+    counter.Walk(line, &matcher, &scratch);
+    return matcher.ok();
+  };
+  BENCHMARK("walk unrolled") {
+    unrolled.Walk(line, &matcher, &scratch);
+    return matcher.ok();
+  };
+  // @formatter:on
+}
+
+TEST_CASE("possessive split benchmark") {
+  const std::string line = Repeat("\"GET /index.html\" 200 1024 ", 20);
+  auto quoted =
+      regex::Program::Compile(regex::Exp::FromStr("\"([^\"]*)\"\\s+x"));
+  auto port = regex::Program::Compile(regex::Exp::FromStr("(\\d+):(\\d+)"));
+  std::vector<size_t> slots;
+  // @formatter:off
+  BENCHMARK("backtracker quoted reject") {
+    return regex::Backtracker(quoted).Search(line, &slots);
+  };
+  BENCHMARK("backtracker digits reject") {
+    return regex::Backtracker(port).Search(line, &slots);
+  };
+  // @formatter:on
+}
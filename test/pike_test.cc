@@ -0,0 +1,95 @@
+//
+// Copyright [2020] <inhzus>
+//
+
+#include "regex/pike.h"
+
+#include <catch2/catch.hpp>
+#include <string>
+#include <vector>
+
+#include "regex/backtrack.h"
+#include "regex/graph.h"
+
+TEST_CASE("pike vm selected without backtracking constructs") {
+  auto compile = [](std::string_view s) {
+    return regex::Program::Compile(regex::Exp::FromStr(s));
+  };
+  REQUIRE_FALSE(compile("(a|b)*c{2,3}[^d]+?").backtrack());
+  REQUIRE(compile("(?P<a>b)(?P=a)").backtrack());
+  REQUIRE(compile("a(?=b)").backtrack());
+  REQUIRE(compile("a(?!b)").backtrack());
+  REQUIRE(compile("(?>a|ab)c").backtrack());
+  REQUIRE(compile("a*+").backtrack());
+}
+
+TEST_CASE("pike vm agrees with backtracker") {
+  std::vector<std::pair<const char *, std::vector<const char *>>> cases{
+      {"aa*|b(cd*(e|fg))?h|i", {"bcdddfgh", "i", "bh", "xbcdefh", "cd"}},
+      {"(a|b)*?a", {"babac", "bbb", ""}},
+      {"(a|ab)(c|bcd)(d*)", {"abcd", "abcdd", "xabc"}},
+      {"(a*)+b", {"aab", "b", "aa"}},
+      {"(a?)*?b", {"aab", "b"}},
+      {"a{2,3}?(a*)", {"aaaaa", "a"}},
+      {"(\\w+)@(\\w+)\\.com$", {"mail me@example.com", "me@x.co"}},
+      {"^(ab|a)(b*)$", {"abbb", "a", "ba"}},
+      {".*?(\\d+)", {"abc 123 456", "none"}},
+      {"(\\d+):(\\d*)$", {"at 12:30", "12:3a", "1:", "12"}},
+      {"\"([^\"]*)\"x", {"say \"hi\"x", "\"a\"\"b\"x", "\"open"}},
+      {"([a-z]+)\\s+(\\d+|x)", {"ab  12", "ab x", "ab"}},
+  };
+  for (const auto &[pattern, inputs] : cases) {
+    auto program = regex::Program::Compile(regex::Exp::FromStr(pattern));
+    for (std::string_view s : inputs) {
+      std::vector<size_t> pike_slots, backtrack_slots;
+      bool pike = regex::PikeVm(program).Search(s, &pike_slots);
+      bool backtrack = regex::Backtracker(program).Search(s, &backtrack_slots);
+      REQUIRE(pike == backtrack);
+      if (pike) REQUIRE(pike_slots == backtrack_slots);
+    }
+  }
+}
+
+TEST_CASE("pike vm stays linear on hostile input") {
+  auto graph = regex::Graph::Compile("(a|a)*b");
+  std::string s(5000, 'a');
+  REQUIRE_FALSE(graph.Match(s));
+  s.push_back('b');
+  REQUIRE(5001 == graph.MatchLen(s));
+
+  graph = regex::Graph::Compile("(a*)*(a*)*c");
+  REQUIRE_FALSE(graph.Match(std::string(2000, 'a')));
+}
+
+TEST_CASE("memoized backtracker agrees with plain backtracker") {
+  std::vector<std::pair<const char *, std::vector<const char *>>> cases{
+      {"(a|ab)(c|bcd)(d*)", {"abcd", "abcdd", "xabc"}},
+      {"(a*)+b", {"aab", "b", "aa"}},
+      {"(a?)*?b", {"aab", "b"}},
+      {"(\\w+)(?=@)", {"me@example.com", "none"}},
+      {"(a|b)*(?!c)(b)", {"aabbc", "abab", "bc"}},
+      {"(?>a|ab)c", {"abc", "ac"}},
+      {"(a+)*+b", {"aaab", "aaa"}},
+      {"x(?=(a*)*b)(\\w*)", {"xaab", "xaa"}},
+      {"((?>a*)|b)*c", {"aabac", "bbd"}},
+  };
+  for (const auto &[pattern, inputs] : cases) {
+    auto program = regex::Program::Compile(regex::Exp::FromStr(pattern));
+    for (std::string_view s : inputs) {
+      std::vector<size_t> plain_slots, memo_slots;
+      bool plain = regex::Backtracker(program).Search(s, &plain_slots);
+      bool memo =
+          regex::Backtracker(program, 1 << 20).Search(s, &memo_slots);
+      REQUIRE(plain == memo);
+      if (plain) REQUIRE(plain_slots == memo_slots);
+    }
+  }
+}
+
+TEST_CASE("memoized backtracker stays linear on hostile input") {
+  auto graph = regex::Graph::Compile("(a|a)*(?!x)b");
+  std::string s(3000, 'a');
+  REQUIRE_FALSE(graph.Match(s));
+  s.push_back('b');
+  REQUIRE(3001 == graph.MatchLen(s));
+}
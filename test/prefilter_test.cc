@@ -0,0 +1,89 @@
+//
+// Copyright [2020] <inhzus>
+//
+
+#include "regex/prefilter.h"
+
+#include <catch2/catch.hpp>
+#include <string>
+#include <vector>
+
+#include "regex/graph.h"
+
+static std::vector<std::string> Literals(std::string_view s) {
+  regex::Prefilter prefilter;
+  prefilter.Build(regex::Exp::FromStr(s));
+  return prefilter.literals();
+}
+
+TEST_CASE("prefilter literals extracted from expression") {
+  using V = std::vector<std::string>;
+  REQUIRE(Literals("\\w+@example\\.com") == V{"@example.com"});
+  REQUIRE(Literals("[0-9]+ms timeout") == V{"ms timeout"});
+  REQUIRE(Literals("(foo|bar)\\d+x") == V{"bar", "foo"});
+  REQUIRE(Literals("\\d+ab?c") == V{"abc", "ac"});
+  REQUIRE(Literals("x(?!error)\\w+").size() == 1);
+  REQUIRE(Literals("x*").empty());
+  REQUIRE(Literals("\\d+").empty());
+  REQUIRE(Literals("a|\\d").empty());
+}
+
+TEST_CASE("prefilter finds literals across chunks") {
+  regex::Prefilter single, multiple;
+  single.Build(regex::Exp::FromStr("\\d+needle"));
+  multiple.Build(regex::Exp::FromStr("\\w(foo|bar|quux)\\d"));
+  std::string s(200, '.');
+  s.replace(14, 6, "needle");  // straddles the first 16 bytes
+  s.replace(63, 3, "bar");
+  s.replace(150, 4, "quux");
+  s.replace(197, 3, "foo");  // left to the scalar tail
+  REQUIRE(14 == single.Find(s, 0));
+  REQUIRE(regex::Prefilter::npos == single.Find(s, 15));
+  REQUIRE(63 == multiple.Find(s, 0));
+  REQUIRE(150 == multiple.Find(s, 64));
+  REQUIRE(197 == multiple.Find(s, 151));
+  REQUIRE(regex::Prefilter::npos == multiple.Find(s, 198));
+  REQUIRE(regex::Prefilter::npos == multiple.Find("qu", 0));
+  // bytes sharing both nibbles of a fingerprint with no literal
+  REQUIRE(regex::Prefilter::npos ==
+          multiple.Find(std::string(40, 'f') + "bao" + "qux", 0));
+}
+
+TEST_CASE("prefilter rejects texts before matching") {
+  std::string s(300, 'x');
+  auto graph = regex::Graph::Compile("(\\w+)@example\\.com");
+  REQUIRE_FALSE(graph.Test(s));
+  REQUIRE(graph.MatchEnd(s) == -1);
+  REQUIRE_FALSE(graph.Match(s).ok());
+  s += "@example.com";
+  REQUIRE(graph.Test(s));
+  REQUIRE(graph.MatchEnd(s) == 312);
+  REQUIRE(graph.Match(s).Group(1) == std::string(300, 'x'));
+
+  graph = regex::Graph::Compile("(?P<a>\\d)(?P=a)ms");
+  REQUIRE_FALSE(graph.Test("1122 1s"));
+  REQUIRE(graph.Match("12 11ms").BeginIdx() == 3);
+}
+
+TEST_CASE("prefilter leading literals start the engines") {
+  regex::Prefilter prefilter;
+  REQUIRE(prefilter.Build(regex::Exp::FromStr("(foo|bar)\\d+x")));
+  REQUIRE(prefilter.leading());
+  REQUIRE(prefilter.Build(regex::Exp::FromStr("^(?=b)bar\\d")));
+  REQUIRE(prefilter.leading());
+  REQUIRE(prefilter.Build(regex::Exp::FromStr("\\w+@example\\.com")));
+  REQUIRE_FALSE(prefilter.leading());
+
+  // the Pike VM and the backtracker, from the first candidate on
+  for (const char *pattern : {"(foo|bar)(\\d+)x", "(foo|bar)(\\d+)(?=x)"}) {
+    auto graph = regex::Graph::Compile(pattern);
+    auto matcher = graph.Match("xx foo12 bar34x");
+    REQUIRE(matcher.BeginIdx() == 9);
+    REQUIRE(matcher.Group(1) == "bar");
+    REQUIRE(matcher.Group(2) == "34");
+    REQUIRE_FALSE(graph.Match("xx foo12 bar34").ok());
+  }
+  auto anchored = regex::Graph::Compile("^foo\\d");
+  REQUIRE_FALSE(anchored.Match("xfoo1").ok());
+  REQUIRE(anchored.Match("foo1").ok());
+}
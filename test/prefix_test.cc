@@ -0,0 +1,72 @@
+//
+// Copyright [2020] <inhzus>
+//
+
+#include "regex/prefix.h"
+
+#include <catch2/catch.hpp>
+#include <string>
+#include <vector>
+
+#include "regex/graph.h"
+
+static std::vector<std::string> Literals(std::string_view s) {
+  regex::Prefix prefix;
+  prefix.Build(regex::Exp::FromStr(s));
+  return prefix.literals();
+}
+
+TEST_CASE("prefix literals extracted from expression") {
+  using V = std::vector<std::string>;
+  REQUIRE(Literals("ERROR: (\\d+)") == V{"ERROR: "});
+  REQUIRE(Literals("(GET|POST) /api") == V{"GET /api", "POST /api"});
+  REQUIRE(Literals("x(a|b)?y") == V{"xay", "xby", "xy"});
+  REQUIRE(Literals("[ab]c|d") == V{"ac", "bc", "d"});
+  REQUIRE(Literals("ab|abc") == V{"ab"});
+  REQUIRE(Literals("a{2,}b") == V{"a"});
+  REQUIRE(Literals("^(?=x)ab$") == V{"ab"});
+  REQUIRE(Literals("a*b") == V{"a", "b"});
+  REQUIRE(Literals("b|a*").empty());
+  REQUIRE(Literals("\\w+@").empty());
+  REQUIRE(Literals(".b").empty());
+  REQUIRE(Literals("(?P<a>x)(?P=a)") == V{"x"});
+}
+
+TEST_CASE("prefix finds candidates") {
+  regex::Prefix single, multiple;
+  single.Build(regex::Exp::FromStr("needle"));
+  multiple.Build(regex::Exp::FromStr("(foo|bar|baz)\\d"));
+  std::string s(100, '.');
+  s.replace(40, 3, "baz");
+  s.replace(70, 6, "needle");
+  s.replace(97, 3, "foo");
+  REQUIRE(70 == single.Find(s, 0));
+  REQUIRE(70 == single.Find(s, 70));
+  REQUIRE(regex::Prefix::npos == single.Find(s, 71));
+  REQUIRE(40 == multiple.Find(s, 0));
+  REQUIRE(97 == multiple.Find(s, 41));
+  REQUIRE(regex::Prefix::npos == multiple.Find(s, 98));
+  REQUIRE(regex::Prefix::npos == multiple.Find("ba", 0));
+}
+
+TEST_CASE("prefix skipping keeps the matches") {
+  std::string s(200, 'x');
+  s += "GET /api/users 200";
+  auto graph = regex::Graph::Compile("GET /api/(\\w+)");
+  auto matcher = graph.Match(s);
+  REQUIRE(matcher.BeginIdx() == 200);
+  REQUIRE(matcher.Group(1) == "users");
+  REQUIRE(graph.Test(s));
+  REQUIRE_FALSE(graph.Test(std::string(200, 'x')));
+  REQUIRE(graph.CompileDfa());
+  REQUIRE(graph.MatchEnd(s) == 214);
+
+  graph = regex::Graph::Compile("^ab");
+  REQUIRE_FALSE(graph.Test("xab"));
+  REQUIRE(graph.Test("abx"));
+  REQUIRE(graph.CompileDfa());
+  REQUIRE_FALSE(graph.Test("xab"));
+
+  graph = regex::Graph::Compile("(?>ab|a)(?=c)");
+  REQUIRE(graph.Match("xxabxac").BeginIdx() == 5);
+}
@@ -0,0 +1,243 @@
+//
+// Copyright [2020] <inhzus>
+//
+
+#include "regex/program.h"
+
+#include <catch2/catch.hpp>
+#include <chrono>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "regex/graph.h"
+
+inline std::string Dump(std::string_view s) {
+  return regex::Program::Compile(regex::Exp::FromStr(s)).Dump();
+}
+
+TEST_CASE("program compile") {
+  REQUIRE(Dump("ab") ==
+          "0: save 0\n"
+          "1: char a\n"
+          "2: char b\n"
+          "3: save 1\n"
+          "4: match\n");
+  REQUIRE(Dump("a|b") ==
+          "0: save 0\n"
+          "1: split 2, 4\n"
+          "2: char a\n"
+          "3: jmp 5\n"
+          "4: char b\n"
+          "5: save 1\n"
+          "6: match\n");
+  REQUIRE(Dump("a*?") ==
+          "0: save 0\n"
+          "1: split 4, 2\n"
+          "2: char a\n"
+          "3: jmp 1\n"
+          "4: save 1\n"
+          "5: match\n");
+  REQUIRE(Dump("(a)+") ==
+          "0: save 0\n"
+          "1: save 2\n"
+          "2: char a\n"
+          "3: save 3\n"
+          "4: split 1, 5\n"
+          "5: save 1\n"
+          "6: match\n");
+  REQUIRE(Dump("a{2,3}") ==
+          "0: save 0\n"
+          "1: char a\n"
+          "2: char a\n"
+          "3: split 4, 5\n"
+          "4: char a\n"
+          "5: save 1\n"
+          "6: match\n");
+  REQUIRE(Dump("(?:a?)*") ==
+          "0: save 0\n"
+          "1: split 2, 7\n"
+          "2: mark 2\n"
+          "3: split 4, 5\n"
+          "4: char a\n"
+          "5: progress 2\n"
+          "6: jmp 1\n"
+          "7: save 1\n"
+          "8: match\n");
+}
+
+TEST_CASE("program empty loops terminate") {
+  auto graph = regex::Graph::Compile("(a?)*b");
+  REQUIRE(2 == graph.MatchLen("ab"));
+  REQUIRE(1 == graph.MatchLen("b"));
+  graph = regex::Graph::Compile("(a*)+b");
+  REQUIRE(3 == graph.MatchLen("aab"));
+  REQUIRE(-1 == graph.MatchLen("aa"));
+  graph = regex::Graph::Compile("(?:a*)*");
+  REQUIRE(0 == graph.Match("b").BeginIdx());
+  REQUIRE(0 == graph.MatchLen("b"));
+}
+
+TEST_CASE("program size budget") {
+  // copied out, the repetitions would need a billion instructions
+  auto exp = regex::Exp::FromStr("(?:(?:a{1000}){1000}){1000}");
+  REQUIRE(regex::Program::Compile(exp).empty());
+  REQUIRE(!regex::Graph::Compile(std::move(exp)).Test("aaaa"));
+  REQUIRE(!regex::Program::Compile(regex::Exp::FromStr("a{1000}")).empty());
+  regex::Options options;
+  options.max_program_size = 100;
+  REQUIRE(!regex::Graph::Compile("(a{10})+b", options).program().empty());
+  // too large patterns are walked, the anchored calls included
+  auto graph = regex::Graph::Compile("(a{10}){10}b|(c)", options);
+  REQUIRE(graph.program().empty());
+  std::string s(100, 'a');
+  s += 'b';
+  std::string text = "x";
+  text += s;
+  REQUIRE(graph.Test(text));
+  REQUIRE(!graph.Test(s.substr(1)));
+  REQUIRE(101 == graph.MatchLen(text));
+  REQUIRE(graph.Match("xc").Group(2) == "c");
+  REQUIRE(!graph.MatchAnchored(text).ok());
+  s += 'c';
+  REQUIRE(graph.MatchAnchored(s).ok());
+  REQUIRE(!graph.FullMatch(s).ok());
+  REQUIRE(graph.FullMatch("c").ok());
+  REQUIRE(!graph.CompileDfa());
+  // look-aheads match where they stand, whichever engine runs them
+  for (size_t max_size : {regex::Program::kMaxSize, size_t{1}}) {
+    options.max_program_size = max_size;
+    graph = regex::Graph::Compile("a(?=(b)c)|a(b)", options);
+    REQUIRE(graph.program().empty() == (max_size == 1));
+    REQUIRE(!graph.Test("axxbc"));
+    auto matcher = graph.Match("abd");
+    REQUIRE(matcher.Str() == "ab");
+    REQUIRE(matcher.Group(1).empty());
+    REQUIRE(matcher.Group(2) == "b");
+    matcher = graph.Match("xabc");
+    REQUIRE(matcher.Str() == "a");
+    REQUIRE(matcher.Group(1) == "b");
+    REQUIRE(!graph.Match("ac").ok());
+  }
+}
+
+TEST_CASE("program vm agrees with graph walker") {
+  std::vector<std::pair<const char *, std::vector<const char *>>> cases{
+      {"aa*|b(cd*(e|fg))?h|i", {"bcdddfgh", "i", "bh", "xbcdefh", "cd"}},
+      {"(a|b)*?a", {"babac", "bbb", ""}},
+      {"a.??b", {"abb", "acb", "ab"}},
+      {"a{1,5}b", {"ab", "aaaaaab", "b"}},
+      {"(?P<a>b|c)(?P=a)d", {"bbd", "bcd", "ccd", "xccd"}},
+      {"(?>aa|a)a", {"aa", "aaa", "aaaa"}},
+      {"a*+b", {"aaab", "b", "aa"}},
+      {"[^ab]+[\\d]", {"cc1", "ab"}},
+      {"^a$", {"a", "aa", ""}},
+      {"a(b)(?P<foo>cd)", {"abcd", "xxabcdab"}},
+      {"a(?=(b))(b|c)", {"ab", "ac"}},
+      {"(ab){2,3}?c|d++", {"ababc", "abc", "dd"}},
+      {"(abc|abd)e", {"abde", "xabce", "abe"}},
+      {"x(?=hello)hel", {"xhello", "xhelp"}},
+      {"a(?:bc)*d(?!ef)", {"abcbcdeg", "adef", "abd"}},
+  };
+  for (const auto &[pattern, inputs] : cases) {
+    auto graph = regex::Graph::Compile(pattern);
+    for (std::string_view s : inputs) {
+      auto vm = graph.Match(s);
+      regex::Matcher walker(s, vm.groups().size(), {});
+      graph.Walk(s, &walker);
+      REQUIRE(vm.ok() == walker.ok());
+      if (!vm.ok()) continue;
+      for (size_t i = 0; i < vm.groups().size(); ++i) {
+        REQUIRE(vm.Group(i) == walker.Group(i));
+      }
+    }
+  }
+}
+
+TEST_CASE("program anchoring detected") {
+  auto anchored = [](const char *pattern) {
+    return regex::Program::Compile(regex::Exp::FromStr(pattern)).anchored();
+  };
+  REQUIRE(anchored("^abc"));
+  REQUIRE(anchored("^a|^b"));
+  REQUIRE(anchored("(^a|(?:^b)c)d+"));
+  REQUIRE(anchored("(?P<x>^a)"));
+  REQUIRE_FALSE(anchored("^a|b"));
+  REQUIRE_FALSE(anchored("(^a)?b"));
+  REQUIRE_FALSE(anchored("a^"));
+  REQUIRE_FALSE(anchored("abc"));
+
+  for (const char *pattern : {"^ab", "^a|^b", "^(?=a)a+", "^(?P<a>a)(?P=a)"}) {
+    auto graph = regex::Graph::Compile(pattern);
+    for (std::string_view s : {"ab", "xab", "b", "aa", ""}) {
+      auto vm = graph.Match(s);
+      regex::Matcher walker(s, vm.groups().size(), {});
+      graph.Walk(s, &walker);
+      REQUIRE(vm.ok() == walker.ok());
+      if (vm.ok()) REQUIRE(vm.Str() == walker.Str());
+    }
+  }
+}
+
+TEST_CASE("program anchored and full matches") {
+  std::vector<std::pair<const char *, std::vector<const char *>>> cases{
+      {"a|ab", {"ab", "a", "xab", "abx"}},
+      {"(a+)(b*)", {"aab", "aabx", "baab", ""}},
+      {"(?>a|ab)c?", {"abc", "ac", "ab"}},
+      {"(?P<q>x)\\w*(?P=q)", {"xyzx", "xyzxy", "yx"}},
+      {"\\d+ms|\\d+", {"12ms", "12", "12mss", "a12"}},
+  };
+  for (const auto &[pattern, inputs] : cases) {
+    auto graph = regex::Graph::Compile(pattern);
+    auto start = regex::Graph::Compile("^(?:" + std::string(pattern) + ")");
+    auto both = regex::Graph::Compile("^(?:" + std::string(pattern) + ")$");
+    for (std::string_view s : inputs) {
+      auto anchored = graph.MatchAnchored(s);
+      auto expected = start.Match(s);
+      REQUIRE(anchored.ok() == expected.ok());
+      if (anchored.ok()) REQUIRE(anchored.groups() == expected.groups());
+      auto full = graph.FullMatch(s);
+      expected = both.Match(s);
+      REQUIRE(full.ok() == expected.ok());
+      if (full.ok()) REQUIRE(full.groups() == expected.groups());
+    }
+  }
+}
+
+TEST_CASE("program possessive splits") {
+  auto possessive = [](std::string_view s) {
+    auto program = regex::Program::Compile(regex::Exp::FromStr(s));
+    size_t count = 0;
+    for (uint32_t pc = 0; pc < program.insts().size(); ++pc) {
+      count += program.possessive(pc);
+    }
+    return count;
+  };
+  REQUIRE(1 == possessive("\\d+:"));
+  REQUIRE(1 == possessive("[^\"]*\""));
+  REQUIRE(1 == possessive("\\d+$"));
+  REQUIRE(1 == possessive("a*?b"));
+  REQUIRE(1 == possessive("abc|bcd"));
+  REQUIRE(2 == possessive("[a-z]+\\s+\\d"));
+  // the rest of the pattern may begin with the same byte, or match nothing
+  REQUIRE(0 == possessive("a*a"));
+  REQUIRE(0 == possessive("\\w+\\d"));
+  REQUIRE(0 == possessive("(?:ab)?"));
+  REQUIRE(0 == possessive("\\d+"));
+  REQUIRE(0 == possessive("a+(?=b)"));
+  // reverse programs and unions are not analyzed
+  auto exp = regex::Exp::FromStr("\\d+:");
+  auto forward = regex::Program::Compile(exp);
+  auto reverse = regex::Program::Compile(exp, true);
+  auto both = regex::Program::Union({&forward, &forward});
+  for (const auto *program : {&reverse, &both}) {
+    for (uint32_t pc = 0; pc < program->insts().size(); ++pc) {
+      REQUIRE_FALSE(program->possessive(pc));
+    }
+  }
+  // the splits are analyzed in one pass, not a walk of the program each
+  auto start = std::chrono::steady_clock::now();
+  REQUIRE(1 == possessive("(?:a?){20000}b"));
+  REQUIRE(0 == possessive("(?:b|a?){20000}"));
+  REQUIRE(std::chrono::steady_clock::now() - start < std::chrono::seconds(2));
+}
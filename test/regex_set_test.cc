@@ -0,0 +1,61 @@
+//
+// Copyright [2020] <inhzus>
+//
+
+#include "regex/regex_set.h"
+
+#include <catch2/catch.hpp>
+#include <string>
+#include <vector>
+
+TEST_CASE("regex set reports every matching pattern") {
+  std::vector<std::string_view> patterns = {
+      "ERROR",  "^GET ",      "\\d+ms$", "(a|b)*c",     "x(?=y)",
+      "^$",     "timeout|refused",      "[^ ]+@\\w+\\.com", "(?P<a>z)(?P=a)",
+      "a{2,3}b", "(?>ab)c|zz"};
+  auto set = regex::RegexSet::Compile(patterns);
+  REQUIRE(set.size() == patterns.size());
+  std::vector<std::string> texts = {
+      "",
+      "GET /index.html 200 12ms",
+      "POST ERROR connection refused",
+      "xy zz mail me@example.com",
+      "abababc aaab",
+      "GET",
+      "nothing here"};
+  std::vector<size_t> matches;
+  std::vector<uint32_t> pcs;
+  for (const auto &text : texts) {
+    std::vector<size_t> expected;
+    for (size_t idx = 0; idx < patterns.size(); ++idx) {
+      if (regex::Graph::Compile(patterns[idx]).Test(text)) {
+        expected.push_back(idx);
+      }
+    }
+    REQUIRE(set.Matches(text) == expected);
+    set.Matches(text, &matches, &pcs);
+    REQUIRE(matches == expected);
+    REQUIRE(set.Test(text) == !expected.empty());
+  }
+  REQUIRE(set.Matches("GET /a 1ms") == std::vector<size_t>{1, 2});
+}
+
+TEST_CASE("regex set falls back when the dfa gives up") {
+  regex::Options options;
+  options.dfa_cache_size = 1 << 10;
+  std::vector<std::string_view> patterns = {"a[ab]{12}c", "b[ab]{12}c",
+                                            "zzz"};
+  auto set = regex::RegexSet::Compile(patterns, options);
+  std::string s;
+  for (size_t i = 0; i < 5000; ++i) s.push_back("ab"[i * 7 % 3 % 2]);
+  s += "abbbbbbbbbbbbc baaaaaaaaaaaac";
+  REQUIRE(set.Matches(s) == std::vector<size_t>{0, 1});
+  REQUIRE(set.Matches(s.substr(0, 5000)).empty());
+  REQUIRE(regex::RegexSet::Compile({}).Matches(s).empty());
+  // nothing a search reported before giving up carries over
+  options.dfa_cache_size = 2 << 10;
+  set = regex::RegexSet::Compile(patterns, options);
+  std::string early = "abbbbbbbbbbbbc " + s.substr(0, 5000);
+  REQUIRE(set.Matches(early) == std::vector<size_t>{0});
+  REQUIRE(set.Matches("abbbbbbbbbbbbc") == std::vector<size_t>{0});
+}
@@ -0,0 +1,56 @@
+//
+// Copyright [2020] <inhzus>
+//
+
+#include "regex/shift_and.h"
+
+#include <catch2/catch.hpp>
+#include <string>
+#include <vector>
+
+#include "regex/pike.h"
+
+TEST_CASE("shift-and agrees with pike vm") {
+  std::vector<std::pair<const char *, std::vector<const char *>>> cases{
+      {"ab[cd]e?f", {"xabcef", "abdf", "abef", "abcdf", ""}},
+      {"\\d\\d-\\d\\d", {"on 12-34", "1-23", "12-3x45-67"}},
+      {"aa*|b(cd*(e|fg))?h|i", {"bcdddfgh", "i", "bh", "xbcdefh", "cd"}},
+      {"(a|b)*?abb", {"babababb", "bbb", "ab"}},
+      {"(a*)+b", {"aab", "b", "aa"}},
+      {"a{2,3}?(b*)c", {"aabbc", "abc", "aaaac"}},
+      {"(ab){2,}c", {"ababc", "abc", "xabababcx"}},
+      {"x(ab){0,2}y", {"xy", "xababy", "xabababy"}},
+      {"(?:a|b{2}){3}c", {"abbac", "abac", "bbbbbbc"}},
+      {"[^a-c]+d", {"abxyd", "abcd"}},
+      {"x*", {"", "y"}},
+      {".b.", {"ab", "abc"}},
+  };
+  for (const auto &[pattern, inputs] : cases) {
+    auto exp = regex::Exp::FromStr(pattern);
+    auto program = regex::Program::Compile(exp);
+    regex::ShiftAnd shift_and;
+    REQUIRE(shift_and.Build(exp));
+    for (std::string_view s : inputs) {
+      std::vector<size_t> slots;
+      REQUIRE(shift_and.Test(s) == regex::PikeVm(program).Search(s, &slots));
+    }
+  }
+}
+
+TEST_CASE("shift-and only takes small plain patterns") {
+  regex::ShiftAnd shift_and;
+  REQUIRE(shift_and.Build(regex::Exp::FromStr("a{3}(bc)+")));
+  REQUIRE(5 == shift_and.position_num());
+  REQUIRE(shift_and.Build(regex::Exp::FromStr("[ab]{64}")));
+  REQUIRE_FALSE(shift_and.Build(regex::Exp::FromStr("[ab]{65}")));
+  REQUIRE_FALSE(shift_and.Build(regex::Exp::FromStr("a{2,}b{100}")));
+  REQUIRE_FALSE(shift_and.Build(regex::Exp::FromStr("^ab")));
+  REQUIRE_FALSE(shift_and.Build(regex::Exp::FromStr("a*+a")));
+  REQUIRE_FALSE(shift_and.Build(regex::Exp::FromStr("a(?=b)")));
+
+  std::string s(63, 'a');
+  REQUIRE(shift_and.Build(regex::Exp::FromStr("a{64}")));
+  REQUIRE_FALSE(shift_and.Test(s));
+  s.push_back('a');
+  REQUIRE(shift_and.Test(s));
+}
@@ -0,0 +1,129 @@
+//
+// Copyright [2020] <inhzus>
+//
+
+#include "regex/static.h"
+
+#include <catch2/catch.hpp>
+#include <initializer_list>
+#include <string>
+#include <string_view>
+
+#include "regex/graph.h"
+
+template <regex::FixedString P>
+static void RequireAgrees(std::initializer_list<std::string_view> inputs) {
+  auto graph = regex::Graph::Compile(std::string_view(P.data, P.size()));
+  for (std::string_view s : inputs) {
+    auto expected = graph.Match(s);
+    auto matcher = regex::Static<P>::Match(s);
+    REQUIRE(matcher.ok() == expected.ok());
+    if (!matcher.ok()) continue;
+    REQUIRE(matcher.groups().size() == expected.groups().size());
+    for (size_t i = 0; i < matcher.groups().size(); ++i) {
+      REQUIRE(matcher.Group(i) == expected.Group(i));
+    }
+  }
+}
+
+TEST_CASE("static regex parsed at compile time") {
+  using Email = regex::Static<"(?P<user>\\w+)@(\\w+)\\.com">;
+  static_assert(Email::kGroupNum == 3);
+  static_assert(Email::Group("user") == 1);
+  static_assert(Email::Test("mail me@example.com"));
+  static_assert(!Email::Test("me@example.org"));
+  static_assert(regex::Static<"^a[^b-d]{2}$">::Match("axe").Size() == 3);
+
+  auto matcher = Email::Match("mail me@example.com");
+  REQUIRE(matcher);
+  REQUIRE(matcher.BeginIdx() == 5);
+  REQUIRE(matcher.EndIdx() == 19);
+  REQUIRE(matcher.Group("user") == "me");
+  REQUIRE(matcher.Group(2) == "example");
+  REQUIRE(matcher.Group("missing").empty());
+}
+
+TEST_CASE("static regex agrees with graph") {
+  RequireAgrees<"aa*|b(cd*(e|fg))?h|i">({"bcdddfgh", "i", "bh", "xbcdefh"});
+  RequireAgrees<"(a|b)*?a">({"babac", "bbb", ""});
+  RequireAgrees<"a.??b">({"abb", "acb", "ab"});
+  RequireAgrees<"a{1,5}b|c{2,}">({"ab", "aaaaaab", "b", "xccc"});
+  RequireAgrees<"(?P<a>b|c)(?P=a)d">({"bbd", "bcd", "ccd", "xccd"});
+  RequireAgrees<"(?>aa|a)a">({"aa", "aaa", "aaaa"});
+  RequireAgrees<"a*+b|a++c|a?+a">({"aaab", "b", "aac", "a"});
+  RequireAgrees<"[^ab]+[\\d]">({"cc1", "ab", "xa12"});
+  RequireAgrees<"^a$|^$">({"a", "aa", ""});
+  RequireAgrees<"a(?=bc)|a(?!b)\\w">({"abc", "abd", "ac", "a"});
+  RequireAgrees<"(a|ab)(c|bcd)(d*)">({"abcd", "xabcdd"});
+  RequireAgrees<"(\\s*\\S+)+?x">({"  a bx", " ab", "x"});
+  RequireAgrees<"(a?){2,3}b">({"ab", "aab", "b", "aaab"});
+  RequireAgrees<"[-a\\]]+|[\\W]">({"--]a", "x!", "abc"});
+}
+
+TEST_CASE("static regex ends empty loop iterations as the graph does") {
+  RequireAgrees<"(a*?)*x">({"aax", "x", "aa"});
+  RequireAgrees<"(a*?)+?$">({"aaaa", ""});
+  RequireAgrees<"((a*?)*(a|b*))*x">({"aax", "abbx"});
+  RequireAgrees<"((b*a?)*?(a*?)){2,}a">({"aabba", "aaaa"});
+  RequireAgrees<"(a*?(a*?))+?x">({"aax", "x"});
+}
+
+TEST_CASE("static regex repeats single bytes without recursing") {
+  RequireAgrees<"a{2,4}?b|x{0,2}+x|[ab]{3,}c">(
+      {"aaab", "ab", "xxx", "xx", "abababc", "abc"});
+  RequireAgrees<"(a*?)(a{2})(\\d+?)$">({"aaaa12", "a1", "aa"});
+
+  std::string s(size_t{1} << 20, 'a');
+  using Either = regex::Static<"a*b|a*">;
+  REQUIRE(Either::Match(s).Size() == s.size());
+  REQUIRE(regex::Static<"a*?b">::Match(s + "b").Size() == s.size() + 1);
+  REQUIRE_FALSE(regex::Static<"^[^b]++b">::Test(s));
+  REQUIRE(regex::Static<".+$">::Match(s).Size() == s.size());
+}
+
+TEST_CASE("static regex stays linear on hostile input") {
+  using Hostile = regex::Static<"^(a|aa)*$">;
+  std::string s(2000, 'a');
+  REQUIRE(Hostile::Match(s).Group(1) == "a");
+  s.push_back('b');
+  REQUIRE_FALSE(Hostile::Test(s));
+  REQUIRE_FALSE(regex::Static<"(a|a)*b">::Test(std::string(2000, 'a')));
+  REQUIRE_FALSE(regex::Static<"(a*)*(a*)*c">::Test(std::string(2000, 'a')));
+}
+
+TEST_CASE("static regex gives up on deep repeats") {
+  std::string s;
+  for (size_t i = 0; i < size_t{1} << 20; ++i) s += "ab";
+  using Deep = regex::Static<"(ab)*c|b">;
+  auto matcher = Deep::Match(s);
+  REQUIRE_FALSE(matcher);
+  REQUIRE(matcher.overflowed());
+  matcher = Deep::Match(s.substr(0, 2000) + "c");
+  REQUIRE(matcher.Size() == 2001);
+  REQUIRE_FALSE(matcher.overflowed());
+  REQUIRE_FALSE(Deep::Match("xd").overflowed());
+}
+
+TEST_CASE("static regex agrees with graph up to the depth limit") {
+  // each iteration nests the four nodes of "(ab)"
+  constexpr size_t kLimit = regex::ct::Context<2>::kMaxDepth / 4;
+  using Deep = regex::Static<"(ab)*c|(ab)*">;
+  auto graph = regex::Graph::Compile("(ab)*c|(ab)*");
+  for (size_t n : {kLimit - 1, kLimit, kLimit + 1}) {
+    std::string s;
+    for (size_t i = 0; i < n; ++i) s += "ab";
+    s += "c";
+    auto expected = graph.Match(s);
+    REQUIRE(expected.Size() == s.size());
+    auto matcher = Deep::Match(s);
+    if (n < kLimit) {
+      REQUIRE(matcher.Str() == expected.Str());
+      REQUIRE(matcher.Group(1) == expected.Group(1));
+      REQUIRE_FALSE(matcher.overflowed());
+    } else {
+      // the graph still finds the match the static matcher gives up on
+      REQUIRE_FALSE(matcher);
+      REQUIRE(matcher.overflowed());
+    }
+  }
+}